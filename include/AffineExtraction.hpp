@@ -0,0 +1,512 @@
+#pragma once
+
+#include "./ArrayReference.hpp"
+#include "./LoopBlock.hpp"
+#include "./Loops.hpp"
+#include "./Math.hpp"
+#include "./ModuleContext.hpp"
+#include "./Schedule.hpp"
+#include "./Symbolics.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/PostOrderIterator.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Support/Casting.h>
+
+// struct AffineForm
+// `constant + sum_l coefs[l] * x_l`, where `x_l` counts the iterations of the
+// enclosing loop at depth `l` (`0` is outermost), and the coefficients are
+// polynomials in the symbols. `loop` is the innermost loop with a nonzero
+// coefficient; all others enclose it.
+struct AffineForm {
+    MPoly constant;
+    llvm::SmallVector<MPoly, 4> coefs;
+    const llvm::Loop *loop{nullptr};
+
+    AffineForm() = default;
+    AffineForm(MPoly constant) : constant(std::move(constant)) {}
+    bool isInvariant() const { return loop == nullptr; }
+    // `false` if the loops of `*this` and `y` aren't nested
+    bool add(const AffineForm &y) {
+        if (y.loop && loop && !loop->contains(y.loop)) {
+            if (!y.loop->contains(loop))
+                return false;
+        } else if (y.loop) {
+            loop = y.loop;
+        }
+        constant += y.constant;
+        if (coefs.size() < y.coefs.size())
+            coefs.resize(y.coefs.size());
+        for (size_t l = 0; l < y.coefs.size(); ++l)
+            coefs[l] += y.coefs[l];
+        return true;
+    }
+    void mul(const MPoly &s) {
+        constant *= s;
+        for (auto &c : coefs)
+            c *= s;
+    }
+};
+
+// struct AffineExtraction
+// Builds the `LoopBlock` of a function from its IR.
+//
+// Every top-level loop nest is a candidate. The address of each load and store
+// is decomposed through SCEV into `base + elSize * index`, where `index` is an
+// `AffineForm`. The address must be an affine `SCEVAddRecExpr` in the loops of
+// the nest. Its steps and start may be polynomials in loop-invariant
+// `SCEVUnknown`s, which become symbols of the `FunctionContext`. Each distinct
+// monomial multiplying an induction variable becomes a dimension of the
+// `ArrayReference`, with that monomial as its stride. Offsets are assigned
+// to the dim whose stride they are a multiple of, by a constant or by one
+// symbol, e.g. `A[i*N + j + N]` gives `A[i + 1, j]` with strides `[1, N]`.
+// Other offsets get a dim of their own. The dims are only kept if the loop
+// bounds prove each index is below the ratio of the next stride to its own,
+// e.g. `0 <= j <= N - 1` above; `A[i*N + j + 1]` would wrap into the next row
+// when `j == N - 1`. As a single dim could not have the symbolic coefficient
+// `N`, the nest is dropped if this is not proven.
+// Loop `l` runs `x_l = 0:btc_l`, where `btc_l` is its backedge-taken count,
+// which must be affine in the symbols and outer loops.
+//
+// A nest is dropped whole if any of its accesses or bounds is not affine, or
+// if it contains any other instruction that may touch memory. Nests and
+// function-level memory operations are numbered in program order by
+// `omega[0]`; a gap in `omega[0]` between two modeled nests means something
+// unmodeled lies between them. Bases are distinct arrays only if they are
+// identified objects, e.g. `noalias` arguments, globals, or allocas. If not,
+// nothing is modeled unless all accesses share a single base.
+//
+// SCEV-to-`AffineForm` conversions are memoized per nest. Their validity
+// depends on which values are invariant in the nest.
+struct AffineExtraction {
+    FunctionContext &ctx;
+    llvm::ScalarEvolution &SE;
+    llvm::LoopInfo &LI;
+    const llvm::DataLayout &DL;
+    LoopBlock &lblock;
+    llvm::DenseMap<const llvm::SCEV *, llvm::Optional<AffineForm>> forms;
+    // per loop of the current nest
+    llvm::DenseMap<const llvm::Loop *, llvm::Optional<AffineForm>> bounds;
+    llvm::DenseMap<const llvm::Loop *, llvm::IntrusiveRefCntPtr<AffineLoopNest>>
+        loops;
+    const llvm::Loop *nest{nullptr};
+    llvm::DenseMap<const llvm::Value *, size_t> arrayIDs;
+    llvm::SmallVector<const llvm::Value *> bases;
+    llvm::SmallVector<uint64_t> elSizes;
+    size_t numNests{0};
+    size_t numModeledNests{0};
+
+    AffineExtraction(FunctionContext &ctx, llvm::ScalarEvolution &SE,
+                     llvm::LoopInfo &LI, const llvm::DataLayout &DL,
+                     LoopBlock &lblock)
+        : ctx(ctx), SE(SE), LI(LI), DL(DL), lblock(lblock) {}
+
+    llvm::Optional<AffineForm> getForm(const llvm::SCEV *S) {
+        auto it = forms.find(S);
+        if (it != forms.end())
+            return it->second;
+        llvm::Optional<AffineForm> f = buildForm(S);
+        // `buildForm` recurses, so insert afterwards
+        forms.insert(std::make_pair(S, f));
+        return f;
+    }
+    // backedge-taken count of `L`, which must be in the current nest
+    llvm::Optional<AffineForm> getBound(const llvm::Loop *L) {
+        auto it = bounds.find(L);
+        if (it != bounds.end())
+            return it->second;
+        llvm::Optional<AffineForm> f;
+        const llvm::SCEV *btc = SE.getBackedgeTakenCount(L);
+        if (!llvm::isa<llvm::SCEVCouldNotCompute>(btc)) {
+            // guards can both remove and introduce `smax`es
+            f = getForm(btc);
+            if (!f)
+                f = getForm(SE.applyLoopGuards(btc, L));
+            if (f && f->loop && !(f->loop != L && f->loop->contains(L)))
+                f = llvm::None;
+        }
+        bounds.insert(std::make_pair(L, f));
+        return f;
+    }
+
+    void extract(llvm::Function &F) {
+        llvm::ReversePostOrderTraversal<llvm::Function *> RPOT(&F);
+        llvm::SmallVector<llvm::BasicBlock *> blocks(RPOT.begin(), RPOT.end());
+        int64_t position = 0;
+        llvm::SmallPtrSet<const llvm::Loop *, 8> visited;
+        for (llvm::BasicBlock *BB : blocks) {
+            llvm::Loop *L = LI.getLoopFor(BB);
+            if (!L) {
+                if (std::any_of(BB->begin(), BB->end(),
+                                [](llvm::Instruction &I) {
+                                    return touchesMemory(I);
+                                }))
+                    ++position;
+                continue;
+            }
+            while (L->getParentLoop())
+                L = L->getParentLoop();
+            if (visited.insert(L).second)
+                extractNest(L, blocks, position++);
+        }
+        for (auto base : bases) {
+            if ((bases.size() > 1) && !llvm::isIdentifiedObject(base)) {
+                lblock.memory.clear();
+                break;
+            }
+        }
+        for (auto &m : lblock.memory)
+            lblock.userToMemory.insert(std::make_pair(m.user, &m));
+    }
+
+  private:
+    static bool touchesMemory(llvm::Instruction &I) {
+        if (!I.mayReadOrWriteMemory())
+            return false;
+        if (auto *II = llvm::dyn_cast<llvm::IntrinsicInst>(&I))
+            return !II->isAssumeLikeIntrinsic();
+        return true;
+    }
+    static llvm::Optional<AffineForm> product(llvm::Optional<AffineForm> x,
+                                              llvm::Optional<AffineForm> y) {
+        if (!(x && y))
+            return llvm::None;
+        if (!x->isInvariant())
+            std::swap(x, y);
+        if (!x->isInvariant())
+            return llvm::None;
+        y->mul(x->constant);
+        return y;
+    }
+    llvm::Optional<AffineForm> buildForm(const llvm::SCEV *S) {
+        if (auto *C = llvm::dyn_cast<llvm::SCEVConstant>(S)) {
+            const llvm::APInt &x = C->getAPInt();
+            if (x.getMinSignedBits() > 64)
+                return llvm::None;
+            return AffineForm(MPoly(x.getSExtValue()));
+        }
+        if (auto *U = llvm::dyn_cast<llvm::SCEVUnknown>(S)) {
+            if (auto *I = llvm::dyn_cast<llvm::Instruction>(U->getValue()))
+                if (nest && nest->contains(I))
+                    return llvm::None;
+            size_t id = ctx.getSymbol(S);
+            if (!id)
+                return llvm::None;
+            return AffineForm(MPoly(Polynomial::Monomial(
+                Polynomial::ID{static_cast<IDType>(id)})));
+        }
+        // `sext(n)` is `n`, as we treat symbols as signed
+        if (auto *X = llvm::dyn_cast<llvm::SCEVSignExtendExpr>(S))
+            if (llvm::isa<llvm::SCEVUnknown>(X->getOperand()))
+                return getForm(X->getOperand());
+        if (auto *A = llvm::dyn_cast<llvm::SCEVAddExpr>(S)) {
+            AffineForm f;
+            for (const llvm::SCEV *op : A->operands()) {
+                llvm::Optional<AffineForm> g = getForm(op);
+                if (!(g && f.add(*g)))
+                    return llvm::None;
+            }
+            return f;
+        }
+        if (auto *M = llvm::dyn_cast<llvm::SCEVMulExpr>(S)) {
+            llvm::Optional<AffineForm> f = AffineForm(MPoly(int64_t(1)));
+            for (const llvm::SCEV *op : M->operands())
+                if (!(f = product(std::move(f), getForm(op))))
+                    return llvm::None;
+            return f;
+        }
+        if (auto *R = llvm::dyn_cast<llvm::SCEVAddRecExpr>(S)) {
+            const llvm::Loop *L = R->getLoop();
+            if (!(R->isAffine() && nest && nest->contains(L)))
+                return llvm::None;
+            llvm::Optional<AffineForm> f = getForm(R->getStart());
+            llvm::Optional<AffineForm> step =
+                getForm(R->getStepRecurrence(SE));
+            if (!(f && step && step->isInvariant()))
+                return llvm::None;
+            if (f->loop && !(f->loop != L && f->loop->contains(L)))
+                return llvm::None;
+            size_t depth = L->getLoopDepth() - 1;
+            if (f->coefs.size() <= depth)
+                f->coefs.resize(depth + 1);
+            f->coefs[depth] += step->constant;
+            f->loop = L;
+            return f;
+        }
+        return llvm::None;
+    }
+
+    struct Access {
+        llvm::Instruction *I;
+        const llvm::Loop *L;
+        size_t arrayID;
+        AffineForm index; // in elements
+        llvm::SmallVector<int64_t, 8> omega;
+        // filled by `layout`
+        llvm::SmallVector<Polynomial::Monomial, 3> dims;
+        bool hasSymbolicOffsets{false};
+    };
+    static llvm::SmallVector<const llvm::Loop *, 4>
+    chain(const llvm::Loop *L) {
+        llvm::SmallVector<const llvm::Loop *, 4> loops;
+        for (; L; L = L->getParentLoop())
+            loops.push_back(L);
+        std::reverse(loops.begin(), loops.end());
+        return loops;
+    }
+    static bool lessMonomial(const Polynomial::Monomial &a,
+                             const Polynomial::Monomial &b) {
+        return b.lexGreater(a);
+    }
+    static void addDim(llvm::SmallVectorImpl<Polynomial::Monomial> &dims,
+                       const Polynomial::Monomial &m) {
+        if (std::find(dims.begin(), dims.end(), m) == dims.end())
+            dims.push_back(m);
+    }
+    // `d` such that `m == dims[d]`, or `m == dims[d] * s` for a symbol `s`,
+    // which is returned as the second value (`One` if equal).
+    static llvm::Optional<std::pair<size_t, Polynomial::Monomial>>
+    findDim(llvm::ArrayRef<Polynomial::Monomial> dims,
+            const Polynomial::Monomial &m) {
+        for (size_t d = 0; d < dims.size(); ++d)
+            if (dims[d] == m)
+                return std::make_pair(d, Polynomial::Monomial());
+        for (size_t d = 0; d < dims.size(); ++d) {
+            auto [n, den] = m.rational(dims[d]);
+            if (den.isCompileTimeConstant() && (n.degree() == 1))
+                return std::make_pair(d, n);
+        }
+        return llvm::None;
+    }
+    // assigns `a.dims`, and adds the symbols offsets are multiples of to
+    // `symbols`
+    static void layout(Access &a,
+                       llvm::SmallVectorImpl<Polynomial::Monomial> &symbols) {
+        for (auto &c : a.index.coefs)
+            for (auto &t : c.terms)
+                addDim(a.dims, t.exponent);
+        for (auto &t : a.index.constant.terms)
+            if (!findDim(a.dims, t.exponent))
+                addDim(a.dims, t.exponent);
+        if (a.dims.empty())
+            a.dims.push_back(Polynomial::Monomial());
+        std::sort(a.dims.begin(), a.dims.end(), lessMonomial);
+        for (auto &t : a.index.constant.terms) {
+            auto d = findDim(a.dims, t.exponent);
+            if (!d->second.isCompileTimeConstant()) {
+                a.hasSymbolicOffsets = true;
+                addDim(symbols, d->second);
+            }
+        }
+    }
+    llvm::Optional<Access> getAccess(llvm::Instruction &I) {
+        llvm::Value *ptr = llvm::getLoadStorePointerOperand(&I);
+        if (!ptr)
+            return llvm::None;
+        if (auto *load = llvm::dyn_cast<llvm::LoadInst>(&I)) {
+            if (!load->isSimple())
+                return llvm::None;
+        } else if (!llvm::cast<llvm::StoreInst>(&I)->isSimple()) {
+            return llvm::None;
+        }
+        llvm::TypeSize size = DL.getTypeStoreSize(llvm::getLoadStoreType(&I));
+        if (size.isScalable() || (size.getFixedSize() == 0))
+            return llvm::None;
+        const uint64_t elSize = size.getFixedSize();
+        const llvm::SCEV *S = SE.getSCEV(ptr);
+        auto *base = llvm::dyn_cast<llvm::SCEVUnknown>(SE.getPointerBase(S));
+        if (!base)
+            return llvm::None;
+        const llvm::SCEV *offset = SE.getMinusSCEV(S, base);
+        if (llvm::isa<llvm::SCEVCouldNotCompute>(offset))
+            return llvm::None;
+        llvm::Optional<AffineForm> index = getForm(offset);
+        const llvm::Loop *L = LI.getLoopFor(I.getParent());
+        if (!index || (index->loop && !index->loop->contains(L)))
+            return llvm::None;
+        // bytes to elements
+        auto divides = [=](const MPoly &p) {
+            return std::all_of(p.terms.begin(), p.terms.end(), [=](auto &t) {
+                return (t.coefficient % int64_t(elSize)) == 0;
+            });
+        };
+        if (!(divides(index->constant) &&
+              std::all_of(index->coefs.begin(), index->coefs.end(), divides)))
+            return llvm::None;
+        for (auto &t : index->constant.terms)
+            t.coefficient /= int64_t(elSize);
+        for (auto &c : index->coefs)
+            for (auto &t : c.terms)
+                t.coefficient /= int64_t(elSize);
+        const llvm::Value *v = base->getValue();
+        auto [it, inserted] = arrayIDs.insert(std::make_pair(v, bases.size()));
+        if (inserted) {
+            bases.push_back(v);
+            elSizes.push_back(elSize);
+        } else if (elSizes[it->second] != elSize) {
+            return llvm::None;
+        }
+        return Access{&I, L, it->second, std::move(*index), {}, {}, false};
+    }
+    // adds `sum_k p_k * [1, symbols]_k` for the invariant `p` to row `r`
+    static bool addInvariant(MutPtrVector<int64_t> row, const MPoly &p,
+                             llvm::ArrayRef<Polynomial::Monomial> symbols) {
+        for (auto &t : p.terms) {
+            if (t.exponent.isCompileTimeConstant()) {
+                row[0] += t.coefficient;
+                continue;
+            }
+            auto it = std::find(symbols.begin(), symbols.end(), t.exponent);
+            if (it == symbols.end())
+                return false;
+            row[1 + (it - symbols.begin())] += t.coefficient;
+        }
+        return true;
+    }
+    // Whether the index of each dim `d` of `ref` is in
+    // `[0, strides[d+1]/strides[d] - 1]`, so that its dims are independent.
+    bool isDelinearized(const ArrayReference &ref) const {
+        for (size_t d = 0; d + 1 < ref.arrayDim(); ++d) {
+            auto [radix, rem] = divRem(ref.strides[d + 1], ref.strides[d]);
+            if (!isZero(rem))
+                return false;
+            const std::pair<unsigned, int64_t> dim(d, 1);
+            if (!DependencePolyhedra::withinRadix(ref, dim, radix, ctx.poset))
+                return false;
+        }
+        return true;
+    }
+    llvm::IntrusiveRefCntPtr<AffineLoopNest>
+    getLoop(const llvm::Loop *L, llvm::ArrayRef<Polynomial::Monomial> symbols) {
+        auto it = loops.find(L);
+        if (it != loops.end())
+            return it->second;
+        auto outer = chain(L);
+        const size_t numLoops = outer.size();
+        const size_t numConst = 1 + symbols.size();
+        IntMatrix A(2 * numLoops, numConst + numLoops);
+        llvm::IntrusiveRefCntPtr<AffineLoopNest> ret;
+        for (size_t k = 0; k < numLoops; ++k) {
+            // x_k >= 0; btc_k - x_k >= 0
+            A(2 * k, numConst + k) = 1;
+            A(2 * k + 1, numConst + k) = -1;
+            llvm::Optional<AffineForm> btc = getBound(outer[k]);
+            if (!addInvariant(A(2 * k + 1, _), btc->constant, symbols))
+                return ret;
+            for (size_t j = 0; j < btc->coefs.size(); ++j) {
+                const MPoly &c = btc->coefs[j];
+                if (isZero(c))
+                    continue;
+                if (!c.isCompileTimeConstant())
+                    return ret;
+                A(2 * k + 1, numConst + j) += c.leadingCoefficient();
+            }
+        }
+        ret = AffineLoopNest::construct(
+            std::move(A), llvm::SmallVector<Polynomial::Monomial>(
+                              symbols.begin(), symbols.end()));
+        loops.insert(std::make_pair(L, ret));
+        return ret;
+    }
+    void extractNest(const llvm::Loop *outer,
+                     llvm::ArrayRef<llvm::BasicBlock *> blocks, int64_t omega0) {
+        ++numNests;
+        nest = outer;
+        forms.clear();
+        bounds.clear();
+        loops.clear();
+        // position of each loop within its parent, and the number of
+        // children of each loop so far
+        llvm::DenseMap<const llvm::Loop *, int64_t> position, count;
+        position[outer] = omega0;
+        llvm::SmallVector<Access, 0> accesses;
+        for (llvm::BasicBlock *BB : blocks) {
+            if (!outer->contains(BB))
+                continue;
+            auto loopsBB = chain(LI.getLoopFor(BB));
+            for (size_t k = 1; k < loopsBB.size(); ++k)
+                if (!position.count(loopsBB[k]))
+                    position[loopsBB[k]] = count[loopsBB[k - 1]]++;
+            for (llvm::Instruction &I : *BB) {
+                if (!touchesMemory(I))
+                    continue;
+                llvm::Optional<Access> a = getAccess(I);
+                if (!a)
+                    return;
+                for (auto L : loopsBB) {
+                    if (!getBound(L))
+                        return;
+                    a->omega.push_back(position[L]);
+                    a->omega.push_back(0);
+                }
+                a->omega.push_back(count[loopsBB.back()]++);
+                accesses.push_back(std::move(*a));
+            }
+        }
+        // symbols of the whole nest, so that its `AffineLoopNest`s agree
+        llvm::SmallVector<Polynomial::Monomial> symbols;
+        for (auto &[L, btc] : bounds)
+            for (auto &t : btc->constant.terms)
+                if (!t.exponent.isCompileTimeConstant())
+                    addDim(symbols, t.exponent);
+        for (auto &a : accesses)
+            layout(a, symbols);
+        std::sort(symbols.begin(), symbols.end(), lessMonomial);
+        llvm::SmallVector<llvm::IntrusiveRefCntPtr<AffineLoopNest>> aln;
+        for (auto &a : accesses) {
+            aln.push_back(getLoop(a.L, symbols));
+            if (!aln.back())
+                return;
+        }
+        llvm::SmallVector<ArrayReference, 0> refs;
+        refs.reserve(accesses.size());
+        for (size_t i = 0; i < accesses.size(); ++i) {
+            Access &a = accesses[i];
+            ArrayReference ref(a.arrayID, aln[i], a.dims.size(),
+                               a.hasSymbolicOffsets);
+            MutPtrMatrix<int64_t> ind = ref.indexMatrix();
+            MutPtrMatrix<int64_t> off = ref.offsetMatrix();
+            for (size_t d = 0; d < a.dims.size(); ++d)
+                ref.strides[d] = MPoly(a.dims[d]);
+            for (size_t l = 0; l < a.index.coefs.size(); ++l)
+                for (auto &t : a.index.coefs[l].terms)
+                    ind(l, findDim(a.dims, t.exponent)->first) +=
+                        t.coefficient;
+            for (auto &t : a.index.constant.terms) {
+                auto [d, s] = *findDim(a.dims, t.exponent);
+                size_t j = 0;
+                if (!s.isCompileTimeConstant())
+                    j = 1 + (std::find(symbols.begin(), symbols.end(), s) -
+                             symbols.begin());
+                off(d, j) += t.coefficient;
+            }
+            if (!isDelinearized(ref))
+                return;
+            refs.push_back(std::move(ref));
+        }
+        for (size_t i = 0; i < accesses.size(); ++i) {
+            Access &a = accesses[i];
+            Schedule sch(aln[i]->getNumLoops());
+            MutPtrVector<int64_t> omega = sch.getOmega();
+            for (size_t k = 0; k < omega.size(); ++k)
+                omega[k] = a.omega[k];
+            lblock.memory.emplace_back(std::move(refs[i]), a.I, std::move(sch),
+                                       llvm::isa<llvm::LoadInst>(a.I));
+        }
+        ++numModeledNests;
+    }
+};
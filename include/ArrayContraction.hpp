@@ -0,0 +1,219 @@
+#pragma once
+
+#include "./ArrayReference.hpp"
+#include "./BitSets.hpp"
+#include "./Constraints.hpp"
+#include "./LoopBlock.hpp"
+#include "./Loops.hpp"
+#include "./Math.hpp"
+#include "./Schedule.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
+
+// Contraction of the temporary arrays of a `LoopBlock`, typically after
+// `LoopFusion`.
+//
+// An array that is not live after the block, and whose accesses are all fused
+// into the same innermost loop body, only needs to hold the values between a
+// store and its last load. We handle one store and any number of loads with
+// the same index matrix, which maps each dim to a distinct loop (coefficient
+// `1`) or none, and differing only in constant offsets. Then the load
+// `B(i + o)` reads the value stored by `B(i + s)` at distance `d = s - o`,
+// i.e. in iteration `i - d`. Let `p` be the outermost loop in which some `d`
+// is nonzero, and `w - 1` the largest `d_p`. The dims indexed by loops outside
+// `p` can be dropped, the dim indexed by `p` becomes a rolling buffer of `w`,
+// and inner dims are kept. If all `d` are `0`, a scalar suffices.
+// This is legal if
+// 1. every `d` is lexicographically positive, or `0` with the load after the
+//    store in the body,
+// 2. for every `i` in the load's nest, `i - d` is in the store's nest, so no
+//    value from before the block is read, and
+// 3. loops that index no dim are outside of `p`, so the last value stored to
+//    an element is the one from `d` iterations before.
+struct ArrayContraction {
+    llvm::MutableArrayRef<MemoryAccess> memory;
+    // largest rolling buffer
+    int64_t maxWindow;
+
+    ArrayContraction(LoopBlock &lblock, int64_t maxWindow = 4)
+        : memory(lblock.memory), maxWindow(maxWindow) {}
+
+    // loop indexing each dim of `ref`, `-1` for constant dims
+    static llvm::Optional<llvm::SmallVector<int, 3>>
+    dimLoops(const ArrayReference &ref) {
+        PtrMatrix<int64_t> M = ref.indexMatrix();
+        llvm::SmallVector<int, 3> loops(ref.arrayDim(), -1);
+        for (size_t l = 0; l < M.numRow(); ++l) {
+            bool found = false;
+            for (size_t k = 0; k < M.numCol(); ++k) {
+                if (int64_t c = M(l, k)) {
+                    if ((c != 1) || found || (loops[k] >= 0))
+                        return {};
+                    loops[k] = l;
+                    found = true;
+                }
+            }
+        }
+        return loops;
+    }
+    // loop at each level of `sch`, which must be a permutation
+    static llvm::Optional<llvm::SmallVector<unsigned>>
+    loopOrder(const Schedule &sch) {
+        SquarePtrMatrix<int64_t> Phi = sch.getPhi();
+        llvm::SmallVector<unsigned> order;
+        for (size_t l = 0; l < Phi.numRow(); ++l) {
+            for (size_t p = 0; p < Phi.numCol(); ++p) {
+                if (int64_t c = Phi(l, p)) {
+                    if ((c != 1) || (order.size() != l))
+                        return {};
+                    order.push_back(p);
+                }
+            }
+            if (order.size() != l + 1)
+                return {};
+        }
+        return order;
+    }
+    static bool sameSymbolicOffsets(const ArrayReference &x,
+                                    const ArrayReference &y) {
+        if (x.hasSymbolicOffsets != y.hasSymbolicOffsets)
+            return false;
+        return x.offsetMatrix()(_, _(1, end)) == y.offsetMatrix()(_, _(1, end));
+    }
+    // Whether `i - d` may lie outside of `src` for some `i` in `dst`. Both
+    // nests must have the same symbols.
+    static bool mayReadOutside(const AffineLoopNest &dst,
+                               const AffineLoopNest &src,
+                               llvm::ArrayRef<int64_t> d) {
+        const size_t numSymbols = src.getNumSymbols();
+        for (size_t r = 0; r < src.A.numRow(); ++r) {
+            // `src.A(r,_) * [1, symbols, i - d] <= -1`
+            IntMatrix B = dst.A;
+            const size_t n = B.numRow();
+            B.resizeRows(n + 1);
+            for (size_t k = 0; k < B.numCol(); ++k)
+                B(n, k) = -src.A(r, k);
+            for (size_t l = 0; l < d.size(); ++l)
+                B(n, 0) += src.A(r, numSymbols + l) * d[l];
+            --B(n, 0);
+            IntMatrix E(0, B.numCol());
+            if (!rationallyEmpty(B, E))
+                return true;
+        }
+        return false;
+    }
+    // Contraction of `arrayID`, see `ArrayReference::contraction`, or `None`
+    // if it cannot be contracted.
+    llvm::Optional<llvm::SmallVector<int64_t, 3>>
+    buffer(size_t arrayID) const {
+        const MemoryAccess *store = nullptr;
+        llvm::SmallVector<const MemoryAccess *> loads;
+        for (auto &m : memory) {
+            if (m.ref.arrayID != arrayID)
+                continue;
+            if (m.isLoad)
+                loads.push_back(&m);
+            else if (store)
+                return {};
+            else
+                store = &m;
+        }
+        if (!store)
+            return {};
+        const ArrayReference &sref = store->ref;
+        const Schedule &ssch = store->schedule;
+        const size_t numLoops = sref.getNumLoops();
+        auto loops = dimLoops(sref);
+        auto order = loopOrder(ssch);
+        if (!loops || !order || (ssch.getNumLoops() != numLoops))
+            return {};
+        // outermost level carrying a value, `numLoops` if none
+        size_t p = numLoops;
+        llvm::SmallVector<llvm::SmallVector<int64_t>> dists;
+        for (auto load : loads) {
+            const ArrayReference &lref = load->ref;
+            const Schedule &lsch = load->schedule;
+            if ((lref.getNumLoops() != numLoops) ||
+                (lsch.getNumLoops() != numLoops) ||
+                !ssch.fusedThrough(lsch, numLoops) ||
+                !(lsch.getPhi() == ssch.getPhi()) ||
+                (lref.loop->symbols != sref.loop->symbols) ||
+                !(lref.indexMatrix() == sref.indexMatrix()) ||
+                !sameSymbolicOffsets(sref, lref))
+                return {};
+            // indexed by loop
+            llvm::SmallVector<int64_t> &d = dists.emplace_back(numLoops, 0);
+            for (size_t k = 0; k < sref.arrayDim(); ++k) {
+                int64_t diff =
+                    sref.offsetMatrix()(k, 0) - lref.offsetMatrix()(k, 0);
+                if ((*loops)[k] >= 0)
+                    d[(*loops)[k]] = diff;
+                else if (diff) // never stored within the block
+                    return {};
+            }
+            size_t l = 0;
+            while ((l < numLoops) && (d[(*order)[l]] == 0))
+                ++l;
+            if (l == numLoops) {
+                if (lsch.getOmega()[2 * numLoops] <=
+                    ssch.getOmega()[2 * numLoops])
+                    return {};
+            } else if (d[(*order)[l]] < 0) {
+                return {};
+            }
+            p = std::min(p, l);
+            if (mayReadOutside(*lref.loop, *sref.loop, d))
+                return {};
+        }
+        int64_t w = 1;
+        if (p < numLoops) {
+            for (auto &d : dists)
+                w = std::max(w, d[(*order)[p]] + 1);
+            if (w > maxWindow)
+                return {};
+            for (size_t l = p + 1; l < numLoops; ++l)
+                if (std::find(loops->begin(), loops->end(),
+                              int((*order)[l])) == loops->end())
+                    return {};
+        }
+        llvm::SmallVector<int64_t, 3> contraction;
+        for (auto loop : *loops) {
+            if (loop < 0) {
+                contraction.push_back(1);
+                continue;
+            }
+            size_t l = std::find(order->begin(), order->end(), unsigned(loop)) -
+                       order->begin();
+            contraction.push_back(l < p ? 1 : (l == p ? w : 0));
+        }
+        return contraction;
+    }
+    // Contracts all arrays not in `liveOut`, returning how many were.
+    // `liveOut` must be large enough to hold every `arrayID`.
+    size_t contract(const BitSet &liveOut) {
+        size_t numContracted = 0;
+        size_t numArrays = 0;
+        for (auto &m : memory)
+            numArrays = std::max(numArrays, m.ref.arrayID + 1);
+        BitSet visited(numArrays);
+        for (auto &m : memory) {
+            const size_t id = m.ref.arrayID;
+            if (contains(visited, id))
+                continue;
+            push(visited, id);
+            if (contains(liveOut, id))
+                continue;
+            if (auto c = buffer(id)) {
+                for (auto &a : memory)
+                    if (a.ref.arrayID == id)
+                        a.ref.contraction = *c;
+                ++numContracted;
+            }
+        }
+        return numContracted;
+    }
+};
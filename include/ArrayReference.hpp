@@ -3,6 +3,7 @@
 #include "./Loops.hpp"
 #include "./Math.hpp"
 #include "./Symbolics.hpp"
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <llvm/ADT/IntrusiveRefCntPtr.h>
@@ -28,6 +29,11 @@ struct ArrayReference {
     //     offsets; // symbolicOffsets * (loop->symbols)
     llvm::SmallVector<int64_t, 16> indices;
     bool hasSymbolicOffsets; // normal case is not to
+    // Storage contraction, empty if the array is kept as is. Otherwise, one
+    // entry per dim: `0` keeps the dim, and `w > 0` takes its index modulo
+    // `w`, i.e. a rolling buffer of `w` (`1` drops the dim).
+    // See `ArrayContraction`.
+    llvm::SmallVector<int64_t, 3> contraction;
 
     size_t arrayDim() const { return strides.size(); }
     size_t getNumLoops() const { return loop->getNumLoops(); }
@@ -104,6 +110,13 @@ struct ArrayReference {
         resize(dim);
     };
     bool isLoopIndependent() const { return allZero(indices); }
+    bool isContracted() const { return !contraction.empty(); }
+    // all dims dropped, so the array can be replaced with a scalar
+    bool isScalarReplaced() const {
+        return isContracted() &&
+               std::all_of(contraction.begin(), contraction.end(),
+                           [](int64_t w) { return w == 1; });
+    }
     bool allConstantIndices() const { return !hasSymbolicOffsets; }
     // Assumes strides and offsets are sorted
     bool stridesMatch(const ArrayReference &x) const {
@@ -169,12 +182,30 @@ struct ArrayReference {
         }
         return os;
     }
-    // use gcd to check if they're known to be independent
-    bool gcdKnownIndependent(const ArrayReference &) const {
-        // TODO: handle this!
-        // consider `x[2i]` vs `x[2i + 1]`, the former
-        // will have a stride of `2`, and the latter of `x[2i+1]`
-        // Additionally, in the future, we do
+    // Uses the gcd test to check if `x(i) == y(j)` has no integer solution.
+    // For matching strides, each dim requires
+    // `sum_l a_l i_l - sum_l b_l j_l == c_y - c_x`, so `gcd(a, b)` must
+    // divide `c_y - c_x`; e.g., `x[2i]` and `x[2j + 1]` are independent.
+    // Dims with symbolic offsets are skipped.
+    bool gcdKnownIndependent(const ArrayReference &y) const {
+        if (!stridesMatch(y))
+            return false;
+        PtrMatrix<int64_t> Ax = indexMatrix();
+        PtrMatrix<int64_t> Ay = y.indexMatrix();
+        PtrMatrix<int64_t> Ox = offsetMatrix();
+        PtrMatrix<int64_t> Oy = y.offsetMatrix();
+        for (size_t k = 0; k < arrayDim(); ++k) {
+            if (!allZero(Ox(k, _(1, end))) || !allZero(Oy(k, _(1, end))))
+                continue;
+            int64_t g = 0;
+            for (size_t l = 0; l < Ax.numRow(); ++l)
+                g = gcd(g, Ax(l, k));
+            for (size_t l = 0; l < Ay.numRow(); ++l)
+                g = gcd(g, Ay(l, k));
+            int64_t c = Oy(k, 0) - Ox(k, 0);
+            if (g ? (c % g) : c)
+                return true;
+        }
         return false;
     }
 };
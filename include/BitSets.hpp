@@ -1,5 +1,7 @@
 #pragma once
 #include "./Math.hpp"
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -24,6 +26,7 @@ struct BitSet {
         return data[i];
     } // allow `getindex` but not `setindex`
 
+    BitSet() : length(0) {}
     BitSet(size_t N) : length(0) {
         size_t len = (N + 63) >> 6;
         data.resize(len);
@@ -33,6 +36,7 @@ struct BitSet {
         // data = std::vector<std::uint64_t>(0, (N + 63) >> 6);
     }
     struct Iterator;
+    struct Reference;
     Iterator begin() const;
     size_t end() const { return length; };
 };
@@ -41,24 +45,19 @@ struct BitSet::Iterator {
     // TODO: is this safe?
     llvm::ArrayRef<std::uint64_t> set;
     size_t didx;
-    uint64_t offset; // offset with 64 bit block
-    uint64_t state;
+    uint64_t state; // remaining bits of `set[didx]`
     size_t count;
 
-    size_t operator*() { return offset + 64 * didx; }
+    size_t operator*() { return 64 * didx + std::countr_zero(state); }
     BitSet::Iterator &operator++() {
         ++count;
+        // clear lowest set bit, then find the next non-zero block
+        state &= state - 1;
         while (state == 0) {
-            ++didx;
-            if (didx >= set.size())
+            if (++didx >= set.size())
                 return *this;
             state = set[didx];
-            offset = std::numeric_limits<uint64_t>::max();
-            // offset = 0xffffffffffffffff;
         }
-        size_t tzp1 = std::countr_zero(state) + 1;
-        offset += tzp1;
-        state >>= tzp1;
         return *this;
     }
     bool operator!=(size_t x) { return count != x; }
@@ -66,23 +65,28 @@ struct BitSet::Iterator {
     bool operator!=(BitSet::Iterator x) { return count != x.count; }
     bool operator==(BitSet::Iterator x) { return count == x.count; }
 };
-// BitSet::Iterator(std::vector<std::uint64_t> &seta)
-//     : set(seta), didx(0), offset(0), state(seta[0]), count(0) {};
 BitSet::Iterator construct(llvm::ArrayRef<std::uint64_t> const &seta) {
-    return BitSet::Iterator{seta, 0, std::numeric_limits<uint64_t>::max(),
-                            seta[0], std::numeric_limits<uint64_t>::max()};
+    // `count` starts at `-1`, so it wraps to `0` on the first increment;
+    // the sentinel bit is cleared by that increment as well.
+    BitSet::Iterator it{seta, 0, 1, std::numeric_limits<size_t>::max()};
+    if (seta.size() && seta[0]) {
+        it.state = seta[0];
+        it.count = 0;
+        return it;
+    }
+    return ++it;
 }
 
-BitSet::Iterator BitSet::begin() const { return ++construct(this->data); }
+BitSet::Iterator BitSet::begin() const { return construct(this->data); }
 
-uint64_t contains(BitSet &s, size_t x) {
+uint64_t contains(const BitSet &s, size_t x) {
     size_t d = x >> size_t(6);
     uint64_t r = uint64_t(x) & uint64_t(63);
     uint64_t mask = uint64_t(1) << r;
     return (s.data[d] & (mask));
 }
 
-size_t length(BitSet s) { return s.length; }
+size_t length(const BitSet &s) { return s.length; }
 
 bool push(BitSet &s, size_t x) {
     size_t d = x >> size_t(6);
@@ -108,6 +112,83 @@ bool remove(BitSet &s, size_t x) {
     return contained;
 }
 
+void clear(BitSet &s) {
+    for (auto &d : s.data)
+        d = 0;
+    s.length = 0;
+}
+
+// calls `f(x)` for each `x` in `s`, in increasing order
+template <typename F> void forEach(const BitSet &s, F &&f) {
+    for (size_t d = 0; d < s.data.size(); ++d)
+        for (uint64_t w = s.data[d]; w; w &= w - 1)
+            f(64 * d + std::countr_zero(w));
+}
+size_t popcount(const BitSet &s) {
+    size_t c = 0;
+    for (auto d : s.data)
+        c += std::popcount(d);
+    return c;
+}
+// Set algebra; plain word loops, which the compiler vectorizes.
+// Sets may have different capacities, missing words are treated as `0`.
+BitSet &operator|=(BitSet &a, const BitSet &b) {
+    if (a.data.size() < b.data.size())
+        a.data.resize(b.data.size());
+    for (size_t d = 0; d < b.data.size(); ++d)
+        a.data[d] |= b.data[d];
+    a.length = popcount(a);
+    return a;
+}
+BitSet &operator&=(BitSet &a, const BitSet &b) {
+    size_t N = std::min(a.data.size(), b.data.size());
+    for (size_t d = 0; d < N; ++d)
+        a.data[d] &= b.data[d];
+    for (size_t d = N; d < a.data.size(); ++d)
+        a.data[d] = 0;
+    a.length = popcount(a);
+    return a;
+}
+// set difference, `a \ b`
+BitSet &operator-=(BitSet &a, const BitSet &b) {
+    size_t N = std::min(a.data.size(), b.data.size());
+    for (size_t d = 0; d < N; ++d)
+        a.data[d] &= ~b.data[d];
+    a.length = popcount(a);
+    return a;
+}
+BitSet operator|(BitSet a, const BitSet &b) { return a |= b; }
+BitSet operator&(BitSet a, const BitSet &b) { return a &= b; }
+BitSet operator-(BitSet a, const BitSet &b) { return a -= b; }
+// is `a` a subset of `b`?
+bool isSubset(const BitSet &a, const BitSet &b) {
+    size_t N = std::min(a.data.size(), b.data.size());
+    for (size_t d = 0; d < N; ++d)
+        if (a.data[d] & ~b.data[d])
+            return false;
+    for (size_t d = N; d < a.data.size(); ++d)
+        if (a.data[d])
+            return false;
+    return true;
+}
+bool operator==(const BitSet &a, const BitSet &b) {
+    return (a.length == b.length) && isSubset(a, b);
+}
+
+// reference to a single bit of a `BitSet`, e.g. for `visited(graph, i)`
+struct BitSet::Reference {
+    BitSet &s;
+    size_t x;
+    operator bool() const { return contains(s, x); }
+    Reference &operator=(bool b) {
+        if (b)
+            push(s, x);
+        else
+            remove(s, x);
+        return *this;
+    }
+};
+
 std::ostream &operator<<(std::ostream &os, BitSet const &x) {
     os << "BitSet[";
     if (x.length) {
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "./Loops.hpp"
+#include "./Math.hpp"
+#include "./Schedule.hpp"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+#include <utility>
+
+// Generates IR scanning the iteration space of an `AffineLoopNest`.
+//
+// Loops are emitted in the order given by the schedule's `Phi`, which must be
+// a permutation. The bounds of level `l` are those of the nest with all inner
+// levels eliminated, so each loop runs from the max of its lower bounds to the
+// min of its upper bounds, in terms of the symbols and outer loops.
+// Bounds are built as SCEVs and materialized with a `SCEVExpander`, which may
+// be shared across nests. Coefficients other than `+/-1` need a floor or
+// ceiling division; these are emitted directly and enter the SCEVs as
+// `SCEVUnknown`s.
+//
+// Statements sharing the nest are fused through level `l` while their
+// `omega[2*l]` agree, and otherwise emitted in order of `omega`.
+// For tiling, emit `AffineLoopNest::tile` with statements scheduled by
+// `Schedule::tile`. Vectorization and unrolling recorded in the schedule are
+// attached as loop metadata, for LLVM's vectorizer and unrollers to apply.
+struct LoopNestCodeGen {
+    // Emits a statement at the builder's insertion point. The induction
+    // variables are given in the nest's loop order.
+    using Body = llvm::function_ref<void(llvm::IRBuilder<> &,
+                                         llvm::ArrayRef<llvm::Value *>)>;
+    struct Statement {
+        const Schedule *schedule;
+        Body body;
+    };
+    llvm::ScalarEvolution &SE;
+    llvm::SCEVExpander &expander;
+    llvm::IntegerType *indexType;
+    const AffineLoopNest &loop;
+    // one SCEV per `loop.symbols`
+    llvm::SmallVector<const llvm::SCEV *> symbols;
+    // loop emitted at each level
+    llvm::SmallVector<unsigned> order;
+    llvm::SmallVector<std::pair<IntMatrix, IntMatrix>, 0> levelBounds;
+    llvm::SmallVector<llvm::Value *> indVars;
+
+    LoopNestCodeGen(llvm::ScalarEvolution &SE, llvm::SCEVExpander &expander,
+                    llvm::IntegerType *indexType, const AffineLoopNest &loop,
+                    llvm::ArrayRef<const llvm::SCEV *> symbolSCEVs)
+        : SE(SE), expander(expander), indexType(indexType), loop(loop),
+          indVars(loop.getNumLoops(), nullptr) {
+        assert(symbolSCEVs.size() == loop.symbols.size());
+        for (auto S : symbolSCEVs)
+            symbols.push_back(SE.getTruncateOrSignExtend(S, indexType));
+    }
+    // Emits the nest at the builder's insertion point, which must be at the
+    // end of a block without terminator. Afterwards, the builder is at the
+    // end of the block following the nest.
+    // All statements must share `loop` and `Phi`.
+    void emit(llvm::IRBuilder<> &builder, llvm::ArrayRef<Statement> statements) {
+        if (statements.empty())
+            return;
+        setOrder(statements.front().schedule->getPhi());
+        llvm::SmallVector<const Statement *> stmts;
+        for (auto &s : statements) {
+            assert(s.schedule->getPhi() == statements.front().schedule->getPhi());
+            stmts.push_back(&s);
+        }
+        emitLevel(builder, 0, stmts);
+    }
+    void setOrder(SquarePtrMatrix<int64_t> Phi) {
+        const size_t numLoops = loop.getNumLoops();
+        assert(Phi.numRow() == numLoops);
+        order.clear();
+        for (size_t l = 0; l < numLoops; ++l) {
+            for (size_t p = 0; p < numLoops; ++p) {
+                if (Phi(l, p)) {
+                    assert(Phi(l, p) == 1);
+                    order.push_back(p);
+                }
+            }
+            assert(order.size() == l + 1);
+        }
+        levelBounds = loop.getBounds(
+            PtrVector<unsigned>{.mem = order.data(), .N = order.size()});
+    }
+    static int64_t getOmega(const Statement *s, size_t level) {
+        return s->schedule->getOmega()[2 * level];
+    }
+    void emitLevel(llvm::IRBuilder<> &builder, size_t level,
+                   llvm::MutableArrayRef<const Statement *> stmts) {
+        std::stable_sort(stmts.begin(), stmts.end(),
+                         [=](const Statement *a, const Statement *b) {
+                             return getOmega(a, level) < getOmega(b, level);
+                         });
+        if (level == order.size()) {
+            for (auto s : stmts)
+                s->body(builder, indVars);
+            return;
+        }
+        for (size_t b = 0, e = 0; b < stmts.size(); b = e) {
+            int64_t o = getOmega(stmts[b], level);
+            for (e = b + 1; (e < stmts.size()) && (getOmega(stmts[e], level) == o);
+                 ++e) {
+            }
+            emitLoop(builder, level, stmts.slice(b, e - b));
+        }
+    }
+    void emitLoop(llvm::IRBuilder<> &builder, size_t level,
+                  llvm::MutableArrayRef<const Statement *> stmts) {
+        const unsigned p = order[level];
+        llvm::LLVMContext &ctx = builder.getContext();
+        llvm::BasicBlock *preheader = builder.GetInsertBlock();
+        llvm::Function *F = preheader->getParent();
+        llvm::BasicBlock *header = llvm::BasicBlock::Create(ctx, "loop", F);
+        llvm::BasicBlock *body = llvm::BasicBlock::Create(ctx, "loop.body", F);
+        llvm::BasicBlock *latch = llvm::BasicBlock::Create(ctx, "loop.latch", F);
+        llvm::BasicBlock *exit = llvm::BasicBlock::Create(ctx, "loop.exit", F);
+        llvm::BranchInst *br = builder.CreateBr(header);
+        llvm::Value *lower =
+            expandBound(levelBounds[level].second, p, true, br);
+        llvm::Value *upper =
+            expandBound(levelBounds[level].first, p, false, br);
+        builder.SetInsertPoint(header);
+        llvm::PHINode *iv = builder.CreatePHI(indexType, 2, "iv");
+        builder.CreateCondBr(builder.CreateICmpSLE(iv, upper), body, exit);
+        // the phi is complete before inner bounds, which may use it, are
+        // expanded
+        builder.SetInsertPoint(latch);
+        llvm::Value *next =
+            builder.CreateNSWAdd(iv, llvm::ConstantInt::get(indexType, 1));
+        llvm::BranchInst *backedge = builder.CreateBr(header);
+        if (llvm::MDNode *md =
+                loopMetadata(ctx, *stmts.front()->schedule, p,
+                             level + 1 == order.size()))
+            backedge->setMetadata(llvm::LLVMContext::MD_loop, md);
+        iv->addIncoming(lower, preheader);
+        iv->addIncoming(next, latch);
+        builder.SetInsertPoint(body);
+        indVars[p] = iv;
+        emitLevel(builder, level + 1, stmts);
+        builder.CreateBr(latch);
+        indVars[p] = nullptr;
+        builder.SetInsertPoint(exit);
+    }
+    // `row * [1, symbols, indVars]`, without the term of loop `p`
+    const llvm::SCEV *affine(PtrVector<int64_t> row, size_t p) {
+        const size_t numSymbols = loop.getNumSymbols();
+        llvm::SmallVector<const llvm::SCEV *> terms;
+        terms.push_back(SE.getConstant(indexType, row[0], true));
+        for (size_t k = 1; k < numSymbols; ++k)
+            if (int64_t c = row[k])
+                terms.push_back(
+                    SE.getMulExpr(SE.getConstant(indexType, c, true),
+                                  symbols[k - 1]));
+        for (size_t q = 0; q < loop.getNumLoops(); ++q) {
+            int64_t c = row[numSymbols + q];
+            if ((q == p) || (c == 0))
+                continue;
+            // inner loops were eliminated from the bounds
+            assert(indVars[q]);
+            terms.push_back(
+                SE.getMulExpr(SE.getConstant(indexType, c, true),
+                              SE.getUnknown(indVars[q])));
+        }
+        return SE.getAddExpr(terms);
+    }
+    // `floor(x / d)` for `d > 0`
+    static llvm::Value *floorDiv(llvm::IRBuilder<> &builder, llvm::Value *x,
+                                 int64_t d) {
+        llvm::Type *T = x->getType();
+        llvm::Value *D = llvm::ConstantInt::get(T, d);
+        llvm::Value *q = builder.CreateSDiv(x, D);
+        // `sdiv` rounds towards zero
+        llvm::Value *r = builder.CreateSRem(x, D);
+        return builder.CreateSub(
+            q, builder.CreateZExt(
+                   builder.CreateICmpSLT(r, llvm::ConstantInt::get(T, 0)), T));
+    }
+    // Each row of `B` is `a*x_p + rest >= 0`. Lower bounds (`a > 0`) give
+    // `x_p >= ceil(-rest/a) == -floor(rest/a)`, and upper bounds
+    // `x_p <= floor(rest/-a)`.
+    llvm::Value *expandBound(PtrMatrix<int64_t> B, size_t p, bool lower,
+                             llvm::Instruction *IP) {
+        const size_t numSymbols = loop.getNumSymbols();
+        assert(B.numRow());
+        // `floor(rest/|a|)` of each row
+        llvm::SmallVector<const llvm::SCEV *> ops;
+        for (size_t r = 0; r < B.numRow(); ++r) {
+            int64_t a = B(r, numSymbols + p);
+            assert((a > 0) == lower);
+            int64_t d = std::abs(a);
+            const llvm::SCEV *S = affine(B.getRow(r), p);
+            if (d != 1) {
+                llvm::IRBuilder<> builder(IP);
+                S = SE.getUnknown(floorDiv(
+                    builder, expander.expandCodeFor(S, indexType, IP), d));
+            }
+            ops.push_back(S);
+        }
+        const llvm::SCEV *bound = SE.getSMinExpr(ops);
+        if (lower)
+            bound = SE.getNegativeSCEV(bound);
+        return expander.expandCodeFor(bound, indexType, IP);
+    }
+    static llvm::MDNode *loopMetadata(llvm::LLVMContext &ctx,
+                                      const Schedule &sch, size_t p,
+                                      bool innermost) {
+        // the first operand refers to the node itself
+        llvm::SmallVector<llvm::Metadata *, 4> mds{nullptr};
+        auto add = [&](const char *name, llvm::Constant *c) {
+            mds.push_back(llvm::MDNode::get(
+                ctx, {llvm::MDString::get(ctx, name),
+                      llvm::ConstantAsMetadata::get(c)}));
+        };
+        auto i32 = [&](unsigned x) {
+            return llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), x);
+        };
+        // LLVM only vectorizes innermost loops
+        if (innermost && (sch.vectorized == int8_t(p))) {
+            add("llvm.loop.vectorize.enable", llvm::ConstantInt::getTrue(ctx));
+            add("llvm.loop.vectorize.width", i32(sch.vectorWidth));
+        }
+        const char *unroll =
+            innermost ? "llvm.loop.unroll.count" : "llvm.loop.unroll_and_jam.count";
+        if (sch.unrolledInner == int8_t(p))
+            add(unroll, i32(sch.unrollFactorInner));
+        if (sch.unrolledOuter == int8_t(p))
+            add(unroll, i32(sch.unrollFactorOuter));
+        if (mds.size() == 1)
+            return nullptr;
+        llvm::MDNode *md = llvm::MDNode::getDistinct(ctx, mds);
+        md->replaceOperandWith(0, md);
+        return md;
+    }
+};
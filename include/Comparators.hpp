@@ -8,6 +8,7 @@
 #include "Simplex.hpp"
 #include "Symbolics.hpp"
 #include "llvm/ADT/Optional.h"
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -307,6 +308,12 @@ struct LinearSymbolicComparator : BaseComparator<LinearSymbolicComparator> {
     IntMatrix U;
     IntMatrix V;
     Vector<int64_t> d;
+    // `slackMap * q` gives the slack values (full rank case) or the simplex
+    // constants (rank deficient case) for the query `q`.
+    IntMatrix slackMap;
+    IntMatrix expandW;
+    mutable Simplex warmStart;
+    mutable bool hasWarmStart{false};
     size_t numVar;
     size_t numEquations;
     using BaseComparator<LinearSymbolicComparator>::greaterEqual;
@@ -373,8 +380,10 @@ struct LinearSymbolicComparator : BaseComparator<LinearSymbolicComparator> {
         // SHOWLN(H);
         // SHOWLN(R);
         // numRowTrunc = R;
+        hasWarmStart = false;
         if (H.isSquare()) {
             d.clear();
+            initFullRank();
             return;
         }
         IntMatrix Ht = H.transpose();
@@ -383,6 +392,93 @@ struct LinearSymbolicComparator : BaseComparator<LinearSymbolicComparator> {
         d = Ht.diag();
         // std::cout << "D = " << d << std::endl;
         V = Vt.transpose();
+        initRankDeficient();
+    }
+    // Full column rank case: `H*y == U*q` has the unique solution
+    // `y = D^{-1} B U q`, where `B*H == D` is diagonal.
+    // We store `sign(D) .* (B*U)` for the slack rows, so that a query is
+    // known to be `>= 0` iff `slackMap * q >= 0`.
+    void initFullRank() {
+        IntMatrix H = V;
+        auto B = IntMatrix::identity(H.numRow());
+        NormalForm::solveSystem(H, B);
+        IntMatrix BU{B(_(numEquations, end), _) * U};
+        for (size_t i = 0; i < BU.numRow(); ++i)
+            if (H(i + numEquations, i + numEquations) < 0)
+                BU.getRow(i) *= -1;
+        slackMap = std::move(BU);
+        expandW.resize(0, 0);
+    }
+    // Column rank deficient case: the constants of the simplex problem
+    // `[-JV2 JV2][y2+ y2-]' <= JV1 D^{-1} U q` are linear in `q`, so we
+    // store `JV1 * Dlcm * D^{-1} * U` as the `slackMap`, and the (query
+    // independent) `[-JV2 JV2] * Dlcm` block in `expandW`.
+    void initRankDeficient() {
+        size_t numSlack = V.numRow() - numEquations;
+        auto Dlcm = d[0];
+        // We represent D martix as a vector, and multiply the lcm to the
+        // linear equation to avoid store D^(-1) as rational type
+        for (size_t i = 1; i < d.size(); ++i)
+            Dlcm = lcm(Dlcm, d(i));
+        size_t numRowTrunc = U.numRow();
+        IntMatrix DU{U};
+        for (size_t i = 0; i < numRowTrunc; ++i)
+            DU.getRow(i) *= Dlcm / d(i);
+        slackMap =
+            IntMatrix{V(_(numEquations, end), _(begin, numRowTrunc)) * DU};
+        auto NSdim = V.numCol() - numRowTrunc;
+        // expand W stores [c -JV2 JV2]
+        //  we use simplex to solve [-JV2 JV2][y2+ y2-]' <= JV1D^(-1)Uq
+        // where y2 = y2+ - y2-
+        expandW.resizeForOverwrite(numSlack, NSdim * 2 + 1);
+        for (size_t i = 0; i < numSlack; ++i) {
+            expandW(i, 0) = 0;
+            for (size_t j = 0; j < NSdim; ++j) {
+                auto val = V(i + numEquations, numRowTrunc + j) * Dlcm;
+                expandW(i, j + 1) = -val;
+                expandW(i, j + NSdim + 1) = val;
+            }
+        }
+    }
+    // The last feasible simplex is reused: row operations applied to the
+    // tableau `[c | I W]` are recorded in the slack columns, so the constants
+    // for a new `c` are `tableau(:, slack) * c`. If these are all `>= 0`, the
+    // old basis is still feasible and no pivots are needed.
+    bool warmStartFeasible(PtrVector<int64_t> c) const {
+        if (!hasWarmStart)
+            return false;
+        const Simplex &S = warmStart;
+        PtrMatrix<int64_t> C{S.getConstraints()};
+        StridedVector<int64_t> basicVars{S.getBasicVariables()};
+        const size_t numSlack = c.size();
+        for (size_t i = 0; i < C.numRow(); ++i) {
+            int64_t v = basicVars[i];
+            if ((v <= 0) || (size_t(v) >= C.numCol()) || (C(i, v) <= 0))
+                return false;
+            int64_t ci = 0;
+            for (size_t j = 0; j < numSlack; ++j)
+                ci += C(i, j + 1) * c(j);
+            if (ci < 0)
+                return false;
+        }
+        return true;
+    }
+    bool feasibleSlack(PtrVector<int64_t> c) const {
+        // `y2 = 0` is a solution
+        if (std::ranges::all_of(c, [](int64_t x) { return x >= 0; }))
+            return true;
+        if (warmStartFeasible(c))
+            return true;
+        IntMatrix W{expandW};
+        for (size_t i = 0; i < W.numRow(); ++i)
+            W(i, 0) = c(i);
+        IntMatrix Wcouple{0, W.numCol()};
+        llvm::Optional<Simplex> optS{Simplex::positiveVariables(W, Wcouple)};
+        if (!optS.hasValue())
+            return false;
+        warmStart = std::move(*optS);
+        hasWarmStart = true;
+        return true;
     }
 
     static LinearSymbolicComparator
@@ -404,132 +500,31 @@ struct LinearSymbolicComparator : BaseComparator<LinearSymbolicComparator> {
     };
     // Note that this is only valid when the comparator was constructed
     // with index `0` referring to >= 0 constants (i.e., the default).
-    bool isEmpty() {
-        StridedVector<int64_t> b{StridedVector<int64_t>(U(_, 0))};
-        if (d.size() == 0) {
-            // SHOWLN(U.numCol());
-            // SHOWLN(query.size());
-            for (size_t i = V.numRow(); i < b.size(); ++i)
-                if (b(i))
-                    return false;
-            auto H = V;
-            auto oldn = H.numCol();
-            H.resizeCols(oldn + 1);
-            for (size_t i = 0; i < H.numRow(); ++i)
-                H(i, oldn) = -b(i);
-            NormalForm::solveSystem(H);
-            for (size_t i = numEquations; i < H.numRow(); ++i)
-                if (auto rhs = H(i, oldn))
-                    if ((rhs > 0) != (H(i, i) > 0))
-                        return false;
-            return true;
-        }
-        // Column rank deficient case
-        else {
-            size_t numSlack = V.numRow() - numEquations;
-            // Vector<int64_t> dinv = d; // copy
-            auto Dlcm = d[0];
-            // We represent D martix as a vector, and multiply the lcm to the
-            // linear equation to avoid store D^(-1) as rational type
-            for (size_t i = 1; i < d.size(); ++i)
-                Dlcm = lcm(Dlcm, d(i));
-            Vector<int64_t> b2;
-            b2.resizeForOverwrite(d.size());
-            for (size_t i = 0; i < d.size(); ++i)
-                b2(i) = -b(i) * Dlcm / d(i);
-            size_t numRowTrunc = U.numRow();
-            Vector<int64_t> c =
-                V(_(numEquations, end), _(begin, numRowTrunc)) * b2;
-            auto NSdim = V.numCol() - numRowTrunc;
-            // expand W stores [c -JV2 JV2]
-            //  we use simplex to solve [-JV2 JV2][y2+ y2-]' <= JV1D^(-1)Uq
-            // where y2 = y2+ - y2-
-            // SHOWLN(V);
-            // SHOWLN(U);
-            // SHOWLN(c);
-            IntMatrix expandW(numSlack, NSdim * 2 + 1);
-            for (size_t i = 0; i < numSlack; ++i) {
-                expandW(i, 0) = c(i);
-                // expandW(i, 0) *= Dlcm;
-                for (size_t j = 0; j < NSdim; ++j) {
-                    auto val = V(i + numEquations, numRowTrunc + j) * Dlcm;
-                    expandW(i, j + 1) = -val;
-                    expandW(i, j + NSdim + 1) = val;
-                }
-            }
-            // SHOWLN(expandW);
-            IntMatrix Wcouple{0, expandW.numCol()};
-            llvm::Optional<Simplex> optS{
-                Simplex::positiveVariables(expandW, Wcouple)};
-            if (optS.hasValue())
-                optS->printResult();
-            return optS.hasValue();
-        }
-        return true;
+    bool isEmpty() const {
+        Vector<int64_t> q{-1};
+        return greaterEqual(q);
     }
     bool greaterEqual(PtrVector<int64_t> query) const {
-        Vector<int64_t> b = U(_, _(begin, query.size())) * query;
-        // SHOWLN(b);
-        // SHOWLN(d.size());
+        Vector<int64_t> c = slackMap(_, _(begin, query.size())) * query;
         // Full column rank case
-        if (d.size() == 0) {
-            // SHOWLN(U.numCol());
-            // SHOWLN(query.size());
-            for (size_t i = V.numRow(); i < b.size(); ++i)
-                if (b(i))
-                    return false;
-            auto H = V;
-            auto oldn = H.numCol();
-            H.resizeCols(oldn + 1);
-            for (size_t i = 0; i < H.numRow(); ++i)
-                H(i, oldn) = b(i);
-            NormalForm::solveSystem(H);
-            for (size_t i = numEquations; i < H.numRow(); ++i)
-                if (auto rhs = H(i, oldn))
-                    if ((rhs > 0) != (H(i, i) > 0))
-                        return false;
-            return true;
-        }
+        if (d.size() == 0)
+            return std::ranges::all_of(c, [](int64_t x) { return x >= 0; });
         // Column rank deficient case
-        else {
-            size_t numSlack = V.numRow() - numEquations;
-            Vector<int64_t> dinv = d; // copy
-            auto Dlcm = dinv[0];
-            // We represent D martix as a vector, and multiply the lcm to the
-            // linear equation to avoid store D^(-1) as rational type
-            for (size_t i = 1; i < dinv.size(); ++i)
-                Dlcm = lcm(Dlcm, dinv(i));
-            for (size_t i = 0; i < dinv.size(); ++i)
-                dinv(i) = Dlcm / dinv(i);
-            b *= dinv;
-            size_t numRowTrunc = U.numRow();
-            Vector<int64_t> c =
-                V(_(numEquations, end), _(begin, numRowTrunc)) * b;
-            auto NSdim = V.numCol() - numRowTrunc;
-            // expand W stores [c -JV2 JV2]
-            //  we use simplex to solve [-JV2 JV2][y2+ y2-]' <= JV1D^(-1)Uq
-            // where y2 = y2+ - y2-
-            // SHOWLN(V);
-            // SHOWLN(U);
-            // SHOWLN(c);
-            IntMatrix expandW(numSlack, NSdim * 2 + 1);
-            for (size_t i = 0; i < numSlack; ++i) {
-                expandW(i, 0) = c(i);
-                // expandW(i, 0) *= Dlcm;
-                for (size_t j = 0; j < NSdim; ++j) {
-                    auto val = V(i + numEquations, numRowTrunc + j) * Dlcm;
-                    expandW(i, j + 1) = -val;
-                    expandW(i, j + NSdim + 1) = val;
-                }
-            }
-            // SHOWLN(expandW);
-            IntMatrix Wcouple{0, expandW.numCol()};
-            llvm::Optional<Simplex> optS{
-                Simplex::positiveVariables(expandW, Wcouple)};
-            if (optS.hasValue())
-                optS->printResult();
-            return optS.hasValue();
+        return feasibleSlack(c);
+    }
+    // Answers `greaterEqual(Q(i,_))` for every row of `Q`; the product with
+    // the precomputed `slackMap` is formed once for the whole batch.
+    llvm::SmallVector<bool> greaterEqual(PtrMatrix<int64_t> Q) const {
+        const IntMatrix C{Q * slackMap(_, _(begin, Q.numCol())).transpose()};
+        llvm::SmallVector<bool> ret(Q.numRow());
+        for (size_t i = 0; i < Q.numRow(); ++i) {
+            PtrVector<int64_t> c{C.getRow(i)};
+            ret[i] = (d.size() == 0)
+                         ? std::ranges::all_of(
+                               c, [](int64_t x) { return x >= 0; })
+                         : feasibleSlack(c);
         }
+        return ret;
     }
 };
 
@@ -5,8 +5,13 @@
 #include "./NormalForm.hpp"
 #include "./Symbolics.hpp"
 #include "EmptyArrays.hpp"
+#include <bit>
 #include <cstddef>
 #include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/Hashing.h>
+#include <llvm/ADT/SmallVector.h>
 #include <sys/types.h>
 
 // prints in current permutation order.
@@ -366,6 +371,109 @@ void slackEqualityConstraints(MutPtrMatrix<int64_t> C, PtrMatrix<int64_t> A,
     }
     // assert(numRows == (numRowsNew+1));
 }
+// Eliminates all variables in `vars` from `A*x >= 0`.
+// Each row carries its Chernikov history set, i.e. the set of original
+// constraints it was combined from. By Imbert's first acceleration theorem, a
+// combination with history `H` is redundant if `|H| > 1 + |E|`, where `E` are
+// the variables that appear in the constraints of `H` but no longer appear in
+// the combination (whether eliminated explicitly or cancelled implicitly).
+// Such combinations are dropped as they are formed, as are duplicates, which
+// are found by hashing the gcd-normalized rows.
+// Histories and supports are `uint64_t` masks, so larger systems fall back to
+// eliminating one variable at a time.
+[[maybe_unused]] static void fourierMotzkin(IntMatrix &A,
+                                            llvm::ArrayRef<size_t> vars) {
+    const size_t numCol = A.numCol();
+    if ((A.numRow() > 64) || (numCol > 64)) {
+        for (auto v : vars)
+            fourierMotzkin(A, v);
+        return;
+    }
+    auto support = [](PtrVector<int64_t> x) {
+        uint64_t m = 0;
+        for (size_t k = 1; k < x.size(); ++k)
+            m |= uint64_t(x[k] != 0) << k;
+        return m;
+    };
+    // `hist[r]` is the history of row `r`, `occ[r]` the union of the
+    // supports of the original constraints in `hist[r]`.
+    llvm::SmallVector<uint64_t> hist;
+    llvm::SmallVector<uint64_t> occ;
+    for (size_t r = 0; r < A.numRow(); ++r) {
+        hist.push_back(uint64_t(1) << r);
+        occ.push_back(support(A.getRow(r)));
+    }
+    IntMatrix B;
+    llvm::SmallVector<uint64_t> histB;
+    llvm::SmallVector<uint64_t> occB;
+    llvm::DenseMap<unsigned, llvm::SmallVector<unsigned, 1>> buckets;
+    Vector<int64_t> row{numCol};
+    // returns `true` if `row` was added to `B`
+    auto pushRow = [&](uint64_t h, uint64_t o) {
+        bool isConst = true;
+        for (size_t k = 1; k < numCol; ++k)
+            isConst &= (row[k] == 0);
+        // `c >= 0` is either trivially satisfied or proves emptiness
+        if (isConst && (row[0] >= 0))
+            return false;
+        uint64_t eliminated = o & ~support(row);
+        if (size_t(std::popcount(h)) > 1 + size_t(std::popcount(eliminated)))
+            return false;
+        normalizeByGCD(row);
+        unsigned key = unsigned(size_t(llvm::hash_combine_range(
+                           row.begin(), row.end()))) >>
+                       1;
+        auto &bucket = buckets[key];
+        for (auto b : bucket) {
+            if (!(B.getRow(b) == PtrVector<int64_t>(row)))
+                continue;
+            // keep the smaller history, so fewer combinations are discarded
+            if (std::popcount(h) < std::popcount(histB[b])) {
+                histB[b] = h;
+                occB[b] = o;
+            }
+            return false;
+        }
+        size_t r = B.numRow();
+        bucket.push_back(r);
+        B.resizeRows(r + 1);
+        B.getRow(r) = row;
+        histB.push_back(h);
+        occB.push_back(o);
+        return true;
+    };
+    for (auto v : vars) {
+        B.resizeForOverwrite(0, numCol);
+        histB.clear();
+        occB.clear();
+        buckets.clear();
+        const size_t numRow = A.numRow();
+        for (size_t i = 0; i < numRow; ++i) {
+            if (A(i, v))
+                continue;
+            row = A.getRow(i);
+            pushRow(hist[i], occ[i]);
+        }
+        for (size_t i = 0; i < numRow; ++i) {
+            int64_t Aiv = A(i, v);
+            if (Aiv <= 0)
+                continue;
+            for (size_t j = 0; j < numRow; ++j) {
+                int64_t Ajv = A(j, v);
+                if (Ajv >= 0)
+                    continue;
+                int64_t g = gcd(Aiv, Ajv);
+                int64_t Ai = Aiv / g, Aj = Ajv / g;
+                for (size_t k = 0; k < numCol; ++k)
+                    row[k] = Ai * A(j, k) - Aj * A(i, k);
+                pushRow(hist[i] | hist[j], occ[i] | occ[j]);
+            }
+        }
+        std::swap(A, B);
+        std::swap(hist, histB);
+        std::swap(occ, occB);
+    }
+}
 // [[maybe_unused]] static constexpr bool substituteEquality(IntMatrix &, EmptyMatrix<int64_t>,
 // size_t){
 //     return true;
@@ -382,6 +490,24 @@ void slackEqualityConstraints(MutPtrMatrix<int64_t> C, PtrMatrix<int64_t> A,
         if (allZero(A(--i, _)))
             eraseConstraint(A, i);
 }
+// Checks whether `A*x >= 0 && E*x == 0` (with `x[0] == 1`) has no rational
+// solution by eliminating all variables; `A` and `E` are overwritten.
+// As rational solutions need not be integral, `false` is conservative.
+[[maybe_unused]] static bool rationallyEmpty(IntMatrix &A, IntMatrix &E) {
+    llvm::SmallVector<size_t> vars;
+    for (size_t v = 1; v < A.numCol(); ++v)
+        if (substituteEquality(A, E, v))
+            vars.push_back(v);
+    fourierMotzkin(A, vars);
+    // only constants remain
+    for (size_t i = 0; i < E.numRow(); ++i)
+        if (E(i, 0))
+            return true;
+    for (size_t i = 0; i < A.numRow(); ++i)
+        if (A(i, 0) < 0)
+            return true;
+    return false;
+}
 
 // A is an inequality matrix, A*x >= 0
 // B is an equality matrix, E*x == 0
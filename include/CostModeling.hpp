@@ -1,7 +1,490 @@
 #pragma once
 
+#include "./ArrayReference.hpp"
+#include "./DependencyPolyhedra.hpp"
+#include "./Loops.hpp"
+#include "./Math.hpp"
+#include "./Schedule.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Instructions.h>
 
+// Cache-aware cost model for tiling a loop nest.
+//
+// For a tile of `T_i` iterations of each loop `i`, a reference touches
+// `1 + sum_i |M(i,d)|*(T_i-1)` elements along each array dimension `d`,
+// where `M` is its `indexMatrix()`. Dividing the contiguous (unit stride)
+// dimension by the cache line length and multiplying the dimensions gives
+// the lines touched per tile. References to the same array with the same
+// index matrix share their lines (group reuse).
+// If the lines of all references fit in the cache, each tile loads them
+// once, so the estimated number of misses is
+// `prod_i ceil(N_i / T_i) * lines(T)`,
+// where `N_i` are the trip counts. Tiles that do not fit are rejected.
+// Without tiling (`T = [1,...,1,N_{end}]`) this is the familiar model
+// where only the innermost loop carries reuse.
+//
+// Tiling is only legal for a fully permutable band; checking that is left
+// to the caller.
+struct CacheModel {
+    // elements per cache line
+    int64_t lineElements = 8;
+    // number of lines of the cache we tile for
+    int64_t cacheLines = 512;
+    // trip count used for loops whose bounds are not compile time constants
+    int64_t unknownTripCount = 1024;
+};
 
+// References to the same array with the same index matrix differ by at most
+// a constant offset, so the cost models treat them as one group.
+inline void addReferenceGroup(llvm::SmallVectorImpl<const ArrayReference *> &refs,
+                       const ArrayReference &ref) {
+    for (auto r : refs)
+        if ((r->arrayID == ref.arrayID) &&
+            (r->indexMatrix() == ref.indexMatrix()))
+            return;
+    refs.push_back(&ref);
+}
 
+struct TilingCostModel {
+    const AffineLoopNest &loop;
+    CacheModel cache;
+    // one representative per group of references with the same array and
+    // index matrix
+    llvm::SmallVector<const ArrayReference *> refs;
+    llvm::SmallVector<int64_t> tripCounts;
 
+    TilingCostModel(const AffineLoopNest &loop,
+                    llvm::ArrayRef<MemoryAccess> memory,
+                    CacheModel cache = {})
+        : loop(loop), cache(cache),
+          tripCounts(estimateTripCounts(loop, cache.unknownTripCount)) {
+        for (auto &m : memory)
+            if (m.ref.loop.get() == &loop)
+                addReferenceGroup(refs, m.ref);
+    }
+    // Trip counts of the rectangular hull of the nest, using only the
+    // constraints that bound a single loop by a constant.
+    static llvm::SmallVector<int64_t>
+    estimateTripCounts(const AffineLoopNest &aln, int64_t unknown) {
+        const size_t numConst = aln.getNumSymbols();
+        const size_t numLoops = aln.getNumLoops();
+        PtrMatrix<int64_t> A = aln.A;
+        llvm::SmallVector<int64_t> ret(numLoops, unknown);
+        for (size_t i = 0; i < numLoops; ++i) {
+            int64_t lower = std::numeric_limits<int64_t>::min();
+            int64_t upper = std::numeric_limits<int64_t>::max();
+            for (size_t r = 0; r < A.numRow(); ++r) {
+                int64_t a = A(r, numConst + i);
+                if ((a == 0) || !allZero(A(r, _(1, numConst))))
+                    continue;
+                bool onlyLoopI = true;
+                for (size_t j = 0; j < numLoops; ++j)
+                    onlyLoopI &= (j == i) || (A(r, numConst + j) == 0);
+                if (!onlyLoopI)
+                    continue;
+                // a*x + c >= 0
+                int64_t c = A(r, 0);
+                if (a > 0)
+                    lower = std::max(lower, -floorDiv(c, a));
+                else
+                    upper = std::min(upper, floorDiv(c, -a));
+            }
+            if ((lower != std::numeric_limits<int64_t>::min()) &&
+                (upper != std::numeric_limits<int64_t>::max()))
+                ret[i] = std::max(upper - lower + 1, int64_t(0));
+        }
+        return ret;
+    }
+    static int64_t floorDiv(int64_t x, int64_t y) {
+        int64_t d = x / y;
+        return d - ((x % y != 0) & ((x < 0) != (y < 0)));
+    }
+    // cache lines `ref` touches during one tile
+    double footprint(const ArrayReference &ref,
+                     llvm::ArrayRef<int64_t> tile) const {
+        PtrMatrix<int64_t> M = ref.indexMatrix();
+        double lines = 1.0;
+        for (size_t d = 0; d < M.numCol(); ++d) {
+            int64_t range = 1;
+            for (size_t i = 0; i < M.numRow(); ++i)
+                range += std::abs(M(i, d)) * (tile[i] - 1);
+            if (isOne(ref.strides[d]))
+                range = (range + cache.lineElements - 1) / cache.lineElements;
+            lines *= double(range);
+        }
+        return lines;
+    }
+    double footprint(llvm::ArrayRef<int64_t> tile) const {
+        double lines = 0.0;
+        for (auto r : refs)
+            lines += footprint(*r, tile);
+        return lines;
+    }
+    // estimated cache misses when iterating in tiles of `tile`;
+    // infinite if a tile's footprint does not fit in the cache.
+    double cost(llvm::ArrayRef<int64_t> tile) const {
+        double lines = footprint(tile);
+        if (lines > double(cache.cacheLines))
+            return std::numeric_limits<double>::infinity();
+        double numTiles = 1.0;
+        for (size_t i = 0; i < tile.size(); ++i)
+            numTiles *= double((tripCounts[i] + tile[i] - 1) / tile[i]);
+        return numTiles * lines;
+    }
+    // cost with only the innermost loop traversed in full
+    double untiledCost() const {
+        llvm::SmallVector<int64_t> tile(tripCounts.size(), 1);
+        if (tile.size())
+            tile.back() = tripCounts.back();
+        return cost(tile);
+    }
+    // Searches power-of-two tile sizes (and the full trip count) for each
+    // loop, minimizing `cost`. Ties are broken in favor of fewer tiles.
+    // Returns the tile sizes in the form taken by `AffineLoopNest::tile` and
+    // `Schedule::tile`: `0` means the loop is not tiled.
+    llvm::SmallVector<int64_t> chooseTileSizes() const {
+        const size_t numLoops = tripCounts.size();
+        llvm::SmallVector<int64_t> tile(numLoops, 1), best(numLoops, 1);
+        if (numLoops)
+            best.back() = tripCounts.back();
+        double bestCost = cost(best);
+        double bestTiles = std::numeric_limits<double>::infinity();
+        search(tile, 0, best, bestCost, bestTiles);
+        // a loop with tile size `1` is moved into the tile band, which only
+        // matters if some other loop is actually tiled.
+        bool anyTiled = false;
+        for (size_t i = 0; i < numLoops; ++i) {
+            if (best[i] >= tripCounts[i])
+                best[i] = 0;
+            anyTiled |= (best[i] > 1);
+        }
+        if (!anyTiled)
+            std::fill(best.begin(), best.end(), 0);
+        return best;
+    }
+    void search(llvm::SmallVector<int64_t> &tile, size_t i,
+                llvm::SmallVector<int64_t> &best, double &bestCost,
+                double &bestTiles) const {
+        if (i == tile.size()) {
+            double c = cost(tile);
+            double numTiles = 1.0;
+            for (size_t j = 0; j < tile.size(); ++j)
+                numTiles *= double((tripCounts[j] + tile[j] - 1) / tile[j]);
+            if ((c < bestCost) || ((c == bestCost) && (numTiles < bestTiles))) {
+                best = tile;
+                bestCost = c;
+                bestTiles = numTiles;
+            }
+            return;
+        }
+        const int64_t N = std::max(tripCounts[i], int64_t(1));
+        for (int64_t T = 1;; T = std::min(2 * T, N)) {
+            tile[i] = T;
+            // footprints only grow with `T`; stop once a tile cannot fit
+            if (footprint(tile) > double(cache.cacheLines))
+                break;
+            search(tile, i + 1, best, bestCost, bestTiles);
+            if (T == N)
+                break;
+        }
+        tile[i] = 1;
+    }
+};
 
+// Unroll-and-jam of up to two outer loops of a nest, as recorded in
+// `Schedule::unrolledOuter` and `Schedule::unrolledInner`.
+struct UnrollAndJam {
+    int8_t outer = -1;
+    int8_t inner = -1;
+    uint16_t outerFactor = 1;
+    uint16_t innerFactor = 1;
+    // registers used by the unrolled body
+    size_t registers = 0;
+    // memory operations per iteration of the original loop body
+    double memOpsPerIteration = 0.0;
+    void apply(Schedule &sch) const {
+        sch.unrolledOuter = outer;
+        sch.unrolledInner = inner;
+        sch.unrollFactorOuter = outerFactor;
+        sch.unrollFactorInner = innerFactor;
+    }
+};
+
+// Register pressure model for unroll-and-jam; the innermost loop stays
+// rolled. Unrolling loop `j` by `u_j` makes `u_j` copies of each reference
+// whose index depends on `j`.
+// References invariant in the innermost loop are kept in registers across
+// it, e.g. the accumulators `C(m,n)` of a matrix multiply over `k`, so they
+// occupy a register per copy but no memory operations per iteration.
+// Every other reference is loaded (or stored) once per copy per iteration,
+// and needs a register while it is used.
+// The model picks the unroll factors minimizing memory operations per
+// original iteration without exceeding `registerCount`, i.e. without
+// spilling. For a matrix multiply with 16 registers, this is `3x3`:
+// 9 accumulators plus 3 + 3 loads, for 6 loads per 9 multiply-adds.
+//
+// Legality of unroll-and-jam is left to the caller.
+struct RegisterTilingModel {
+    llvm::SmallVector<const ArrayReference *> refs;
+    size_t numLoops;
+    unsigned registerCount;
+
+    RegisterTilingModel(const AffineLoopNest &loop,
+                        llvm::ArrayRef<MemoryAccess> memory,
+                        unsigned registerCount)
+        : numLoops(loop.getNumLoops()), registerCount(registerCount) {
+        for (auto &m : memory)
+            if (m.ref.loop.get() == &loop)
+                addReferenceGroup(refs, m.ref);
+    }
+    static bool dependsOn(const ArrayReference &ref, size_t j) {
+        return !allZero(ref.indexMatrix()(j, _));
+    }
+    size_t copies(const ArrayReference &ref, const UnrollAndJam &u) const {
+        size_t c = 1;
+        if ((u.outer >= 0) && dependsOn(ref, u.outer))
+            c *= u.outerFactor;
+        if ((u.inner >= 0) && dependsOn(ref, u.inner))
+            c *= u.innerFactor;
+        return c;
+    }
+    // fills `registers` and `memOpsPerIteration`
+    void evaluate(UnrollAndJam &u) const {
+        size_t regs = 0, memOps = 0;
+        for (auto r : refs) {
+            size_t c = copies(*r, u);
+            regs += c;
+            if (dependsOn(*r, numLoops - 1))
+                memOps += c;
+        }
+        u.registers = regs;
+        u.memOpsPerIteration =
+            double(memOps) / (double(u.outerFactor) * double(u.innerFactor));
+    }
+    bool isBetter(const UnrollAndJam &x, const UnrollAndJam &y) const {
+        if (x.memOpsPerIteration != y.memOpsPerIteration)
+            return x.memOpsPerIteration < y.memOpsPerIteration;
+        return x.registers < y.registers;
+    }
+    UnrollAndJam choose() const {
+        UnrollAndJam best;
+        evaluate(best);
+        if (numLoops < 2)
+            return best;
+        // `outer == inner` is used for unrolling a single loop
+        for (size_t a = 0; a + 1 < numLoops; ++a) {
+            for (size_t b = a; b + 1 < numLoops; ++b) {
+                UnrollAndJam u;
+                u.outer = a;
+                u.inner = b;
+                for (unsigned fa = 1; fa <= registerCount; ++fa) {
+                    u.outerFactor = uint16_t(fa);
+                    u.innerFactor = 1;
+                    evaluate(u);
+                    if (u.registers > registerCount)
+                        break;
+                    for (unsigned fb = 1; (a != b) && (fb <= registerCount);
+                         ++fb) {
+                        u.innerFactor = uint16_t(fb);
+                        evaluate(u);
+                        if (u.registers > registerCount)
+                            break;
+                        if (isBetter(u, best))
+                            best = u;
+                    }
+                    if ((a == b) && isBetter(u, best))
+                        best = u;
+                }
+            }
+        }
+        // normalize, so that unused slots read as not unrolled
+        if (best.outer == best.inner) {
+            if (best.outerFactor == 1)
+                return UnrollAndJam{.registers = best.registers,
+                                    .memOpsPerIteration =
+                                        best.memOpsPerIteration};
+            best.inner = best.outer;
+            best.innerFactor = best.outerFactor;
+            best.outer = -1;
+            best.outerFactor = 1;
+        }
+        return best;
+    }
+};
+
+// How the address of a reference changes along one loop of its nest.
+enum class AccessPattern {
+    // the address does not depend on the loop
+    Invariant,
+    // unit stride along the contiguous dimension (possibly reversed)
+    Contiguous,
+    // constant, non-unit stride along the contiguous dimension
+    Strided,
+    // anything else, e.g. a symbolic stride
+    Gather
+};
+
+// Vectorization of one loop of a nest, as recorded in `Schedule::vectorized`.
+struct Vectorization {
+    int8_t loop = -1;
+    uint16_t width = 1;
+    // estimated cost of the memory accesses per iteration of the body
+    double cost = 0.0;
+    void apply(Schedule &sch) const {
+        sch.vectorized = loop;
+        sch.vectorWidth = width;
+    }
+};
+
+// Picks the loop of a nest to vectorize by `width` lanes.
+//
+// Vectorizing loop `j` strip-mines it and moves the lanes innermost. This is
+// legal if `j` carries no dependence between, or within, the accesses of the
+// nest: then dependent iterations that agree on the loops outside of `j` also
+// agree on `j`. A store invariant in `j` would be written by every lane, so
+// it is rejected as well.
+//
+// Legal loops are ranked by the reciprocal throughput of the memory accesses
+// per iteration of the body. Contiguous accesses take one vector load or store
+// per `width` iterations, invariant loads are hoisted, and all other accesses
+// are gathers or scatters. Costs come from `TTI` for accesses with an
+// instruction; otherwise, a vector access costs `1` and a gather `width`.
+// A loop is only vectorized if this beats the scalar nest, whose loads
+// invariant in the innermost loop are hoisted.
+struct VectorizationModel {
+    const AffineLoopNest &loop;
+    llvm::SmallVector<const MemoryAccess *> accesses;
+    llvm::SmallVector<const Dependence *> edges;
+    unsigned width;
+    const llvm::TargetTransformInfo *TTI;
+
+    VectorizationModel(const AffineLoopNest &loop,
+                       llvm::ArrayRef<MemoryAccess> memory,
+                       llvm::ArrayRef<Dependence> deps, unsigned width,
+                       const llvm::TargetTransformInfo *TTI = nullptr)
+        : loop(loop), width(width), TTI(TTI) {
+        for (auto &m : memory)
+            if (m.ref.loop.get() == &loop)
+                accesses.push_back(&m);
+        for (auto &d : deps)
+            if ((d.in->ref.loop.get() == &loop) &&
+                (d.out->ref.loop.get() == &loop))
+                edges.push_back(&d);
+    }
+    static AccessPattern pattern(const ArrayReference &ref, size_t j) {
+        PtrMatrix<int64_t> M = ref.indexMatrix();
+        AccessPattern p = AccessPattern::Invariant;
+        for (size_t d = 0; d < M.numCol(); ++d) {
+            int64_t c = M(j, d);
+            if (c == 0)
+                continue;
+            if ((p != AccessPattern::Invariant) || !isOne(ref.strides[d]))
+                return AccessPattern::Gather;
+            p = (std::abs(c) == 1) ? AccessPattern::Contiguous
+                                   : AccessPattern::Strided;
+        }
+        return p;
+    }
+    bool isLegal(size_t j) const {
+        for (auto m : accesses)
+            if ((!m->isLoad) &&
+                (pattern(m->ref, j) == AccessPattern::Invariant))
+                return false;
+        for (auto d : edges)
+            if (d->mayCarry(j))
+                return false;
+        // output dependencies of a store on itself
+        for (auto m : accesses)
+            if ((!m->isLoad) && DependencePolyhedra(*m, *m).mayCarry(j))
+                return false;
+        return true;
+    }
+    static llvm::Type *getElementType(const MemoryAccess &m) {
+        if (auto l = llvm::dyn_cast_or_null<llvm::LoadInst>(m.user))
+            return l->getType();
+        if (auto s = llvm::dyn_cast_or_null<llvm::StoreInst>(m.user))
+            return s->getValueOperand()->getType();
+        return nullptr;
+    }
+    // lanes of the widest element type in `memory` fitting in a register
+    static unsigned vectorWidth(const llvm::TargetTransformInfo &TTI,
+                                llvm::ArrayRef<MemoryAccess> memory) {
+        uint64_t bits = 0;
+        for (auto &m : memory)
+            if (llvm::Type *T = getElementType(m))
+                bits = std::max(
+                    bits, uint64_t(T->getPrimitiveSizeInBits().getFixedSize()));
+        if (bits == 0)
+            return 1;
+        uint64_t registerBits =
+            TTI.getRegisterBitWidth(
+                   llvm::TargetTransformInfo::RGK_FixedWidthVector)
+                .getFixedSize();
+        return std::max(unsigned(registerBits / bits), 1U);
+    }
+    static double toDouble(llvm::InstructionCost c) {
+        if (auto v = c.getValue())
+            return double(*v);
+        return std::numeric_limits<double>::infinity();
+    }
+    // cost of `m` per iteration of the body, vectorized by `w` lanes with
+    // access pattern `p`
+    double cost(const MemoryAccess &m, AccessPattern p, unsigned w) const {
+        if ((p == AccessPattern::Invariant) && m.isLoad)
+            return 0.0;
+        llvm::Type *T = TTI ? getElementType(m) : nullptr;
+        if (!T)
+            return (p == AccessPattern::Contiguous) ? 1.0 / w : 1.0;
+        const unsigned opcode = llvm::cast<llvm::Instruction>(m.user)->getOpcode();
+        const llvm::Align align = llvm::getLoadStoreAlignment(m.user);
+        const unsigned addrSpace = llvm::getLoadStoreAddressSpace(m.user);
+        if (w == 1)
+            return toDouble(TTI->getMemoryOpCost(opcode, T, align, addrSpace));
+        auto VT = llvm::FixedVectorType::get(T, w);
+        if (p == AccessPattern::Contiguous)
+            return toDouble(
+                       TTI->getMemoryOpCost(opcode, VT, align, addrSpace)) /
+                   w;
+        return toDouble(TTI->getGatherScatterOpCost(
+                   opcode, VT, llvm::getLoadStorePointerOperand(m.user),
+                   false, align)) /
+               w;
+    }
+    double scalarCost() const {
+        const size_t inner = loop.getNumLoops() - 1;
+        double c = 0.0;
+        for (auto m : accesses)
+            c += cost(*m, pattern(m->ref, inner), 1);
+        return c;
+    }
+    double cost(size_t j) const {
+        double c = 0.0;
+        for (auto m : accesses)
+            c += cost(*m, pattern(m->ref, j), width);
+        return c;
+    }
+    // Returns the cheapest legal loop, preferring inner loops on ties.
+    // `loop == -1` if no loop is legal or vectorizing does not pay off.
+    Vectorization choose() const {
+        Vectorization best;
+        if (loop.getNumLoops() == 0)
+            return best;
+        best.cost = scalarCost();
+        if (width <= 1)
+            return best;
+        for (size_t j = loop.getNumLoops(); j != 0;) {
+            double c = cost(--j);
+            if ((c < best.cost) && isLegal(j))
+                best = Vectorization{
+                    .loop = int8_t(j), .width = uint16_t(width), .cost = c};
+        }
+        return best;
+    }
+};
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "./ArrayReference.hpp"
+#include "./SubscriptTests.hpp"
 #include "./Loops.hpp"
 #include "./Math.hpp"
 #include "./NormalForm.hpp"
+#include "./PIP.hpp"
 #include "./POSet.hpp"
 #include "./Polyhedra.hpp"
 #include "./Schedule.hpp"
@@ -11,8 +13,10 @@
 #include "Macro.hpp"
 #include "Orthogonalize.hpp"
 #include "Simplex.hpp"
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/Optional.h>
 #include <llvm/ADT/SmallVector.h>
@@ -39,7 +43,7 @@ struct DependencePolyhedra : SymbolicEqPolyhedra {
     inline size_t getDim0() const { return numDep0Var; }
     inline size_t getNumSymbols() const { return 1 + symbols.size(); }
     inline size_t getDim1() const {
-        return getNumVar() - numDep0Var - nullStep.size() - getNumSymbols();
+        return A.numCol() - numDep0Var - nullStep.size() - getNumSymbols();
     }
     inline size_t getNumScheduleCoefficients() const {
         return getNumVar() - nullStep.size() + 3 - getNumSymbols();
@@ -65,95 +69,321 @@ struct DependencePolyhedra : SymbolicEqPolyhedra {
                 return {};
         return E(i, 0);
     }
+    // Checks whether there may be solutions with `x_i == y_i` for `i < j` and
+    // `direction*(x_j - y_j) >= 1`, i.e. `x` after `y` in loop `j` for
+    // `direction == 1`. Both accesses must be nested in loops `0,...,j`.
+    // The check is rational, so `true` may be conservative.
+    bool mayCarry(size_t j, int64_t direction) const {
+        assert(j < getDim0() && j < getDim1());
+        const size_t numSymbols = getNumSymbols();
+        IntMatrix B = A;
+        IntMatrix F = E;
+        const size_t numIneq = B.numRow();
+        B.resizeRows(numIneq + 1);
+        B(numIneq, _) = 0;
+        B(numIneq, 0) = -1;
+        B(numIneq, numSymbols + j) = direction;
+        B(numIneq, numSymbols + numDep0Var + j) = -direction;
+        const size_t numEq = F.numRow();
+        F.resizeRows(numEq + j);
+        for (size_t i = 0; i < j; ++i) {
+            F(numEq + i, _) = 0;
+            F(numEq + i, numSymbols + i) = 1;
+            F(numEq + i, numSymbols + numDep0Var + i) = -1;
+        }
+        return !rationallyEmpty(B, F);
+    }
+    // Checks whether loop `j` may carry the dependence, i.e. whether
+    // `x_i == y_i` for `i < j` but `x_j != y_j`.
+    bool mayCarry(size_t j) const {
+        return mayCarry(j, 1) || mayCarry(j, -1);
+    }
+    // Range of `y_j - x_j`, found by eliminating all other variables. Bounds
+    // that depend on the symbols are left infinite, and as the elimination
+    // is rational, the range may be conservative.
+    Interval distanceRange(size_t j) const {
+        assert(j < getDim0() && j < getDim1());
+        const size_t numSymbols = getNumSymbols();
+        const size_t numCol = A.numCol();
+        // `d == y_j - x_j` is appended as the last variable; the equalities
+        // used for substitution keep their other variables, so only rows in
+        // `d` alone are read
+        IntMatrix B(A.numRow(), numCol + 1);
+        IntMatrix F(E.numRow() + 1, numCol + 1);
+        for (size_t r = 0; r < A.numRow(); ++r)
+            B(r, _(begin, numCol)) = A(r, _);
+        for (size_t r = 0; r < E.numRow(); ++r)
+            F(r, _(begin, numCol)) = E(r, _);
+        F(E.numRow(), numSymbols + j) = 1;
+        F(E.numRow(), numSymbols + numDep0Var + j) = -1;
+        F(E.numRow(), numCol) = 1;
+        llvm::SmallVector<size_t> vars;
+        for (size_t v = numSymbols; v < numCol; ++v)
+            if (substituteEquality(B, F, v))
+                vars.push_back(v);
+        fourierMotzkin(B, vars);
+        Interval range = Interval::unconstrained();
+        for (size_t r = 0; r < F.numRow(); ++r) {
+            int64_t a = F(r, numCol);
+            if (!a || !allZero(F(r, _(1, numCol))))
+                continue;
+            // `d == n / m` with `m > 0`
+            const int64_t m = std::abs(a), n = a > 0 ? -F(r, 0) : F(r, 0);
+            range = range.intersect(Interval{SubscriptTest::ceilDiv(n, m),
+                                             SubscriptTest::floorDiv(n, m)});
+        }
+        for (size_t r = 0; r < B.numRow(); ++r) {
+            int64_t a = B(r, numCol);
+            if (!a || !allZero(B(r, _(1, numCol))))
+                continue;
+            // `a*d + B(r,0) >= 0`
+            if (a > 0)
+                range.lowerBound = std::max(
+                    range.lowerBound, SubscriptTest::ceilDiv(-B(r, 0), a));
+            else
+                range.upperBound = std::min(
+                    range.upperBound, SubscriptTest::floorDiv(B(r, 0), -a));
+        }
+        return range;
+    }
+    // `distanceRange` of each loop of both `x` and `y`
+    llvm::SmallVector<Interval, 4> distanceRanges() const {
+        llvm::SmallVector<Interval, 4> ranges;
+        for (size_t j = 0; j < std::min(getDim0(), getDim1()); ++j)
+            ranges.push_back(distanceRange(j));
+        return ranges;
+    }
+    // `>= 0` constraints on `[1, symbols]` from the ranges `poset` gives the
+    // degree-1 symbols and their differences
+    IntMatrix symbolContext(const PartiallyOrderedSet &poset) const {
+        constexpr int64_t lo = std::numeric_limits<int64_t>::min();
+        constexpr int64_t hi = std::numeric_limits<int64_t>::max();
+        const size_t numSymbols = getNumSymbols();
+        IntMatrix C(0, numSymbols);
+        // `sign*(s_j - s_i) >= sign*b`, where `i == 0` is the constant
+        auto add = [&](size_t i, size_t j, int64_t sign, int64_t b) {
+            const size_t r = C.numRow();
+            C.resize(r + 1, numSymbols);
+            C(r, 0) = -sign * b;
+            C(r, j) = sign;
+            if (i)
+                C(r, i) = -sign;
+        };
+        auto id = [&](size_t i) -> llvm::Optional<size_t> {
+            if (symbols[i].degree() != 1)
+                return {};
+            return symbols[i].prodIDs.front().getID();
+        };
+        for (size_t j = 0; j < symbols.size(); ++j) {
+            auto jd = id(j);
+            if (!jd)
+                continue;
+            for (size_t i = 0; i <= j; ++i) {
+                llvm::Optional<size_t> ix;
+                if (i < j && !(ix = id(i)))
+                    continue;
+                Interval itv = (i == j) ? poset(*jd) : poset(*ix, *jd);
+                const size_t ci = (i == j) ? 0 : 1 + i;
+                if (itv.lowerBound != lo)
+                    add(ci, 1 + j, 1, itv.lowerBound);
+                if (itv.upperBound != hi)
+                    add(ci, 1 + j, -1, itv.upperBound);
+            }
+        }
+        return C;
+    }
+    // Whether there are no integer solutions for any values of the symbols
+    // allowed by `poset`. This is exact, unlike `isEmpty`, unless the
+    // parametric search gives up.
+    bool isIntegerEmpty(const PartiallyOrderedSet &poset = {}) const {
+        return PIP(A, E, symbolContext(poset), getNumSymbols() - 1).isEmpty();
+    }
+
+    // One axis of the delinearized address, of stride `stride`. Each pair
+    // `(d, s)` in `dims0` is a dim `d` of `ar0` with stride `s * stride`,
+    // likewise for `dims1`, and `sum(s * index)` must match between the two.
+    // An empty side has index `0` on this axis.
+    struct StrideAxis {
+        MPoly stride;
+        llvm::SmallVector<std::pair<unsigned, int64_t>, 1> dims0;
+        llvm::SmallVector<std::pair<unsigned, int64_t>, 1> dims1;
+    };
+    // `x / y` if it is an integer
+    static llvm::Optional<int64_t> constantRatio(const MPoly &x,
+                                                 const MPoly &y) {
+        auto [q, r] = divRem(x, y);
+        if (!isZero(r))
+            return {};
+        return q.getCompileTimeConstant();
+    }
+    static bool divides(const MPoly &x, const MPoly &y) {
+        return isZero(divRem(y, x).second);
+    }
+    static void addToAxis(StrideAxis &axis, bool isAr0, unsigned d,
+                          int64_t s) {
+        (isAr0 ? axis.dims0 : axis.dims1).emplace_back(d, s);
+    }
+    // merges `src` into `dst`, where `src.stride == s * dst.stride`
+    static void mergeAxes(StrideAxis &dst, const StrideAxis &src, int64_t s) {
+        for (auto [d, t] : src.dims0)
+            dst.dims0.emplace_back(d, s * t);
+        for (auto [d, t] : src.dims1)
+            dst.dims1.emplace_back(d, s * t);
+    }
+    // `p` as coefficients of `[1, loop.symbols]`, if it is affine in them
+    static llvm::Optional<llvm::SmallVector<int64_t>>
+    symbolCoefficients(const MPoly &p, const AffineLoopNest &loop) {
+        llvm::SmallVector<int64_t> coefs(loop.getNumSymbols(), 0);
+        for (auto &t : p) {
+            if (isOne(t.exponent)) {
+                coefs[0] += t.coefficient;
+                continue;
+            }
+            auto it = std::find(loop.symbols.begin(), loop.symbols.end(),
+                                t.exponent);
+            if (it == loop.symbols.end())
+                return {};
+            coefs[1 + (it - loop.symbols.begin())] += t.coefficient;
+        }
+        return coefs;
+    }
+    // Whether `sum(s * index)` over `dims` of `ar` is within
+    // `[0, radix - 1]` for all iterations, using the loop bounds and `poset`.
+    static bool
+    withinRadix(const ArrayReference &ar,
+                llvm::ArrayRef<std::pair<unsigned, int64_t>> dims,
+                const MPoly &radix, const PartiallyOrderedSet &poset) {
+        llvm::Optional<llvm::SmallVector<int64_t>> r =
+            symbolCoefficients(radix, *ar.loop);
+        if (!r)
+            return false;
+        PtrMatrix<int64_t> Ar = ar.indexMatrix();
+        PtrMatrix<int64_t> Or = ar.offsetMatrix();
+        SubscriptTest test(ar, ar, poset);
+        SubscriptTest::Subscript sub{
+            llvm::SmallVector<int64_t>(Ar.numRow(), 0),
+            {},
+            0,
+            llvm::SmallVector<int64_t>(ar.loop->getNumSymbols(), 0),
+            Interval{0},
+            false};
+        for (auto [d, s] : dims) {
+            for (size_t l = 0; l < Ar.numRow(); ++l)
+                sub.a[l] += s * Ar(l, d);
+            sub.c += s * Or(d, 0);
+            for (size_t j = 1; j < Or.numCol(); ++j)
+                sub.sym[j] += s * Or(d, j);
+        }
+        if (test.range(sub).lowerBound < 0)
+            return false;
+        // `sum(s * index) - radix <= -1`
+        sub.c -= (*r)[0];
+        for (size_t j = 1; j < r->size(); ++j)
+            sub.sym[j] -= (*r)[j];
+        return test.range(sub).upperBound <= -1;
+    }
+    // Whether `ar` itself has a dim of stride `stride * radix` following its
+    // dim `d`, so that the index of `d` is below `radix` if in bounds.
+    static bool boundedByShape(const ArrayReference &ar, unsigned d,
+                               const MPoly &next) {
+        return (d + 1 < ar.arrayDim()) && (ar.strides[d + 1] == next);
+    }
 
-    static llvm::Optional<llvm::SmallVector<std::pair<int, int>, 4>>
+    // Delinearizes the addresses of `ar0` and `ar1` into a shared list of
+    // axes, so that they are equal iff they match on every axis.
+    // Strides that are integer multiples of one another share an axis. The
+    // axes must then form a chain, each stride dividing the next, with
+    // `radix_k = stride_{k+1} / stride_k`. The index on axis `k` is below
+    // `radix_k` either by assumption, if it is a single dim followed by a dim
+    // of stride `stride_{k+1}` in the same reference (as for matching
+    // strides), or because the loop bounds and `poset` prove it.
+    // E.g., `A[0, i, 0, j]` and `A[k, 0, l, 0]` give four axes, and
+    // `B[i, 2*j]` with strides `[1, M]` and `B[i, j]` with `[1, 2*M]` give two,
+    // with `B[i, j]`'s `j` scaled by `2`.
+    // Returns `None` if the addresses could not be separated.
+    static llvm::Optional<llvm::SmallVector<StrideAxis, 4>>
     matchingStrideConstraintPairs(const ArrayReference &ar0,
-                                  const ArrayReference &ar1) {
-#ifndef NDEBUG
-        std::cout << "ar0 = \n" << ar0 << "\nar1 = " << ar1 << std::endl;
-#endif
+                                  const ArrayReference &ar1,
+                                  const PartiallyOrderedSet &poset = {}) {
+        llvm::SmallVector<StrideAxis, 4> axes;
         // fast path; most common case
         if (ar0.stridesMatch(ar1)) {
-            llvm::SmallVector<std::pair<int, int>, 4> dims;
             size_t numDims = ar0.arrayDim();
-            dims.reserve(numDims);
-            for (size_t i = 0; i < numDims; ++i)
-                dims.emplace_back(i, i);
-            return dims;
-        }
-        // Farkas: psi(x) >= 0 iff
-        // psi(x) = l_0 + lambda' * (b - A'*x) for some l_0, lambda >= 0
-        // psi(x) is an affine function.
-        // Here, we assume that function is either...
-        // if (boundAbove) {
-        //   w + u'N + alpha_delta + alpha_t'i_t - alpha_s'i_s
-        // else {
-        //   alpha_delta + alpha_t'i_t - alpha_s'i_s
-        // }
-        // N are the symbolic variables, like loop bounds.
-        // u and w are introduced variables.
-        //
-        // x = [i_s..., i_t...]
-        //
-        // or swap alpha signs if subInd < 0
-        //
-        // Returns an IntegerEqPolyhedra C'*y <= d
-        // where
-        // y = [alpha_delta, alpha_s..., alpha_t..., w, u...]
-        // for our cost function, we want to set `sum(u)` to zero
-        // Note y >= 0
-        //
-        // This is useful for eliminating indVars as well as for eliminating `N`
-        // We have, for example...
-        // b = [I-1, 0, J-1, 0]
-        // A = [ 1  -1   0   0
-        //       0   0   1  -1 ]
-        // N = [I, J]
-        // x = [i_s, j_s, i_t, j_t]
-        //
-        // w + u'N + alpha_delta + alpha_t'i_t - alpha_s'i_s =
-        // l_0 + lambda' * (b - A'*x)
-        // w + alpha_delta + u_1 * I + u_2 * J + alpha_t_i * i_t + alpha_t_j *
-        // j_t - alpha_s_i * i_s - alpha_s_j * j_s = l_0 + lambda_0 * (I - 1 -
-        // i_s) + lambda_1
-        // * (j_s) + lambda_2 * (J-1 - i_t) + lambda_3 * j_t
-        //
-        // (w + alpha_delta - l_0 + lambda_0 + lambda_2) + I*(u_1 - lambda_0) +
-        // J*(u_2 - lambda_2) + i_t*(alpha_t_i + lambda_2) + j_t *
-        // (alpha_t_j-lambda_3) + i_s * (lambda_0 -alpha_s_i) + j_s *
-        // (-alpha_s_j-lambda_1) = 0
-        //
-        // Now...we assume that it is valid to transform this into a system of
-        // equations 0 = w + alpha_delta - l_0 + lambda_0 + lambda_2 0 = u_1 -
-        // lambda_0 0 = u_2 - lambda_2 0 = alpha_t_i + lambda_2 0 = alpha_t_j -
-        // lambda_3 0 = lambda_0 - alpha_s_i 0 = -alpha_s_j - lambda_1
-        //
-        // A[w*i + x*j]
-        // w*(i...)
-        // x*(j...)
-        // Delinearization seems like the weakest conditions...
-        //
-        // what about
-        // x is symbol, i and j are indvars
-        // A[i,j]
-        // A[i,x]
-        //
-        // if (!ar0.allConstantStrides())
-        //     return {};
-        // if (!ar1.allConstantStrides())
-        //     return {};
-        // if (ar0.stridesMatch(ar1)) {
-        //     return ar0.dim();
-        // }
-        // TODO: handle these examples that fail above but can be matched:
-        // A[0, i, 0, j], A[k, 0, l, 0]
-        // B[i, k], B[i, K] // k = 0:K-1
-        // B[i, k], B[i, J] // J's relation to k??? -- split loop?
-        // size_t dim = 0;
-        // auto axesix = ar0.axes.begin();
-        // auto axesiy = ar1.axes.begin();
-
-        return {};
+            axes.reserve(numDims);
+            for (unsigned i = 0; i < numDims; ++i)
+                axes.push_back(StrideAxis{ar0.strides[i], {{i, 1}}, {{i, 1}}});
+            return axes;
+        }
+        for (bool isAr0 : {true, false}) {
+            const ArrayReference &ar = isAr0 ? ar0 : ar1;
+            for (unsigned d = 0; d < ar.arrayDim(); ++d) {
+                const MPoly &stride = ar.strides[d];
+                bool found = false;
+                for (auto &axis : axes) {
+                    if (auto s = constantRatio(stride, axis.stride)) {
+                        addToAxis(axis, isAr0, d, *s);
+                    } else if (auto s = constantRatio(axis.stride, stride)) {
+                        // rebase `axis` onto the smaller `stride`
+                        StrideAxis old = std::move(axis);
+                        axis = StrideAxis{stride, {}, {}};
+                        mergeAxes(axis, old, *s);
+                        addToAxis(axis, isAr0, d, 1);
+                    } else {
+                        continue;
+                    }
+                    found = true;
+                    break;
+                }
+                if (!found)
+                    addToAxis(axes.emplace_back(StrideAxis{stride, {}, {}}),
+                              isAr0, d, 1);
+            }
+        }
+        // rebasing may have made axes multiples of one another
+        for (size_t i = 0; i < axes.size(); ++i) {
+            for (size_t j = i + 1; j < axes.size();) {
+                if (auto s = constantRatio(axes[j].stride, axes[i].stride)) {
+                    mergeAxes(axes[i], axes[j], *s);
+                } else if (auto s =
+                               constantRatio(axes[i].stride, axes[j].stride)) {
+                    std::swap(axes[i], axes[j]);
+                    mergeAxes(axes[i], axes[j], *s);
+                } else {
+                    ++j;
+                    continue;
+                }
+                axes.erase(axes.begin() + j);
+                j = i + 1;
+            }
+        }
+        // order the axes into a chain
+        for (size_t i = 0; i < axes.size(); ++i) {
+            size_t k = i;
+            while ((k < axes.size()) &&
+                   !std::all_of(axes.begin() + i, axes.end(),
+                                [&](const StrideAxis &a) {
+                                    return divides(axes[k].stride, a.stride);
+                                }))
+                ++k;
+            if (k == axes.size())
+                return {};
+            std::swap(axes[i], axes[k]);
+        }
+        for (size_t k = 0; k + 1 < axes.size(); ++k) {
+            const MPoly &next = axes[k + 1].stride;
+            MPoly radix = divRem(next, axes[k].stride).first;
+            for (bool isAr0 : {true, false}) {
+                const ArrayReference &ar = isAr0 ? ar0 : ar1;
+                const auto &dims = isAr0 ? axes[k].dims0 : axes[k].dims1;
+                if (dims.empty() ||
+                    ((dims.size() == 1) && (dims[0].second == 1) &&
+                     boundedByShape(ar, dims[0].first, next)))
+                    continue;
+                if (!withinRadix(ar, dims, radix, poset))
+                    return {};
+            }
+        }
+        return axes;
     }
 
     // static bool check(const ArrayReference &ar0, const ArrayReference &ar1) {
@@ -205,21 +435,18 @@ struct DependencePolyhedra : SymbolicEqPolyhedra {
     // A*x <= b
     // Where x = [inds0..., inds1..., time..]
 
-    DependencePolyhedra(const MemoryAccess &ma0, const MemoryAccess &ma1)
+    // Without a delinearization of the addresses, no index equalities are
+    // added, which conservatively assumes all pairs of iterations may alias.
+    DependencePolyhedra(const MemoryAccess &ma0, const MemoryAccess &ma1,
+                        const PartiallyOrderedSet &poset = {})
         : Polyhedra<IntMatrix, LinearSymbolicComparator>{} {
 
         const ArrayReference &ar0 = ma0.ref;
         const ArrayReference &ar1 = ma1.ref;
-        const llvm::Optional<llvm::SmallVector<std::pair<int, int>, 4>>
-            maybeDims = matchingStrideConstraintPairs(ar0, ar1);
-
-        assert(maybeDims.hasValue());
-        const llvm::SmallVector<std::pair<int, int>, 4> &dims =
-            maybeDims.getValue();
-        std::cout << "dims = [";
-        for (auto &d : dims)
-            std::cout << "(" << d.first << ", " << d.second << "), ";
-        std::cout << "]" << std::endl;
+        const llvm::Optional<llvm::SmallVector<StrideAxis, 4>> maybeAxes =
+            matchingStrideConstraintPairs(ar0, ar1, poset);
+        const llvm::SmallVector<StrideAxis, 4> axes =
+            maybeAxes.getValueOr(llvm::SmallVector<StrideAxis, 4>{});
         auto [nc0, nv0] = ar0.loop->A.size();
         auto [nc1, nv1] = ar1.loop->A.size();
         numDep0Var = ar0.loop->getNumLoops();
@@ -237,7 +464,7 @@ struct DependencePolyhedra : SymbolicEqPolyhedra {
         const size_t nc = nc0 + nc1;
         IntMatrix NS{nullSpace(ma0, ma1)};
         const size_t nullDim{NS.numRow()};
-        const size_t indexDim{dims.size()};
+        const size_t indexDim{axes.size()};
         nullStep.resize_for_overwrite(nullDim);
         for (size_t i = 0; i < nullDim; ++i) {
             int64_t s = 0;
@@ -271,10 +498,6 @@ struct DependencePolyhedra : SymbolicEqPolyhedra {
         PtrMatrix<int64_t> A1 = ar1.indexMatrix();
         PtrMatrix<int64_t> O0 = ar0.offsetMatrix();
         PtrMatrix<int64_t> O1 = ar1.offsetMatrix();
-        SHOWLN(A0);
-        SHOWLN(A1);
-        SHOWLN(O0);
-        SHOWLN(O1);
         // printMatrix(std::cout << "A0 =\n", A0);
         // printMatrix(std::cout << "\nA1 =\n", A1) << std::endl;
         // std::cout << "indexDim = " << indexDim << std::endl;
@@ -282,21 +505,19 @@ struct DependencePolyhedra : SymbolicEqPolyhedra {
         // e.g. i_0 + j_0 + off_0 = i_1 + j_1 + off_1
         // i_0 + j_0 - i_1 - j_1 = off_1 - off_0
         for (size_t i = 0; i < indexDim; ++i) {
-            auto [d0, d1] = dims[i];
-            // std::cout << "d0 = " << d0 << "; d1 = " << d1 << std::endl;
-            if (d0 >= 0) {
-                E(i, 0) = O0(i, 0);
+            for (auto [d0, s] : axes[i].dims0) {
+                E(i, 0) += s * O0(d0, 0);
                 for (size_t j = 0; j < O0.numCol() - 1; ++j)
-                    E(i, 1 + oldToNewMap0[j]) = O0(d0, 1 + j);
+                    E(i, 1 + oldToNewMap0[j]) += s * O0(d0, 1 + j);
                 for (size_t j = 0; j < numDep0Var; ++j)
-                    E(i, j + numSymbols) = A0(j, d0);
+                    E(i, j + numSymbols) += s * A0(j, d0);
             }
-            if (d1 >= 0) {
-                E(i, 0) -= O1(i, 0);
+            for (auto [d1, s] : axes[i].dims1) {
+                E(i, 0) -= s * O1(d1, 0);
                 for (size_t j = 0; j < O1.numCol() - 1; ++j)
-                    E(i, 1 + oldToNewMap1[j]) -= O1(d1, 1 + j);
+                    E(i, 1 + oldToNewMap1[j]) -= s * O1(d1, 1 + j);
                 for (size_t j = 0; j < numDep1Var; ++j)
-                    E(i, j + numSymbols + numDep0Var) = -A1(j, d1);
+                    E(i, j + numSymbols + numDep0Var) -= s * A1(j, d1);
             }
         }
         for (size_t i = 0; i < nullDim; ++i) {
@@ -307,16 +528,75 @@ struct DependencePolyhedra : SymbolicEqPolyhedra {
             }
             E(indexDim + i, numSymbols + numDep0Var + numDep1Var + i) = 1;
         }
-        SHOWLN(A);
-        SHOWLN(E);
         C.init(A, E);
-        SHOWLN(*this);
         // pruneBounds();
     }
+    // Equalities substituted out of the Farkas systems. Each `(p, j)` in
+    // `pivots` solves equality `j` for the variable in column `p`, after the
+    // substitutions of the earlier pivots. `rows(i,_)` is equality
+    // `pivots[i].second` after all of them, so it contains no other pivot, and
+    // `rows(i,_) * [1, symbols, vars] == 0` maps the remaining variables back
+    // to the eliminated ones.
+    struct EqualityElimination {
+        llvm::SmallVector<std::pair<size_t, size_t>> pivots;
+        IntMatrix rows;
+        // Fills in the eliminated variables of `x = [1, symbols, vars]`
+        // from the others; returns `false` if one is not an integer.
+        bool expand(MutPtrVector<int64_t> x) const {
+            for (size_t i = 0; i < pivots.size(); ++i)
+                x[pivots[i].first] = 0;
+            bool integral = true;
+            for (size_t i = 0; i < pivots.size(); ++i) {
+                const size_t p = pivots[i].first;
+                int64_t s = 0;
+                for (size_t k = 0; k < rows.numCol(); ++k)
+                    s += rows(i, k) * x[k];
+                integral &= ((s % rows(i, p)) == 0);
+                x[p] = -s / rows(i, p);
+            }
+            return integral;
+        }
+    };
+    // Only the variables are eliminated, and only without time dimensions, as
+    // `timeCheck` edits the equality lambdas.
+    EqualityElimination eliminateEqualities() const {
+        EqualityElimination elim;
+        if (getTimeDim())
+            return elim;
+        IntMatrix F = E;
+        const size_t numSymbols = getNumSymbols();
+        for (size_t j = 0; j < F.numRow(); ++j) {
+            size_t p = numSymbols;
+            while ((p < F.numCol()) && (F(j, p) == 0))
+                ++p;
+            if (p == F.numCol())
+                continue;
+            const int64_t e = F(j, p);
+            for (size_t i = 0; i < F.numRow(); ++i) {
+                if (i == j)
+                    continue;
+                if (int64_t c = F(i, p)) {
+                    int64_t g = gcd(c, e);
+                    F(i, _) = (std::abs(e) / g) * F(i, _) -
+                              ((e > 0 ? c : -c) / g) * F(j, _);
+                }
+            }
+            elim.pivots.emplace_back(p, j);
+        }
+        elim.rows.resizeForOverwrite(elim.pivots.size(), F.numCol());
+        for (size_t i = 0; i < elim.pivots.size(); ++i)
+            elim.rows(i, _) = F(elim.pivots[i].second, _);
+        return elim;
+    }
     static size_t getNumLambda(size_t numIneq, size_t numEq) {
         return 1 + numIneq + 2 * numEq;
     }
-    size_t getNumLambda() const { return getNumLambda(A.numRow(), E.numRow()); }
+    // the Farkas systems have no lambdas for the equalities
+    // `eliminateEqualities` substitutes out
+    size_t getNumLambda() const {
+        return getNumLambda(A.numRow(),
+                            E.numRow() - eliminateEqualities().pivots.size());
+    }
     // `direction = true` means second dep follow first
     // lambda_0 + lambda*A*x = delta + c'x
     // x = [s, i]
@@ -355,11 +635,6 @@ struct DependencePolyhedra : SymbolicEqPolyhedra {
         MutPtrMatrix<int64_t> fC{fw.getConstraints()(_, _(1, end))};
         fC(_, 0) = 0;
         fC(0, 0) = 1; // lambda_0
-        SHOWLN(A.numRow());
-        SHOWLN(A.numCol());
-        SHOWLN(fC.numRow());
-        SHOWLN(fC.numCol());
-        SHOWLN(ineqEnd - 1);
         fC(_, _(1, ineqEnd)) = A.transpose();
         // fC(_, _(ineqEnd, posEqEnd)) = E.transpose();
         // fC(_, _(posEqEnd, numVarNew)) = -E.transpose();
@@ -428,8 +703,49 @@ struct DependencePolyhedra : SymbolicEqPolyhedra {
         fC(0, numScheduleCoefs - 1 + numLambda) = -1;
         bC(0, numScheduleCoefs - 2 + numLambda) = -1;
         bC(0, numScheduleCoefs - 1 + numLambda) = 1;
-        SHOWLN(pair.first.tableau);
-        SHOWLN(pair.second.tableau);
+        // Substituting `x_p` out with equality `j` corresponds to combining
+        // row `p` into the others so that `mu_j` only remains in row `p`. As
+        // `mu_j^+ - mu_j^-` is free, row `p` can then always be satisfied, and
+        // is dropped along with `mu_j`.
+        EqualityElimination elim = eliminateEqualities();
+        if (elim.pivots.empty())
+            return pair;
+        for (auto [p, j] : elim.pivots) {
+            const size_t m = ineqEnd + j;
+            const int64_t e = fC(p, m);
+            assert(e != 0);
+            for (size_t k = 0; k < numConstraintsNew; ++k) {
+                int64_t c = fC(k, m);
+                if ((k == p) || (c == 0))
+                    continue;
+                int64_t g = gcd(c, e);
+                int64_t a = std::abs(e) / g, b = (e > 0 ? c : -c) / g;
+                fC(k, _) = a * fC(k, _) - b * fC(p, _);
+                bC(k, _) = a * bC(k, _) - b * bC(p, _);
+            }
+        }
+        llvm::SmallVector<bool> dropRow(numConstraintsNew, false),
+            dropCol(numVarNew + 1, false);
+        for (auto [p, j] : elim.pivots) {
+            dropRow[p] = true;
+            dropCol[1 + ineqEnd + j] = dropCol[1 + posEqEnd + j] = true;
+        }
+        // compact in place, including the constant column
+        for (Simplex *s : {&fw, &bw}) {
+            MutPtrMatrix<int64_t> C{s->getConstraints()};
+            size_t r = 0, c = 0;
+            for (size_t i = 0; i < numConstraintsNew; ++i) {
+                if (dropRow[i])
+                    continue;
+                c = 0;
+                for (size_t v = 0; v <= numVarNew; ++v)
+                    if (!dropCol[v])
+                        C(r, c++) = C(i, v);
+                ++r;
+            }
+            s->truncateConstraints(r);
+            s->truncateVars(c);
+        }
         // note that delta/constant coef is handled as last `s`
         return pair;
         // fw.removeExtraVariables(numVarKeep);
@@ -527,19 +843,133 @@ struct Dependence {
     //
     //
     DependencePolyhedra depPoly;
-    Simplex dependenceSatisfaction;
-    Simplex dependenceBounding;
+    // The Farkas systems are built from `depPoly` on first use, see
+    // `getSatisfaction` and `getBounding`, as many edges are never queried.
+    mutable llvm::Optional<Simplex> dependenceSatisfaction;
+    mutable llvm::Optional<Simplex> dependenceBounding;
     MemoryAccess *in;
     MemoryAccess *out;
     const bool forward;
-    // Dependence(DependencePolyhedra depPoly,
-    //            IntegerEqPolyhedra dependenceSatisfaction,
-    //            IntegerEqPolyhedra dependenceBounding, MemoryAccess *in,
-    //            MemoryAccess *out, const bool forward)
-    //     : depPoly(std::move(depPoly)),
-    //       dependenceSatisfaction(std::move(dependenceSatisfaction)),
-    //       dependenceBounding(std::move(dependenceBounding)), in(in),
-    //       out(out), forward(forward){};
+    // `depPoly.getNumLambda()`, i.e. the lambdas of one Farkas system
+    size_t halfLambda;
+    // Range of `out - in` in each loop shared by the two polyhedron
+    // variables, computed once so that most legality questions need neither
+    // `depPoly` nor the `Simplex`es.
+    llvm::SmallVector<Interval, 4> distance;
+    // direction of `out - in` in a loop; `Less` means `out` runs in a later
+    // iteration than `in`
+    enum class Direction { Less, Equal, Greater, Any };
+
+    Dependence(DependencePolyhedra depPoly, Simplex dependenceSatisfaction,
+               Simplex dependenceBounding, MemoryAccess *in, MemoryAccess *out,
+               const bool forward)
+        : depPoly(std::move(depPoly)),
+          dependenceSatisfaction(std::move(dependenceSatisfaction)),
+          dependenceBounding(std::move(dependenceBounding)), in(in),
+          out(out), forward(forward),
+          halfLambda(this->depPoly.getNumLambda()) {
+        setDistance(this->depPoly.distanceRanges());
+    }
+    // Lazy construction; `xyDistance` are the `distanceRanges` of `depPoly`.
+    // `depPoly` must not change afterwards, as the Farkas systems are built
+    // from it.
+    Dependence(DependencePolyhedra depPoly, MemoryAccess *in, MemoryAccess *out,
+               const bool forward, llvm::ArrayRef<Interval> xyDistance)
+        : depPoly(std::move(depPoly)), in(in), out(out), forward(forward),
+          halfLambda(this->depPoly.getNumLambda()) {
+        setDistance(xyDistance);
+    }
+    void setDistance(llvm::ArrayRef<Interval> xyDistance) {
+        // `x` is `in` for forward dependencies
+        for (auto d : xyDistance)
+            distance.push_back(forward ? d : d * -1);
+    }
+    void buildFarkas() const {
+        if (dependenceSatisfaction)
+            return;
+        std::pair<Simplex, Simplex> pair(depPoly.farkasPair());
+        if (!forward)
+            std::swap(pair.first, pair.second);
+        pair.first.truncateVars(halfLambda +
+                                depPoly.getNumScheduleCoefficients());
+        dependenceSatisfaction = std::move(pair.first);
+        dependenceBounding = std::move(pair.second);
+    }
+    Simplex &getSatisfaction() const {
+        buildFarkas();
+        return *dependenceSatisfaction;
+    }
+    Simplex &getBounding() const {
+        buildFarkas();
+        return *dependenceBounding;
+    }
+    bool hasFarkas() const { return dependenceSatisfaction.hasValue(); }
+    Direction direction(size_t l) const {
+        const Interval d = distance[l];
+        if (d.lowerBound >= 1)
+            return Direction::Less;
+        if (d.upperBound <= -1)
+            return Direction::Greater;
+        if ((d.lowerBound == 0) && (d.upperBound == 0))
+            return Direction::Equal;
+        return Direction::Any;
+    }
+    // the distance vector is exact
+    bool hasConstantDistance() const {
+        for (auto d : distance)
+            if (d.lowerBound != d.upperBound)
+                return false;
+        return true;
+    }
+    // Whether loop `j` may carry the dependence with `sign*(out - in) >= 1`,
+    // i.e. `in` after `out` in loop `j` for `sign == -1`; see
+    // `DependencePolyhedra::mayCarry`. Only falls back to `depPoly` if
+    // `distance` cannot tell.
+    bool mayCarry(size_t j, int64_t sign) const {
+        bool outerEqual = true;
+        for (size_t i = 0; i < j; ++i) {
+            Direction dir = direction(i);
+            if ((dir == Direction::Less) || (dir == Direction::Greater))
+                return false;
+            outerEqual &= dir == Direction::Equal;
+        }
+        Interval d = distance[j] * sign;
+        if (d.upperBound <= 0)
+            return false;
+        if (outerEqual && (d.lowerBound >= 1))
+            return true;
+        return depPoly.mayCarry(j, forward ? -sign : sign);
+    }
+    bool mayCarry(size_t j) const { return mayCarry(j, 1) || mayCarry(j, -1); }
+    // Whether transforming the shared loops by `T` (new loops by old loops),
+    // e.g. a permutation or a skew, keeps `out` after `in`, i.e. whether
+    // `T*(out - in)` is lexicographically nonnegative. `None` if `distance`
+    // cannot tell.
+    llvm::Optional<bool> isPreservedBy(PtrMatrix<int64_t> T) const {
+        assert(T.numCol() == distance.size());
+        for (size_t k = 0; k < T.numRow(); ++k) {
+            Interval d{0};
+            for (size_t l = 0; l < T.numCol(); ++l)
+                if (int64_t t = T(k, l))
+                    d += distance[l] * t;
+            if (d.lowerBound >= 1)
+                return true;
+            if (d.upperBound <= -1)
+                return false;
+            if ((d.lowerBound != 0) || (d.upperBound != 0))
+                return {};
+        }
+        // loop independent, so the order within the body decides
+        return true;
+    }
+    // `isPreservedBy` for the permutation placing loop `order[k]` at `k`
+    llvm::Optional<bool>
+    isPreservedByPermutation(llvm::ArrayRef<unsigned> order) const {
+        IntMatrix T(order.size(), distance.size());
+        for (size_t k = 0; k < order.size(); ++k)
+            T(k, order[k]) = 1;
+        return isPreservedBy(T);
+    }
     // if there is no time dimension, it returns a 0xdim matrix and `R == 0`
     // else, it returns a square matrix, where the first `R` rows correspond
     // to time-axis.
@@ -598,11 +1028,11 @@ struct Dependence {
     // }
     // emplaces dependencies without any repeat accesses to the same memory
     // returns
-    size_t getNumLambda() const { return depPoly.getNumLambda() << 1; }
+    size_t getNumLambda() const { return halfLambda << 1; }
     size_t getNumSymbols() const { return depPoly.getNumSymbols(); }
     size_t getNumConstraints() const {
-        return dependenceBounding.getNumConstraints() +
-               dependenceSatisfaction.getNumConstraints();
+        return getBounding().getNumConstraints() +
+               getSatisfaction().getNumConstraints();
     }
     // order of variables:
     // [ lambda, schedule coefs on loops, const schedule coef, w, u ]
@@ -612,12 +1042,12 @@ struct Dependence {
         // const size_t numBoundingConstraints =
         //     dependenceBounding.getNumConstraints();
         const size_t numSchedulingConstraints =
-            dependenceSatisfaction.getNumConstraints();
-        const size_t halfLambda = depPoly.getNumLambda();
+            getSatisfaction().getNumConstraints();
         assert(A.numRow() == getNumConstraints());
         assert(A.numCol() == getNumLambda());
-        PtrMatrix<int64_t> sC{dependenceSatisfaction.getCostsAndConstraints()};
-        PtrMatrix<int64_t> bC{dependenceBounding.getCostsAndConstraints()};
+        const Simplex &sat = getSatisfaction(), &bnd = getBounding();
+        PtrMatrix<int64_t> sC{sat.getCostsAndConstraints()};
+        PtrMatrix<int64_t> bC{bnd.getCostsAndConstraints()};
         auto rS = _(begin, numSchedulingConstraints);
         auto rB = _(numSchedulingConstraints, end);
         d(rS) = sC(_, 0);
@@ -653,17 +1083,12 @@ struct Dependence {
         PtrVector<int64_t> yOmega = y.schedule.getOmega();
         Vector<int64_t> sch;
         sch.resizeForOverwrite(numLoopsTotal + 2);
+        // reused by every level's sub-problem
+        Simplex sub;
         // const size_t numLambda = DependencePolyhedra::getNumLambda();
-        SHOWLN(xPhi);
-        SHOWLN(yPhi);
-        SHOWLN(xOmega);
-        SHOWLN(yOmega);
         for (size_t i = 0; /*i <= numLoopsCommon*/; ++i) {
-            SHOWLN(i);
-            if (int64_t o2idiff = yOmega[2 * i] - xOmega[2 * i]) {
-                SHOWLN(o2idiff);
+            if (int64_t o2idiff = yOmega[2 * i] - xOmega[2 * i])
                 return o2idiff > 0;
-            }
             // we should not be able to reach `numLoopsCommon`
             // because at the very latest, this last schedule value
             // should be different, because either:
@@ -680,25 +1105,69 @@ struct Dependence {
             sch(_(numLoopsX, numLoopsTotal)) = yPhi(i, _);
             sch(numLoopsTotal) = xOmega[2 * i + 1];
             sch(numLoopsTotal + 1) = yOmega[2 * i + 1];
-            SHOWLN(sch);
-            if (fxy.unSatisfiableZeroRem(sch, numLambda, nonTimeDim)) {
-                assert(!fyx.unSatisfiableZeroRem(sch, numLambda, nonTimeDim));
+            if (fxy.unSatisfiableZeroRem(sub, sch, numLambda, nonTimeDim)) {
+                assert(!fyx.unSatisfiableZeroRem(sub, sch, numLambda,
+                                                 nonTimeDim));
                 return false;
             }
-            if (fyx.unSatisfiableZeroRem(sch, numLambda, nonTimeDim))
+            if (fyx.unSatisfiableZeroRem(sub, sch, numLambda, nonTimeDim))
                 return true;
         }
         assert(false);
         return false;
     }
+    // `checkDirection` from the schedules and the distances `y - x` alone, or
+    // `None` if they do not settle it.
+    static llvm::Optional<bool> checkDirection(const MemoryAccess &x,
+                                               const MemoryAccess &y,
+                                               llvm::ArrayRef<Interval> dist) {
+        const size_t numLoopsX = x.ref.getNumLoops();
+        const size_t numLoopsY = y.ref.getNumLoops();
+        const size_t numLoopsCommon = std::min(numLoopsX, numLoopsY);
+        SquarePtrMatrix<int64_t> xPhi = x.schedule.getPhi();
+        SquarePtrMatrix<int64_t> yPhi = y.schedule.getPhi();
+        PtrVector<int64_t> xOmega = x.schedule.getOmega();
+        PtrVector<int64_t> yOmega = y.schedule.getOmega();
+        for (size_t i = 0; i <= numLoopsCommon; ++i) {
+            if (int64_t o2idiff = yOmega[2 * i] - xOmega[2 * i])
+                return o2idiff > 0;
+            if ((i == numLoopsCommon) || (numLoopsX != numLoopsY) ||
+                (dist.size() != numLoopsX))
+                return {};
+            // `yPhi(i,_)*y - xPhi(i,_)*x`, if the rows match
+            Interval v{yOmega[2 * i + 1] - xOmega[2 * i + 1]};
+            for (size_t l = 0; l < numLoopsX; ++l) {
+                if (xPhi(i, l) != yPhi(i, l))
+                    return {};
+                if (int64_t c = xPhi(i, l))
+                    v += dist[l] * c;
+            }
+            if (v.lowerBound >= 1)
+                return true;
+            if (v.upperBound <= -1)
+                return false;
+            if (v.lowerBound || v.upperBound)
+                return {};
+        }
+        return {};
+    }
+    // The Farkas systems are only built here if the schedules and distances
+    // cannot settle the direction; otherwise, they are left to first use.
     static void timelessCheck(llvm::SmallVectorImpl<Dependence> &deps,
                               const DependencePolyhedra &dxy, MemoryAccess &x,
                               MemoryAccess &y) {
+        llvm::SmallVector<Interval, 4> dist = dxy.distanceRanges();
+        if (llvm::Optional<bool> isFwd = checkDirection(x, y, dist)) {
+            if (*isFwd)
+                deps.emplace_back(Dependence{dxy, &x, &y, true, dist});
+            else
+                deps.emplace_back(Dependence{dxy, &y, &x, false, dist});
+            return;
+        }
         std::pair<Simplex, Simplex> pair(dxy.farkasPair());
-        const size_t numLambda = 1 + dxy.getNumInequalityConstraints() +
-                                 2 * dxy.getNumEqualityConstraints();
+        const size_t numLambda = dxy.getNumLambda();
         if (checkDirection(pair, x, y, numLambda,
-                           dxy.A.numCol() - dxy.getTimeDim())) {
+                           pair.first.getNumConstraints())) {
             pair.first.truncateVars(numLambda +
                                     dxy.getNumScheduleCoefficients());
             deps.emplace_back(Dependence{std::move(dxy), std::move(pair.first),
@@ -730,7 +1199,6 @@ struct Dependence {
         MemoryAccess *in = &x, *out = &y;
         const bool isFwd = checkDirection(pair, x, y, numLambda,
                                           dxy.A.numCol() - dxy.getTimeDim());
-        SHOWLN(isFwd);
         if (isFwd) {
             std::swap(farkasBackups.first, farkasBackups.second);
         } else {
@@ -757,9 +1225,6 @@ struct Dependence {
         size_t t = 0;
         auto fE{farkasBackups.first.getConstraints()};
         auto sE{farkasBackups.second.getConstraints()};
-        std::cout << "Time check; ";
-        SHOWLN(dxy.A);
-        SHOWLN(dxy.E);
         do {
             // set `t`th timeDim to +1/-1
             int64_t step = dxy.nullStep[t];
@@ -772,12 +1237,6 @@ struct Dependence {
             for (size_t c = 0; c < numEqualityConstraintsOld; ++c) {
                 // each of these actually represents 2 inds
                 int64_t Ecv = dxy.E(c, v) * step;
-#ifndef NDEBUG
-                if (Ecv) {
-                    std::cout << "Found non-0: E(" << c << ", " << v
-                              << ") = " << Ecv << std::endl;
-                }
-#endif
                 fE(0, c + ineqEnd) -= Ecv;
                 fE(0, c + posEqEnd) += Ecv;
                 sE(0, c + ineqEnd) -= Ecv;
@@ -828,45 +1287,36 @@ struct Dependence {
                 sE(0, c + posEqEnd) += Ecv;
             }
         } while (++t < timeDim);
-#ifndef NDEBUG
-        std::cout << "time dxy =" << dxy << std::endl;
-#endif
         dxy.truncateVars(numVar);
-#ifndef NDEBUG
-        std::cout << "after zeroing, time dxy =" << dxy << std::endl;
-#endif
         farkasBackups.first.truncateVars(numLambda + numScheduleCoefs);
         deps.emplace_back(
             Dependence{std::move(dxy), std::move(farkasBackups.first),
                        std::move(farkasBackups.second), out, in, !isFwd});
     }
 
+    // Runs the `SubscriptTest` tiers first; only pairs they leave `Unknown`
+    // are checked for emptiness, and independent pairs are never built. The
+    // cheap rational check goes before the exact parametric one, which is
+    // only run when the bounds are symbolic.
     static size_t check(llvm::SmallVectorImpl<Dependence> &deps,
-                        MemoryAccess &x, MemoryAccess &y) {
+                        MemoryAccess &x, MemoryAccess &y,
+                        const PartiallyOrderedSet &poset = {}) {
         // static void check(llvm::SmallVectorImpl<Dependence> deps,
         //                   const ArrayReference &x, const Schedule &sx,
         //                   const ArrayReference &y, const Schedule &sy) {
-        if (x.ref.gcdKnownIndependent(y.ref))
+        SubscriptTest::Result pre =
+            SubscriptTest::check(x.ref, y.ref, poset).result;
+        if (pre == SubscriptTest::Result::Independent)
             return 0;
-        DependencePolyhedra dxy(x, y);
-        if (dxy.isEmpty())
+        DependencePolyhedra dxy(x, y, poset);
+        if ((pre == SubscriptTest::Result::Unknown) &&
+            (dxy.isEmpty() ||
+             ((dxy.getNumSymbols() > 1) && dxy.isIntegerEmpty(poset))))
             return 0;
-#ifndef NDEBUG
-        std::cout << "Pre prune-bounds" << std::endl;
-        SHOWLN(dxy.A);
-        SHOWLN(dxy.E);
-#endif
         dxy.pruneBounds();
         // note that we set boundAbove=true, so we reverse the
         // dependence direction for the dependency we week, we'll
         // discard the program variables x then y
-#ifndef NDEBUG
-        std::cout << "Post prune-bounds" << std::endl;
-        std::cout << "x = " << x.ref << "\ny = " << y.ref << "\ndxy =" << dxy
-                  << std::endl;
-        SHOWLN(dxy.A);
-        SHOWLN(dxy.E);
-#endif
         if (dxy.getTimeDim()) {
             timeCheck(deps, std::move(dxy), x, y);
             return 2;
@@ -883,16 +1333,18 @@ struct Dependence {
         //}
     }
 
-    friend std::ostream &operator<<(std::ostream &os, Dependence &d) {
+    // only prints the Farkas systems if they have been built
+    friend std::ostream &operator<<(std::ostream &os, const Dependence &d) {
         os << "Dependence Poly ";
         if (d.forward) {
             os << "x -> y:";
         } else {
             os << "y -> x:";
         }
-        return os << d.depPoly
-                  << "\nSchedule Constraints:" << d.dependenceSatisfaction
-                  << "\nBounding Constraints:" << d.dependenceBounding
-                  << std::endl;
+        os << d.depPoly;
+        if (d.hasFarkas())
+            os << "\nSchedule Constraints:" << *d.dependenceSatisfaction
+               << "\nBounding Constraints:" << *d.dependenceBounding;
+        return os << std::endl;
     }
 };
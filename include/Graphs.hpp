@@ -4,14 +4,11 @@
 #include <tuple>
 
 template <typename G>
-void visit(llvm::SmallVector<int64_t> sorted, G &graph, size_t idx) {
-    auto outs = outNeighbors(graph, idx);
+void visit(llvm::SmallVector<int64_t> &sorted, G &graph, size_t idx) {
     visited(graph, idx) = true;
-    for (size_t j = 0; j < length(outs); ++j) {
-        if (!visited(graph, j)) {
-            visit(sorted, graph, outs(j));
-        }
-    }
+    for (size_t j : outNeighbors(graph, idx))
+        if (!visited(graph, j))
+            visit(sorted, graph, j);
     sorted.push_back(idx);
 }
 
@@ -53,9 +50,9 @@ void strongConnect(
     indexLowLinkOnStack[v] = std::make_tuple(index, index, true);
     index += 1;
     stack.push_back(v);
+    visited(graph, v) = true;
 
-    auto outN = outNeighbors(graph, v);
-    for (size_t w = 0; w < length(outN); ++w) {
+    for (size_t w : outNeighbors(graph, v)) {
         if (visited(graph, w)) {
             auto [wIndex, wLowLink, wOnStack] = indexLowLinkOnStack[w];
             if (wOnStack) {
@@ -1,21 +1,103 @@
 #pragma once
 #include "./Math.hpp"
 #include "./Polyhedra.hpp"
+#include "./Simplex.hpp"
 #include "NormalForm.hpp"
-#include "lp_data/HConst.h"
-#include "lp_data/HighsStatus.h"
 #include "llvm/ADT/SmallVector.h"
-#include <Highs.h>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <numeric>
+#ifdef LOOPMODELS_USE_HIGHS
+#include "lp_data/HConst.h"
+#include "lp_data/HighsStatus.h"
+#include <Highs.h>
+#endif
 
 // use ILP solver for eliminating redundant constraints
+//
+// The built-in checker works on the `Simplex`; HiGHS is only used when
+// building with `-DLOOPMODELS_USE_HIGHS` (meson option `use_highs`), in which
+// case debug builds cross-check the two.
+
+// `a(0) + a(_(1,end))*x >= 0` for integer `x`; dividing the variable
+// coefficients by their gcd `g` lets us round the constant down.
+[[maybe_unused]] static void tightenIntegerConstraint(MutPtrVector<int64_t> a) {
+    int64_t g = 0;
+    for (size_t i = 1; i < a.size(); ++i)
+        if (a[i] && ((g = gcd(g, a[i])) == 1))
+            return;
+    if (g <= 1)
+        return;
+    int64_t a0 = a[0];
+    a[0] = (a0 >= 0) ? (a0 / g) : -((g - 1 - a0) / g);
+    for (size_t i = 1; i < a.size(); ++i)
+        a[i] /= g;
+}
+
+// Redundancy checker for `A*x >= 0`, `E*x == 0` with integer `x`, where
+// `A(_,0)` and `E(_,0)` are the constants.
+// The LP model is built once; `x` is split into `x+ - x-` as the `Simplex`
+// requires non-negative variables:
+//   [-A(_,1:end) A(_,1:end)] [x+; x-] <= A(_,0)
+//   [ E(_,1:end) -E(_,1:end)] [x+; x-] == -E(_,0)
+// A query for constraint `c` swaps in its integer-tightened negation,
+// `-A(c,_)*x - 1 >= 0`; if that system has no rational solution, no integer
+// `x` violates constraint `c`, so it is redundant. This is exact for the LP
+// relaxation and conservative otherwise.
+struct IntegerRedundancyChecker {
+    IntMatrix ineq;
+    IntMatrix eq;
+
+    IntegerRedundancyChecker(PtrMatrix<int64_t> A, PtrMatrix<int64_t> E)
+        : ineq(A.numRow(), 2 * A.numCol() - 1),
+          eq(E.numRow(), 2 * A.numCol() - 1) {
+        const size_t numVar = A.numCol() - 1;
+        for (size_t r = 0; r < A.numRow(); ++r)
+            setRow(ineq.getRow(r), A.getRow(r), 1);
+        for (size_t r = 0; r < E.numRow(); ++r) {
+            eq(r, 0) = -E(r, 0);
+            eq(r, _(1, 1 + numVar)) = E(r, _(1, 1 + numVar));
+            for (size_t v = 0; v < numVar; ++v)
+                eq(r, 1 + numVar + v) = -E(r, 1 + v);
+        }
+    }
+    IntegerRedundancyChecker(PtrMatrix<int64_t> A)
+        : IntegerRedundancyChecker(A, IntMatrix{0, A.numCol()}) {}
+
+    // writes `s*a*x >= 0`, after integer tightening, as a model row
+    static void setRow(MutPtrVector<int64_t> m, PtrVector<int64_t> a,
+                       int64_t s) {
+        const size_t numVar = a.size() - 1;
+        Vector<int64_t> t{a};
+        if (s < 0) {
+            t *= -1;
+            --t[0];
+        }
+        tightenIntegerConstraint(t);
+        m[0] = t[0];
+        for (size_t v = 0; v < numVar; ++v) {
+            m[1 + v] = -t[1 + v];
+            m[1 + numVar + v] = t[1 + v];
+        }
+    }
+    // returns `true` if constraint `c` of `A` is implied by the others
+    bool isRedundant(PtrMatrix<int64_t> A, size_t c) {
+        Vector<int64_t> old{ineq.getRow(c)};
+        setRow(ineq.getRow(c), A.getRow(c), -1);
+        bool redundant = !Simplex::positiveVariables(ineq, eq).hasValue();
+        ineq.getRow(c) = old;
+        return redundant;
+    }
+    // constraint `c` no longer takes part in later queries
+    void drop(size_t c) { ineq.getRow(c) = 0; }
+};
+
+#ifdef LOOPMODELS_USE_HIGHS
 
-void buildILPRedundancyEliminationModel(Highs &highs, IntMatrix auto &A,
+void buildILPRedundancyEliminationModel(Highs &highs, IntMatrix &A,
                                         llvm::SmallVectorImpl<int64_t> &b,
-                                        IntMatrix auto &E,
+                                        IntMatrix &E,
                                         llvm::SmallVectorImpl<int64_t> &q,
                                         size_t C) {
     auto [numVar, numColA] = A.size();
@@ -115,9 +197,9 @@ void buildILPRedundancyEliminationModel(Highs &highs, IntMatrix auto &A,
     HighsStatus return_status = highs.passModel(std::move(model));
     assert(return_status == HighsStatus::kOk);
 }
-void updateILPRedundancyEliminationModel(Highs &highs, IntMatrix auto &A,
+void updateILPRedundancyEliminationModel(Highs &highs, IntMatrix &A,
                                          llvm::SmallVectorImpl<int64_t> &b,
-                                         IntMatrix auto &E,
+                                         IntMatrix &E,
                                          llvm::SmallVectorImpl<int64_t> &q,
                                          size_t Cnew, size_t Cold) {
 
@@ -131,9 +213,9 @@ void updateILPRedundancyEliminationModel(Highs &highs, IntMatrix auto &A,
     highs.changeColsCost(numVar, set, cost);
 }
 
-bool constraintIsRedundant(IntMatrix auto &A,
+bool constraintIsRedundant(IntMatrix &A,
                            llvm::SmallVectorImpl<int64_t> &b,
-                           IntMatrix auto &E,
+                           IntMatrix &E,
                            llvm::SmallVectorImpl<int64_t> &q, const size_t C) {
 
     Highs highs;
@@ -164,9 +246,8 @@ bool constraintIsRedundant(IntMatrix auto &A,
     return redundant;
 }
 
-void pruneBounds(IntMatrix auto &A, llvm::SmallVectorImpl<int64_t> &b,
-                 IntMatrix auto &E, llvm::SmallVectorImpl<int64_t> &q) {
-    NormalForm::simplifyEqualityConstraints(E, q);
+void pruneBounds(IntMatrix &A, llvm::SmallVectorImpl<int64_t> &b,
+                 IntMatrix &E, llvm::SmallVectorImpl<int64_t> &q) {
     for (size_t c = A.numCol(); c > 0;) {
         if (constraintIsRedundant(A, b, E, q, --c)) {
 #ifndef NDEBUG
@@ -178,98 +259,49 @@ void pruneBounds(IntMatrix auto &A, llvm::SmallVectorImpl<int64_t> &b,
     }
 }
 
-void fourierMotzkin(IntMatrix auto &Anew, llvm::SmallVectorImpl<int64_t> &bnew,
-                    IntMatrix auto &Enew, llvm::SmallVectorImpl<int64_t> &qnew,
-                    IntMatrix auto &A, llvm::SmallVectorImpl<int64_t> &b,
-                    IntMatrix auto &E, llvm::SmallVectorImpl<int64_t> &q,
-                    size_t i) {
-
-    const auto [numRow, numColA] = A.size();
-    const size_t numColE = E.numCol();
-    size_t countNeg = 0, countPos = 0, countEq = 0;
-    for (size_t j = 0; j < numColA; ++j) {
-        countNeg += (A(i, j) < 0);
-        countPos += (A(i, j) > 0);
+// Cross-check of `IntegerRedundancyChecker::isRedundant` on the same
+// row-major `A*x >= 0`, `E*x == 0` system, using the column-major
+// `A'x <= b`, `E'x == q` form HiGHS is fed above.
+bool highsConstraintIsRedundant(PtrMatrix<int64_t> A, PtrMatrix<int64_t> E,
+                                size_t c) {
+    const size_t numVar = A.numCol() - 1;
+    IntMatrix Ac(numVar, A.numRow());
+    llvm::SmallVector<int64_t> b(A.numRow());
+    for (size_t r = 0; r < A.numRow(); ++r) {
+        b[r] = A(r, 0);
+        for (size_t v = 0; v < numVar; ++v)
+            Ac(v, r) = -A(r, v + 1);
     }
-    for (size_t j = 0; j < numColE; ++j) {
-        countEq += (E(i, j) != 0);
+    IntMatrix Ec(numVar, E.numRow());
+    llvm::SmallVector<int64_t> q(E.numRow());
+    for (size_t r = 0; r < E.numRow(); ++r) {
+        q[r] = -E(r, 0);
+        for (size_t v = 0; v < numVar; ++v)
+            Ec(v, r) = E(r, v + 1);
     }
-    size_t newColA = numColA - countNeg - countPos +
-                     (countNeg + countEq) * (countPos + countEq) -
-                     countEq * countEq;
-
-    Anew.resize(numRow, newColA);
-    bnew.resize(newColA);
-    size_t newColE = numColE - countEq + countEq * countEq;
-    Enew.resize(numRow, newColE);
-    qnew.resize(newColE);
+    return constraintIsRedundant(Ac, b, Ec, q, c);
+}
+#endif
 
-    size_t a = 0;
-    for (size_t j = 0; j < numColA; ++j) {
-        if (int64_t Aij = A(i, j)) {
-            for (size_t k = 0; k < j; ++k) {
-                if ((A(i, k) == 0) || ((Aij > 0) == (A(i, k) > 0)))
-                    continue;
-                if (IntegerPolyhedra::setBounds(Anew.getCol(a), bnew[a],
-                                                A.getCol(j), b[j], A.getCol(k),
-                                                b[k], i) &&
-                    IntegerPolyhedra::uniqueConstraint(Anew, bnew, a)) {
-                    ++a;
-                }
-            }
-            for (size_t k = 0; k < numColE; ++k) {
-                if (E(i, k) == 0)
-                    continue;
-                if ((E(i, k) > 0) == (Aij > 0)) {
-                    for (size_t v = 0; v < numRow; ++v) {
-                        E(v, k) *= -1;
-                    }
-                    q[k] *= -1;
-                }
-                if (IntegerPolyhedra::setBounds(Anew.getCol(a), bnew[a],
-                                                A.getCol(j), b[j], E.getCol(k),
-                                                q[k], i) &&
-                    IntegerPolyhedra::uniqueConstraint(Anew, bnew, a)) {
-                    ++a;
-                }
-            }
-        } else {
-            for (size_t v = 0; v < numRow; ++v) {
-                Anew(v, a) = A(v, j);
-            }
-            bnew[a] = b[j];
-            if (IntegerPolyhedra::uniqueConstraint(Anew, bnew, a)) {
-                ++a;
-            }
-        }
-    }
-    Anew.resize(numRow, a);
-    bnew.resize(a);
-    size_t e = 0;
-    for (size_t j = 0; j < numColE; ++j) {
-        if (int64_t Eij = E(i, j)) {
-            for (size_t k = 0; k < j; ++k) {
-                if (k == j)
-                    continue;
-                if (int64_t Eik = E(i, k)) {
-                    int64_t g = gcd(Eij, Eik);
-                    int64_t Ejg = Eij / g;
-                    int64_t Ekg = Eik / g;
-                    for (size_t v = 0; v < numRow; ++v) {
-                        Enew(v, e) = Ejg * E(v, k) - Ekg * E(v, j);
-                    }
-                    qnew[e] = Ejg * q[k] - Ekg * q[j];
-                    ++e;
-                }
-            }
-        } else {
-            for (size_t v = 0; v < numRow; ++v) {
-                Enew(v, e) = E(v, j);
-            }
-            qnew[e] = q[j];
-            ++e;
+// Drops all constraints of `A` that are implied by the others.
+[[maybe_unused]] static void pruneBoundsILP(IntMatrix &A,
+                                            PtrMatrix<int64_t> E) {
+    IntegerRedundancyChecker checker{A, E};
+    llvm::SmallVector<unsigned> redundant;
+    for (size_t c = A.numRow(); c;) {
+        bool isRedundant = checker.isRedundant(A, --c);
+#if defined(LOOPMODELS_USE_HIGHS) && !defined(NDEBUG)
+        // the LP relaxation is weaker than HiGHS' ILP
+        assert(!isRedundant || highsConstraintIsRedundant(A, E, c));
+#endif
+        if (isRedundant) {
+            checker.drop(c);
+            redundant.push_back(c);
         }
     }
-    Enew.resize(numRow, e);
-    qnew.resize(e);
+    for (auto c : redundant)
+        eraseConstraint(A, c);
+}
+[[maybe_unused]] static void pruneBoundsILP(IntMatrix &A) {
+    pruneBoundsILP(A, IntMatrix{0, A.numCol()});
 }
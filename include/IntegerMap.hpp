@@ -65,7 +65,7 @@ struct ValueToPosetMap {
         return j;
     }
     // 0 is sentinal value for not found
-    size_t getForward(llvm::Value *i) { return forward.lookup(i); }
+    size_t getForward(llvm::Value *i) const { return forward.lookup(i); }
     // nullptr is sentinal value for not found
     llvm::Value *getBackward(size_t j) {
         j -= 1;
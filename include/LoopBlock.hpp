@@ -1,6 +1,7 @@
 #pragma once
 
 #include "./ArrayReference.hpp"
+#include "./BitSets.hpp"
 #include "./DependencyPolyhedra.hpp"
 #include "./Loops.hpp"
 #include "./Math.hpp"
@@ -8,6 +9,7 @@
 #include "./Schedule.hpp"
 #include "./Simplex.hpp"
 #include "./Symbolics.hpp"
+#include "Graphs.hpp"
 #include "LinearAlgebra.hpp"
 #include "Orthogonalize.hpp"
 #include <cstddef>
@@ -68,6 +70,54 @@
 // for (i = eachindex(y)){
 //   f(m, ...); // Omega = [2, _, 0]
 // }
+// Compressed sparse row view of the dependence graph of a `LoopBlock`,
+// frozen once the edges are filled. Vertices are memory accesses; the
+// out-neighbors of `i` are `neighbors[offsets[i]:offsets[i+1]]`, and
+// `edgeIds` holds the index of the corresponding `Dependence`.
+struct DependenceGraph {
+    llvm::SmallVector<unsigned> offsets;
+    llvm::SmallVector<unsigned> neighbors;
+    llvm::SmallVector<unsigned> edgeIds;
+    BitSet visitedSet;
+    DependenceGraph() = default;
+    DependenceGraph(llvm::ArrayRef<MemoryAccess> memory,
+                    llvm::ArrayRef<Dependence> edges)
+        : visitedSet(memory.size()) {
+        offsets.resize_for_overwrite(memory.size() + 1);
+        neighbors.resize_for_overwrite(edges.size());
+        edgeIds.resize_for_overwrite(edges.size());
+        size_t k = 0;
+        for (size_t i = 0; i < memory.size(); ++i) {
+            offsets[i] = k;
+            for (unsigned e : memory[i].edgesOut) {
+                neighbors[k] = edges[e].out - memory.data();
+                edgeIds[k++] = e;
+            }
+        }
+        offsets[memory.size()] = k;
+        assert(k == edges.size());
+    }
+    size_t getNumVertices() const { return offsets.size() - 1; }
+    llvm::ArrayRef<unsigned> outNeighbors(size_t i) const {
+        return llvm::ArrayRef<unsigned>(neighbors)
+            .slice(offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    llvm::ArrayRef<unsigned> outEdges(size_t i) const {
+        return llvm::ArrayRef<unsigned>(edgeIds)
+            .slice(offsets[i], offsets[i + 1] - offsets[i]);
+    }
+};
+// `Graphs.hpp` interface
+inline size_t nv(const DependenceGraph &g) { return g.getNumVertices(); }
+inline llvm::ArrayRef<unsigned> outNeighbors(const DependenceGraph &g,
+                                             size_t i) {
+    return g.outNeighbors(i);
+}
+inline void clearVisited(DependenceGraph &g) { clear(g.visitedSet); }
+inline BitSet::Reference visited(DependenceGraph &g, size_t i) {
+    return BitSet::Reference{g.visitedSet, i};
+}
+
 struct LoopBlock {
     // llvm::SmallVector<ArrayReference, 0> refs;
     // TODO: figure out how to handle the graph's dependencies based on
@@ -81,9 +131,12 @@ struct LoopBlock {
     llvm::SmallVector<MemoryAccess, 0> memory;
 
     llvm::SmallVector<Dependence, 0> edges;
-    llvm::SmallVector<bool> visited; // visited, for traversing graph
+    DependenceGraph graph; // frozen view of `edges`, see `fillEdges`
     llvm::DenseMap<llvm::User *, MemoryAccess *> userToMemory;
     llvm::SmallVector<Polynomial::Monomial> symbols;
+    // scratch space for `isSatisfied`, reused across queries
+    mutable Simplex satScratch;
+    mutable Vector<int64_t> schScratch;
     // Simplex simplex;
     // ArrayReference &ref(MemoryAccess &x) { return refs[x.ref]; }
     // ArrayReference &ref(MemoryAccess *x) { return refs[x->ref]; }
@@ -94,7 +147,6 @@ struct LoopBlock {
     //     return refs[x->ref];
     // }
     bool isSatisfied(const Dependence &e) const {
-        const Simplex &sat = e.dependenceSatisfaction;
         Schedule &schIn = e.in->schedule;
         Schedule &schOut = e.out->schedule;
         const ArrayReference &refIn = e.in->ref;
@@ -103,13 +155,11 @@ struct LoopBlock {
         size_t numLoopsOut = refOut.getNumLoops();
         size_t numLoopsCommon = std::min(numLoopsIn, numLoopsOut);
         size_t numLoopsTotal = numLoopsIn + numLoopsOut;
-        Vector<int64_t> schv;
-        schv.resizeForOverwrite(sat.getNumVar());
+        Vector<int64_t> &schv = schScratch;
         const SquarePtrMatrix<int64_t> inPhi = schIn.getPhi();
         const SquarePtrMatrix<int64_t> outPhi = schOut.getPhi();
         llvm::ArrayRef<int64_t> inOmega = schIn.getOmega();
         llvm::ArrayRef<int64_t> outOmega = schOut.getOmega();
-        const size_t numLambda = e.getNumLambda();
         // when i == numLoopsCommon, we've passed the last loop
         for (size_t i = 0; i <= numLoopsCommon; ++i) {
             if (int64_t o2idiff = outOmega[2 * i] - inOmega[2 * i]) {
@@ -128,6 +178,32 @@ struct LoopBlock {
             //   present at that level
             // }
             assert(i != numLoopsCommon);
+            int64_t inO = inOmega[2 * i + 1], outO = outOmega[2 * i + 1];
+            // if both share the same `phi` row, its value on `out - in`
+            // follows from the cached distances
+            if ((numLoopsIn == numLoopsOut) &&
+                (e.distance.size() == numLoopsIn)) {
+                bool samePhi = true;
+                Interval d{outO - inO};
+                for (size_t j = 0; samePhi && (j < numLoopsIn); ++j) {
+                    int64_t c = inPhi(j, i);
+                    samePhi = c == outPhi(j, i);
+                    if (c)
+                        d += e.distance[j] * c;
+                }
+                if (samePhi) {
+                    if (d.lowerBound >= 1)
+                        return true;
+                    if (d.upperBound <= -1)
+                        return false;
+                    if ((d.lowerBound == 0) && (d.upperBound == 0))
+                        continue;
+                }
+            }
+            // only now are the Farkas systems needed
+            const Simplex &sat = e.getSatisfaction();
+            const size_t numLambda = e.getNumLambda();
+            schv.resizeForOverwrite(sat.getNumVar());
             const size_t offIn = e.forward ? 0 : numLoopsOut;
             const size_t offOut = e.forward ? numLoopsIn : 0;
             for (size_t j = 0; j < numLoopsIn; ++j) {
@@ -136,14 +212,14 @@ struct LoopBlock {
             for (size_t j = 0; j < numLoopsOut; ++j) {
                 schv[j + offOut] = outPhi(j, i);
             }
-            int64_t inO = inOmega[2 * i + 1], outO = outOmega[2 * i + 1];
             // forward means offset is 2nd - 1st
             schv[numLoopsTotal] = outO - inO;
             // dependenceSatisfaction is phi_t - phi_s >= 0
             // dependenceBounding is w + u'N - (phi_t - phi_s) >= 0
             // we implicitly 0-out `w` and `u` here,
-            if (sat.satisfiable(schv, numLambda)) {
-                if (e.dependenceBounding.unSatisfiable(schv, numLambda)) {
+            if (sat.satisfiable(satScratch, schv, numLambda)) {
+                if (e.getBounding().unSatisfiable(satScratch, schv,
+                                                  numLambda)) {
                     // if zerod-out bounding not >= 0, then that means
                     // phi_t - phi_s > 0, so the dependence is satisfied
                     return true;
@@ -198,10 +274,11 @@ struct LoopBlock {
     //         // push both edge directions
     //     }
     // }
-    void addEdge(MemoryAccess &mai, MemoryAccess &maj) {
+    void addEdge(MemoryAccess &mai, MemoryAccess &maj,
+                 const PartiallyOrderedSet &poset = {}) {
         // note, axes should be fully delinearized, so should line up
         // as a result of preprocessing.
-        if (size_t numDeps = Dependence::check(edges, mai, maj)) {
+        if (size_t numDeps = Dependence::check(edges, mai, maj, poset)) {
             size_t numEdges = edges.size();
             size_t e = numEdges - numDeps;
             do {
@@ -234,8 +311,8 @@ struct LoopBlock {
         }
     }
     // fills all the edges between memory accesses, checking for
-    // dependencies.
-    void fillEdges() {
+    // dependencies; `poset` holds the known ranges of the symbols.
+    void fillEdges(const PartiallyOrderedSet &poset = {}) {
         for (size_t i = 1; i < memory.size(); ++i) {
             MemoryAccess &mai = memory[i];
             ArrayReference &refI = mai.ref;
@@ -245,10 +322,13 @@ struct LoopBlock {
                 if ((refI.arrayID != refJ.arrayID) ||
                     ((mai.isLoad) && (maj.isLoad)))
                     continue;
-                addEdge(mai, maj);
+                addEdge(mai, maj, poset);
             }
         }
+        freezeGraph();
     }
+    // builds `graph`; call again if `edges` are added after `fillEdges`.
+    void freezeGraph() { graph = DependenceGraph(memory, edges); }
     static llvm::IntrusiveRefCntPtr<AffineLoopNest>
     getBang(llvm::DenseMap<const AffineLoopNest *,
                            llvm::IntrusiveRefCntPtr<AffineLoopNest>> &map,
@@ -285,14 +365,14 @@ struct LoopBlock {
         }
     }
     void orthogonalizeStores() {
-        llvm::SmallVector<bool, 256> visited(memory.size());
+        BitSet visited(memory.size());
         for (size_t i = 0; i < memory.size(); ++i) {
-            if (visited[i])
+            if (contains(visited, i))
                 continue;
             MemoryAccess &mai = memory[i];
             if (mai.isLoad)
                 continue;
-            visited[i] = true;
+            push(visited, i);
             ArrayReference &refI = mai.ref;
             size_t dimI = refI.arrayDim();
             auto indMatI = refI.indexMatrix();
@@ -382,7 +462,7 @@ struct LoopBlock {
                 rowStore = 0;
                 rowLoad = numStore;
                 for (unsigned j : orthInds) {
-                    visited[j] = true;
+                    push(visited, j);
                     MemoryAccess &maj = memory[j];
                     // unsigned oldRefID = maj.ref;
                     // if (refMap[oldRefID] >= 0) {
@@ -440,6 +520,42 @@ struct LoopBlock {
         }
         return std::make_tuple(a, b, c);
     }
+    size_t getIndex(const MemoryAccess *m) const { return m - memory.data(); }
+    // strongly connected components of the dependence graph, in topological
+    // order. Edges between components are satisfied by the order of the
+    // components, so each component can be scheduled with its own simplex.
+    llvm::SmallVector<llvm::SmallVector<int64_t>> getComponents() {
+        // Tarjan's algorithm returns components in reverse topological order
+        assert(nv(graph) == memory.size());
+        auto components = stronglyConnectedComponents(graph);
+        std::reverse(components.begin(), components.end());
+        return components;
+    }
+    // like the above, but only counting edges within `component`
+    size_t countNumScheduleCoefs(llvm::ArrayRef<int64_t> component) const {
+        size_t c = component.size();
+        for (auto m : component)
+            c += memory[m].getNumLoops();
+        return c;
+    }
+    std::tuple<size_t, size_t, size_t>
+    countAuxParamsAndConstraints(llvm::ArrayRef<int64_t> component) const {
+        BitSet inComponent(memory.size());
+        for (auto m : component)
+            push(inComponent, m);
+        size_t a = 0, b = 0, c = 0;
+        for (auto m : component) {
+            for (auto i : graph.outEdges(m)) {
+                const Dependence &e = edges[i];
+                if (!contains(inComponent, getIndex(e.out)))
+                    continue;
+                a += e.getNumLambda();
+                b += e.getNumSymbols();
+                c += e.getNumConstraints();
+            }
+        }
+        return std::make_tuple(a, b, c);
+    }
     // assemble simplex
     // we want to order variables
     // bounding, scheduled coefs, lambda
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "./ArrayReference.hpp"
+#include "./CostModeling.hpp"
+#include "./DependencyPolyhedra.hpp"
+#include "./LoopBlock.hpp"
+#include "./Loops.hpp"
+#include "./Math.hpp"
+#include "./Schedule.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+
+// Greedy fusion of the loop nests of a `LoopBlock`.
+//
+// Nests are the clusters of accesses sharing `omega[0]`, in program order.
+// Only adjacent clusters, whose nests' `omega[0]` are consecutive, may be
+// fused, as a gap means something unmodeled lies between them.
+// Fusing the adjacent clusters `a` and `b` through `d` levels gives the
+// accesses of `b` the `omega[2*l]` of `a` for `l < d`, and places them after
+// those of `a` at level `d`. This is legal if
+// 1. the outer `d` loops of all their nests have the same bounds, and
+// 2. no dependence from an access in one to an access in the other has a
+//    source iteration after its destination iteration within the outer `d`
+//    loops, as checked with `Dependence::mayCarry`.
+// We pick the deepest legal fusion that fits within `registerCount`
+// reference streams, and whose lines touched per iteration of loop `d-1`
+// fit in the cache.
+// Pairs are weighted by reuse: a load of an array stored by the other
+// (producer-consumer) counts `2`, any other pair of accesses to the same
+// array `1`. The heaviest pair is fused until no candidate is left.
+struct LoopFusion {
+    struct Cluster {
+        // indices into `memory`
+        llvm::SmallVector<unsigned> members;
+        // loops shared by all members
+        size_t depth;
+        // `omega[0]` of the first and last nest merged into the cluster
+        int64_t first, last;
+    };
+    llvm::MutableArrayRef<MemoryAccess> memory;
+    llvm::ArrayRef<Dependence> edges;
+    CacheModel cache;
+    unsigned registerCount;
+    llvm::SmallVector<Cluster> clusters;
+
+    LoopFusion(LoopBlock &lblock, unsigned registerCount,
+               CacheModel cache = {})
+        : memory(lblock.memory), edges(lblock.edges), cache(cache),
+          registerCount(registerCount) {
+        llvm::SmallVector<unsigned> order;
+        for (unsigned i = 0; i < memory.size(); ++i)
+            order.push_back(i);
+        std::stable_sort(order.begin(), order.end(),
+                         [&](unsigned a, unsigned b) {
+                             return memory[a].schedule.getOmega()[0] <
+                                    memory[b].schedule.getOmega()[0];
+                         });
+        for (auto i : order) {
+            const Schedule &sch = memory[i].schedule;
+            const int64_t omega0 = sch.getOmega()[0];
+            if (clusters.empty() || (clusters.back().first != omega0)) {
+                clusters.push_back(Cluster{{i}, sch.numLoops, omega0, omega0});
+                continue;
+            }
+            Cluster &c = clusters.back();
+            const Schedule &first = memory[c.members.front()].schedule;
+            c.depth = std::min(c.depth, size_t(sch.numLoops));
+            while (c.depth && !first.fusedThrough(sch, c.depth))
+                --c.depth;
+            c.members.push_back(i);
+        }
+    }
+    // whether nothing lies between `clusters[c]` and `clusters[c+1]`
+    bool adjacent(size_t c) const {
+        return clusters[c + 1].first == clusters[c].last + 1;
+    }
+    unsigned getIndex(const MemoryAccess *m) const {
+        return m - memory.data();
+    }
+    // Constraints of `loop` projected onto its outer `d` loops, as sorted
+    // rows over `[1, symbols, x_0, ..., x_{d-1}]`.
+    static llvm::SmallVector<llvm::SmallVector<int64_t>>
+    outerBounds(const AffineLoopNest &loop, size_t d) {
+        AffineLoopNest tmp = loop;
+        for (size_t i = tmp.getNumLoops(); i-- > d;)
+            tmp.removeLoopBang(i);
+        const size_t n = tmp.getNumSymbols() + d;
+        llvm::SmallVector<llvm::SmallVector<int64_t>> rows;
+        for (size_t r = 0; r < tmp.A.numRow(); ++r) {
+            if (allZero(tmp.A(r, _(begin, n))))
+                continue;
+            llvm::SmallVector<int64_t> &row = rows.emplace_back();
+            for (size_t k = 0; k < n; ++k)
+                row.push_back(tmp.A(r, k));
+        }
+        std::sort(rows.begin(), rows.end());
+        return rows;
+    }
+    bool conforming(const Cluster &a, const Cluster &b, size_t d) const {
+        const AffineLoopNest *first = memory[a.members.front()].ref.loop.get();
+        auto bounds = outerBounds(*first, d);
+        auto check = [&](const Cluster &c) {
+            for (auto i : c.members) {
+                const AffineLoopNest *loop = memory[i].ref.loop.get();
+                if ((loop != first) && ((loop->symbols != first->symbols) ||
+                                        (outerBounds(*loop, d) != bounds)))
+                    return false;
+            }
+            return true;
+        };
+        return check(a) && check(b);
+    }
+    static bool contains(const Cluster &c, unsigned i) {
+        return std::find(c.members.begin(), c.members.end(), i) !=
+               c.members.end();
+    }
+    bool isLegal(const Cluster &a, const Cluster &b, size_t d) const {
+        for (auto &e : edges) {
+            unsigned in = getIndex(e.in), out = getIndex(e.out);
+            if (!((contains(a, in) && contains(b, out)) ||
+                  (contains(b, in) && contains(a, out))))
+                continue;
+            for (size_t l = 0; l < d; ++l)
+                if (e.mayCarry(l, -1))
+                    return false;
+        }
+        return true;
+    }
+    bool fits(const Cluster &a, const Cluster &b, size_t d) const {
+        llvm::SmallVector<const ArrayReference *> refs;
+        for (auto i : a.members)
+            addReferenceGroup(refs, memory[i].ref);
+        for (auto i : b.members)
+            addReferenceGroup(refs, memory[i].ref);
+        if (refs.size() > registerCount)
+            return false;
+        double lines = 0.0;
+        for (auto r : refs) {
+            TilingCostModel model(*r->loop, {}, cache);
+            llvm::SmallVector<int64_t> tile{model.tripCounts};
+            std::fill(tile.begin(), tile.begin() + d, 1);
+            lines += model.footprint(*r, tile);
+        }
+        return lines <= double(cache.cacheLines);
+    }
+    int64_t reuse(const Cluster &a, const Cluster &b) const {
+        int64_t w = 0;
+        for (auto i : a.members) {
+            for (auto j : b.members) {
+                const MemoryAccess &x = memory[i];
+                const MemoryAccess &y = memory[j];
+                if (x.ref.arrayID != y.ref.arrayID)
+                    continue;
+                w += ((!x.isLoad) && y.isLoad) ? 2 : 1;
+            }
+        }
+        return w;
+    }
+    // deepest legal fusion of `a` and `b`, `0` if none
+    size_t fusionDepth(const Cluster &a, const Cluster &b) const {
+        for (size_t d = std::min(a.depth, b.depth); d; --d)
+            if (conforming(a, b, d) && isLegal(a, b, d) && fits(a, b, d))
+                return d;
+        return 0;
+    }
+    void merge(size_t c, size_t d) {
+        Cluster &a = clusters[c];
+        Cluster &b = clusters[c + 1];
+        MutPtrVector<int64_t> aOmega =
+            memory[a.members.front()].schedule.getOmega();
+        int64_t aMax = std::numeric_limits<int64_t>::min();
+        int64_t bMin = std::numeric_limits<int64_t>::max();
+        for (auto i : a.members)
+            aMax = std::max(aMax, memory[i].schedule.getOmega()[2 * d]);
+        for (auto i : b.members)
+            bMin = std::min(bMin, memory[i].schedule.getOmega()[2 * d]);
+        for (auto i : b.members) {
+            MutPtrVector<int64_t> omega = memory[i].schedule.getOmega();
+            for (size_t l = 0; l < d; ++l)
+                omega[2 * l] = aOmega[2 * l];
+            omega[2 * d] += aMax + 1 - bMin;
+        }
+        a.members.append(b.members.begin(), b.members.end());
+        a.depth = d;
+        a.last = b.last;
+        clusters.erase(clusters.begin() + c + 1);
+    }
+    // returns the number of fusions
+    size_t fuse() {
+        size_t numFused = 0;
+        while (true) {
+            size_t best = clusters.size(), bestDepth = 0;
+            int64_t bestReuse = 0;
+            for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+                if (!adjacent(c))
+                    continue;
+                int64_t w = reuse(clusters[c], clusters[c + 1]);
+                if (w <= bestReuse)
+                    continue;
+                if (size_t d = fusionDepth(clusters[c], clusters[c + 1])) {
+                    best = c;
+                    bestDepth = d;
+                    bestReuse = w;
+                }
+            }
+            if (best == clusters.size())
+                return numFused;
+            merge(best, bestDepth);
+            ++numFused;
+        }
+    }
+};
@@ -71,6 +71,40 @@ struct AffineLoopNest : SymbolicPolyhedra,
         return ret;
     }
 
+    // Tiles loop `i` by `tileSizes[i]` when `tileSizes[i] > 0`.
+    // The result has one tile loop `t` per tiled loop first (in the original
+    // order), followed by the original (point) loops, with
+    // tileSizes[i]*t <= x_i <= tileSizes[i]*t + tileSizes[i] - 1
+    // Bounds of the tile loops follow from projecting out the point loops.
+    llvm::IntrusiveRefCntPtr<AffineLoopNest>
+    tile(llvm::ArrayRef<int64_t> tileSizes) const {
+        const size_t numConst = getNumSymbols();
+        const size_t numLoops = getNumLoops();
+        assert(tileSizes.size() == numLoops);
+        size_t numTiled = 0;
+        for (auto t : tileSizes)
+            numTiled += (t > 0);
+        const size_t M = A.numRow();
+        IntMatrix B(M + 2 * numTiled, numConst + numTiled + numLoops);
+        B(_(begin, M), _(begin, numConst)) = A(_, _(begin, numConst));
+        B(_(begin, M), _(numConst + numTiled, end)) = A(_, _(numConst, end));
+        size_t r = M, t = numConst;
+        for (size_t i = 0; i < numLoops; ++i) {
+            int64_t T = tileSizes[i];
+            if (T <= 0)
+                continue;
+            size_t x = numConst + numTiled + i;
+            // x - T*t >= 0
+            B(r, t) = -T;
+            B(r++, x) = 1;
+            // T - 1 + T*t - x >= 0
+            B(r, 0) = T - 1;
+            B(r, t++) = T;
+            B(r++, x) = -1;
+        }
+        return construct(std::move(B), symbols);
+    }
+
     PtrVector<int64_t> getProgVars(size_t j) const {
         return A(j, _(0, getNumSymbols()));
     }
@@ -116,14 +150,14 @@ struct AffineLoopNest : SymbolicPolyhedra,
         return ret;
     }
     llvm::SmallVector<std::pair<IntMatrix, IntMatrix>, 0>
-    getBounds(PtrVector<unsigned> x) {
+    getBounds(PtrVector<unsigned> x) const {
         llvm::SmallVector<std::pair<IntMatrix, IntMatrix>, 0> ret;
         size_t i = x.size();
         ret.resize_for_overwrite(i);
         AffineLoopNest tmp = *this;
         while (true) {
             size_t xi = x[--i];
-            ret[i] = tmp.bounds(xi);
+            ret[i] = tmp.bounds(xi + getNumSymbols());
             if (i == 0)
                 break;
             tmp.removeLoopBang(xi);
@@ -151,9 +185,11 @@ struct AffineLoopNest : SymbolicPolyhedra,
 
         // for (size_t i = _i + 1; i < numPrevLoops; ++i)
         // tmp.removeLoopBang(i);
+        llvm::SmallVector<size_t> vars;
         for (size_t i = 0; i < numPrevLoops; ++i)
             if (i != _i)
-                tmp.removeVariableAndPrune(i + getNumSymbols());
+                vars.push_back(i + getNumSymbols());
+        tmp.removeVariablesAndPrune(vars);
         bool indep = true;
         const size_t numConst = getNumSymbols();
         for (size_t n = 0; n < tmp.A.numRow(); ++n)
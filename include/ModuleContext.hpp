@@ -0,0 +1,85 @@
+#pragma once
+
+#include "./IntegerMap.hpp"
+#include "./POSet.hpp"
+#include <cstddef>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Casting.h>
+
+// struct ModuleContext
+// Symbols and facts that hold in every function of a module, built once and
+// shared by all of them.
+// `llvm.assume`s only hold where they are executed, so they are not module
+// facts. What we do know module-wide are the values of integer constants:
+// a load of `@N = constant i64 10` is `10` in every function, and every such
+// load maps to the same symbol.
+struct ModuleContext {
+    ValueToPosetMap symbols;
+    PartiallyOrderedSet poset;
+
+    ModuleContext() = default;
+    ModuleContext(llvm::Module &M) {
+        for (llvm::GlobalVariable &G : M.globals())
+            addGlobal(G);
+    }
+    void addGlobal(llvm::GlobalVariable &G) {
+        if (!(G.isConstant() && G.hasDefinitiveInitializer()))
+            return;
+        llvm::ConstantInt *c =
+            llvm::dyn_cast<llvm::ConstantInt>(G.getInitializer());
+        if ((!c) || (c->getBitWidth() > 64))
+            return;
+        size_t id = symbols.push(&G);
+        poset.push(0, id, Interval(c->getSExtValue()));
+    }
+    size_t getNumSymbols() const { return symbols.backward.size(); }
+};
+
+// struct FunctionContext
+// The symbols and facts of one function, layered on a copy of a
+// `ModuleContext` so that module symbols keep their IDs, and facts added
+// here (e.g. from the function's assumptions) don't leak into other
+// functions. The `ModuleContext` is only read, so functions can be processed
+// independently of one another.
+struct FunctionContext {
+    const ModuleContext &module;
+    ValueToPosetMap symbols;
+    PartiallyOrderedSet poset;
+    // `SCEV`s are owned by the function's `ScalarEvolution`, so this memo
+    // can't be shared across functions
+    llvm::DenseMap<const llvm::SCEV *, size_t> scevSymbols;
+
+    FunctionContext(const ModuleContext &module)
+        : module(module), symbols(module.symbols), poset(module.poset) {}
+
+    // interns `v`, mapping loads of module constants to the module's symbol
+    size_t getSymbol(llvm::Value *v) {
+        if (llvm::LoadInst *load = llvm::dyn_cast<llvm::LoadInst>(v)) {
+            llvm::GlobalVariable *G = llvm::dyn_cast<llvm::GlobalVariable>(
+                load->getPointerOperand()->stripPointerCasts());
+            if (G && (!load->isVolatile()) &&
+                (load->getType() == G->getValueType()))
+                if (size_t id = symbols.getForward(G))
+                    if (id <= module.getNumSymbols())
+                        return id;
+        }
+        return symbols.push(v);
+    }
+    // interns the `SCEVUnknown` `S`; returns `0` for any other expression
+    size_t getSymbol(const llvm::SCEV *S) {
+        auto it = scevSymbols.find(S);
+        if (it != scevSymbols.end())
+            return it->second;
+        size_t id = 0;
+        if (const llvm::SCEVUnknown *U = llvm::dyn_cast<llvm::SCEVUnknown>(S))
+            id = getSymbol(U->getValue());
+        scevSymbols.insert(std::make_pair(S, id));
+        return id;
+    }
+};
@@ -0,0 +1,514 @@
+#pragma once
+
+#include "./Constraints.hpp"
+#include "./Math.hpp"
+#include "./Simplex.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
+#include <ostream>
+
+// Parametric integer programming, after Feautrier (1988).
+//
+// `PIP(A, E, context, numParams)` finds the lexicographic minimum of the
+// integer `x` with `A*[1, p, x] >= 0` and `E*[1, p, x] == 0` as a function of
+// the integer parameters `p` with `context*[1, p] >= 0`. The result is a list
+// of `Piece`s partitioning the context, each giving the minimum as an affine
+// function of `p` and of the floor divisions (`divs`) introduced by the Gomory
+// cuts, i.e. a quasi-affine function, or that there is no solution.
+//
+// The variables are shifted by a symbolic large constant `M`, `x' = x + M`,
+// so that requiring `x' >= 0` loses no solutions. Each row of the tableau is a
+// variable that must be non-negative, `x'` first and then the constraints,
+// as an affine function of the current non-basic variables. The dual simplex
+// pivots on a row whose constant is negative for the whole context, choosing
+// the column that keeps `x'` lexicographically minimal. When the parameters
+// do not settle the sign of a row's constant, the context is split. Once all
+// constants are non-negative, a row of `x'` that is not integral gives a
+// Gomory cut; if its constant depends on the parameters, a new div is added.
+//
+// Context emptiness is checked by solving a problem without parameters,
+// where signs are known, with the context's parameters and divs as variables.
+// These nested problems are charged to the same `maxSteps` budget, so that it
+// bounds the total work; once it is spent, signs are left unknown and the
+// search stops with `complete == false`.
+struct PIP {
+    struct Piece {
+        // `context * [1, p, divs] >= 0`
+        IntMatrix context;
+        // div `i` is `floor(divs(i, _(1, end)) * [1, p, divs] / divs(i, 0))`,
+        // where only the earlier divs appear
+        IntMatrix divs;
+        // `x == solution * [1, p, divs]` if `feasible && bounded`
+        IntMatrix solution;
+        bool feasible;
+        // `false` if the minimum is unbounded below
+        bool bounded;
+    };
+    // Row `i` is `(M*K(i,0) + K(i,_(1,end))*[1, p, divs] + T(i,_)*n) / den[i]`
+    // for the non-basic variables `n`.
+    struct Tableau {
+        IntMatrix K;
+        IntMatrix T;
+        llvm::SmallVector<int64_t> den;
+        IntMatrix context;
+        IntMatrix divs;
+    };
+    size_t numParams;
+    size_t numVars;
+    // pivots, cuts, and context emptiness checks, including those of nested
+    // problems, before giving up
+    size_t maxSteps;
+    size_t steps{0};
+    // `false` if we gave up, in which case `pieces` do not cover the context
+    bool complete{true};
+    llvm::SmallVector<Piece, 0> pieces;
+
+    PIP(PtrMatrix<int64_t> A, PtrMatrix<int64_t> E,
+        PtrMatrix<int64_t> context, size_t numParams, size_t maxSteps = 256)
+        : numParams(numParams), numVars(A.numCol() - 1 - numParams),
+          maxSteps(maxSteps) {
+        assert(E.numCol() == A.numCol());
+        assert(context.numCol() == 1 + numParams);
+        const size_t numIneq = A.numRow();
+        const size_t numCon = numIneq + 2 * E.numRow();
+        const size_t numRow = numVars + numCon;
+        Tableau t;
+        t.K = IntMatrix(numRow, 2 + numParams);
+        t.T = IntMatrix(numRow, numVars);
+        t.den.resize(numRow, 1);
+        for (size_t j = 0; j < numVars; ++j)
+            t.T(j, j) = 1;
+        for (size_t r = 0; r < numCon; ++r) {
+            const size_t i = numVars + r;
+            const bool isIneq = r < numIneq;
+            const size_t e = (r - numIneq) >> 1;
+            const int64_t s = (isIneq || !((r - numIneq) & 1)) ? 1 : -1;
+            auto a = [&](size_t k) { return s * (isIneq ? A(r, k) : E(e, k)); };
+            for (size_t k = 0; k <= numParams; ++k)
+                t.K(i, 1 + k) = a(k);
+            // `x == x' - M`
+            for (size_t j = 0; j < numVars; ++j) {
+                t.T(i, j) = a(1 + numParams + j);
+                t.K(i, 0) -= t.T(i, j);
+            }
+        }
+        t.context = context;
+        t.divs = IntMatrix(0, 2 + numParams);
+        if (!contextEmpty(context))
+            solve(std::move(t));
+    }
+
+    bool anyFeasible() const {
+        for (auto &p : pieces)
+            if (p.feasible)
+                return true;
+        return false;
+    }
+    // Whether there is no integer solution for any parameters in the
+    // context; `false` may be conservative if the search was cut short.
+    bool isEmpty() const { return complete && !anyFeasible(); }
+
+    // Whether `C*[1, y] >= 0` has no integer solution. `false` may be
+    // conservative.
+    static bool integerEmpty(PtrMatrix<int64_t> C, size_t maxSteps = 256) {
+        if (simplexEmpty(C))
+            return true;
+        if (C.numCol() == 1)
+            return false;
+        PIP pip(C, IntMatrix(0, C.numCol()), IntMatrix(0, 1), 0, maxSteps);
+        return pip.isEmpty();
+    }
+    // Whether `q*[1, p, x] >= 0` for all integer solutions of `A` and `E`
+    // with the parameters in `context`. Unlike the rational comparators, this
+    // is exact unless the search is cut short.
+    static bool knownGreaterEqual(PtrMatrix<int64_t> A, PtrMatrix<int64_t> E,
+                                  PtrMatrix<int64_t> context, size_t numParams,
+                                  PtrVector<int64_t> q) {
+        IntMatrix B = A;
+        const size_t r = B.numRow();
+        B.resize(r + 1, B.numCol());
+        for (size_t k = 0; k < B.numCol(); ++k)
+            B(r, k) = -q[k];
+        --B(r, 0);
+        return PIP(B, E, context, numParams).isEmpty();
+    }
+
+    static int64_t floorDiv(int64_t x, int64_t y) {
+        int64_t q = x / y;
+        return q - ((x % y) && ((x < 0) != (y < 0)));
+    }
+    static int64_t mod(int64_t x, int64_t d) { return x - d * floorDiv(x, d); }
+    // The piece containing `params`, if any; `w` is set to `[1, p, divs]`.
+    const Piece *find(llvm::ArrayRef<int64_t> params,
+                      llvm::SmallVectorImpl<int64_t> &w) const {
+        assert(params.size() == numParams);
+        for (auto &p : pieces) {
+            w.clear();
+            w.push_back(1);
+            w.append(params.begin(), params.end());
+            for (size_t i = 0; i < p.divs.numRow(); ++i) {
+                int64_t s = 0;
+                for (size_t k = 0; k < w.size(); ++k)
+                    s += p.divs(i, 1 + k) * w[k];
+                w.push_back(floorDiv(s, p.divs(i, 0)));
+            }
+            bool in = true;
+            for (size_t r = 0; in && (r < p.context.numRow()); ++r) {
+                int64_t s = 0;
+                for (size_t k = 0; k < w.size(); ++k)
+                    s += p.context(r, k) * w[k];
+                in = s >= 0;
+            }
+            if (in)
+                return &p;
+        }
+        return nullptr;
+    }
+    // The lexicographic minimum for `params`, or `None` if there is none or
+    // it is unbounded.
+    llvm::Optional<llvm::SmallVector<int64_t>>
+    lexMin(llvm::ArrayRef<int64_t> params) const {
+        llvm::SmallVector<int64_t> w;
+        const Piece *p = find(params, w);
+        if (!p || !p->feasible || !p->bounded)
+            return {};
+        llvm::SmallVector<int64_t> x(numVars, 0);
+        for (size_t j = 0; j < numVars; ++j)
+            for (size_t k = 0; k < w.size(); ++k)
+                x[j] += p->solution(j, k) * w[k];
+        return x;
+    }
+
+  private:
+    // Whether `C*[1, y] >= 0` has no rational solution, by the simplex method
+    // with `y == y^+ - y^-`; Fourier-Motzkin blows up on the contexts that
+    // the cuts build.
+    static bool simplexEmpty(PtrMatrix<int64_t> C) {
+        const size_t n = C.numCol() - 1;
+        if (n == 0) {
+            for (size_t i = 0; i < C.numRow(); ++i)
+                if (C(i, 0) < 0)
+                    return true;
+            return false;
+        }
+        if (C.numRow() == 0)
+            return false;
+        IntMatrix B(C.numRow(), 1 + 2 * n);
+        for (size_t i = 0; i < C.numRow(); ++i) {
+            B(i, 0) = C(i, 0);
+            for (size_t k = 0; k < n; ++k) {
+                B(i, 1 + k) = -C(i, 1 + k);
+                B(i, 1 + n + k) = C(i, 1 + k);
+            }
+        }
+        return !Simplex::positiveVariables(B, IntMatrix(0, 1 + 2 * n))
+                    .hasValue();
+    }
+    // `integerEmpty`, charged to `steps`; `false` once the budget is spent.
+    bool contextEmpty(PtrMatrix<int64_t> C) {
+        if (++steps > maxSteps) {
+            complete = false;
+            return false;
+        }
+        if (simplexEmpty(C))
+            return true;
+        if (C.numCol() == 1)
+            return false;
+        PIP pip(C, IntMatrix(0, C.numCol()), IntMatrix(0, 1), 0,
+                maxSteps - steps);
+        steps += pip.steps;
+        complete &= pip.complete;
+        return pip.isEmpty();
+    }
+    // `1` if row `i` is `>= 0` everywhere in the context, `-1` if it is `< 0`
+    // everywhere, and `0` otherwise.
+    int sign(const Tableau &t, size_t i) {
+        if (int64_t m = t.K(i, 0))
+            return m > 0 ? 1 : -1;
+        const size_t n = t.context.numCol();
+        bool isConst = true;
+        for (size_t k = 1; k < n; ++k)
+            isConst &= (t.K(i, 1 + k) == 0);
+        if (isConst)
+            return t.K(i, 1) >= 0 ? 1 : -1;
+        IntMatrix B = t.context;
+        const size_t r = B.numRow();
+        B.resize(r + 1, n);
+        // `c <= -1`
+        for (size_t k = 0; k < n; ++k)
+            B(r, k) = -t.K(i, 1 + k);
+        --B(r, 0);
+        if (contextEmpty(B))
+            return 1;
+        // `c >= 0`
+        for (size_t k = 0; k < n; ++k)
+            B(r, k) = t.K(i, 1 + k);
+        if (contextEmpty(B))
+            return -1;
+        return 0;
+    }
+    static void addContext(Tableau &t, size_t i, bool nonNegative) {
+        const size_t n = t.context.numCol();
+        const size_t r = t.context.numRow();
+        t.context.resize(r + 1, n);
+        for (size_t k = 0; k < n; ++k)
+            t.context(r, k) = nonNegative ? t.K(i, 1 + k) : -t.K(i, 1 + k);
+        if (!nonNegative)
+            --t.context(r, 0);
+    }
+    // Column to pivot row `r` on: the one with a positive coefficient whose
+    // column, divided by it, is lexicographically smallest over the rows of
+    // `x'`, or `numVars` if there is none.
+    size_t pivotColumn(const Tableau &t, size_t r) const {
+        size_t best = numVars;
+        for (size_t k = 0; k < numVars; ++k) {
+            if (t.T(r, k) <= 0)
+                continue;
+            if (best == numVars) {
+                best = k;
+                continue;
+            }
+            for (size_t i = 0; i < numVars; ++i) {
+                int64_t a = t.T(i, k) * t.T(r, best);
+                int64_t b = t.T(i, best) * t.T(r, k);
+                if (a != b) {
+                    if (a < b)
+                        best = k;
+                    break;
+                }
+            }
+        }
+        return best;
+    }
+    // Swaps row `r` into the non-basic variable of column `p`.
+    static void pivot(Tableau &t, size_t r, size_t p) {
+        const size_t numRow = t.T.numRow();
+        const size_t numCol = t.T.numCol();
+        const size_t numConst = t.K.numCol();
+        llvm::SmallVector<int64_t> Tr, Kr;
+        for (size_t k = 0; k < numCol; ++k)
+            Tr.push_back(t.T(r, k));
+        for (size_t k = 0; k < numConst; ++k)
+            Kr.push_back(t.K(r, k));
+        const int64_t a = Tr[p];
+        const int64_t dr = t.den[r];
+        assert(a > 0);
+        for (size_t i = 0; i < numRow; ++i) {
+            const int64_t b = t.T(i, p);
+            if (i == r) {
+                t.T(i, _) = 0;
+                t.K(i, _) = 0;
+                t.T(i, p) = 1;
+                t.den[i] = 1;
+                continue;
+            }
+            if (b == 0)
+                continue;
+            for (size_t k = 0; k < numCol; ++k)
+                t.T(i, k) = (k == p) ? b * dr : a * t.T(i, k) - b * Tr[k];
+            for (size_t k = 0; k < numConst; ++k)
+                t.K(i, k) = a * t.K(i, k) - b * Kr[k];
+            t.den[i] *= a;
+            int64_t g = t.den[i];
+            for (size_t k = 0; (g != 1) && (k < numCol); ++k)
+                g = gcd(g, t.T(i, k));
+            for (size_t k = 0; (g != 1) && (k < numConst); ++k)
+                g = gcd(g, t.K(i, k));
+            if (g == 1)
+                continue;
+            for (size_t k = 0; k < numCol; ++k)
+                t.T(i, k) /= g;
+            for (size_t k = 0; k < numConst; ++k)
+                t.K(i, k) /= g;
+            t.den[i] /= g;
+        }
+    }
+    // `mod(-K(i,_(1,end)), den[i])`; returns whether only its constant may be
+    // nonzero.
+    static bool fraction(const Tableau &t, size_t i,
+                         llvm::SmallVectorImpl<int64_t> &c) {
+        const int64_t d = t.den[i];
+        bool isConst = true;
+        c.clear();
+        for (size_t k = 1; k < t.K.numCol(); ++k) {
+            c.push_back(mod(-t.K(i, k), d));
+            isConst &= (k == 1) || (c.back() == 0);
+        }
+        return isConst;
+    }
+    // Index of the div `floor(c * [1, p, divs] / d)`, or the number of divs.
+    static size_t findDiv(const Tableau &t, llvm::ArrayRef<int64_t> c,
+                          int64_t d) {
+        const size_t numDivs = t.divs.numRow();
+        for (size_t q = 0; q < numDivs; ++q) {
+            bool match = t.divs(q, 0) == d;
+            for (size_t k = 0; match && (k < c.size()); ++k)
+                match = t.divs(q, 1 + k) == c[k];
+            if (match)
+                return q;
+        }
+        return numDivs;
+    }
+    // column of div `q` in `K`
+    static size_t divColumn(const Tableau &t, size_t q) {
+        return t.K.numCol() - t.divs.numRow() + q;
+    }
+    // First row of `x'` whose constant may not be an integer; `M` is taken to
+    // be a multiple of every denominator. If `c = mod(-K(i,_(1,end)), d)` has
+    // a div `q = floor(c*w/d)`, and `c*w == d*q` on the context, the constant
+    // is replaced with the equal `(K(i,_(1,end)) + c)*w - d*q`.
+    size_t nonIntegralRow(Tableau &t) {
+        llvm::SmallVector<int64_t> c;
+        for (size_t i = 0; i < numVars; ++i) {
+            const int64_t d = t.den[i];
+            if (d == 1)
+                continue;
+            if (fraction(t, i, c)) {
+                if (c[0])
+                    return i;
+                continue;
+            }
+            const size_t q = findDiv(t, c, d);
+            if (q == t.divs.numRow())
+                return i;
+            // `c*w - d*q >= 1`
+            IntMatrix B = t.context;
+            const size_t r = B.numRow(), n = B.numCol();
+            B.resize(r + 1, n);
+            for (size_t k = 0; k < n; ++k)
+                B(r, k) = c[k];
+            B(r, divColumn(t, q) - 1) -= d;
+            --B(r, 0);
+            if (!contextEmpty(B))
+                return i;
+            for (size_t k = 0; k < n; ++k)
+                t.K(i, 1 + k) += c[k];
+            t.K(i, divColumn(t, q)) -= d;
+        }
+        return numVars;
+    }
+    // Index of the div `floor(c * [1, p, divs] / d)`, added if needed.
+    static size_t getDiv(Tableau &t, llvm::ArrayRef<int64_t> c, int64_t d) {
+        const size_t numDivs = t.divs.numRow();
+        if (size_t q = findDiv(t, c, d); q != numDivs)
+            return q;
+        t.K.resizeCols(t.K.numCol() + 1);
+        t.divs.resize(numDivs + 1, t.divs.numCol() + 1);
+        t.divs(numDivs, 0) = d;
+        for (size_t k = 0; k < c.size(); ++k)
+            t.divs(numDivs, 1 + k) = c[k];
+        // `0 <= c * w - d * q <= d - 1`
+        const size_t n = t.context.numCol();
+        const size_t r = t.context.numRow();
+        t.context.resize(r + 2, n + 1);
+        for (size_t k = 0; k < n; ++k) {
+            t.context(r, k) = c[k];
+            t.context(r + 1, k) = -c[k];
+        }
+        t.context(r, n) = -d;
+        t.context(r + 1, n) = d;
+        t.context(r + 1, 0) += d - 1;
+        return numDivs;
+    }
+    // Adds the Gomory cut of row `i` of `x'`: as the row is an integer,
+    // `sum(mod(T(i,k), d) * n_k) + K(i,_(1,end)) * [1, p, divs]` is a multiple
+    // of `d`, so `sum(mod(T(i,k), d) * n_k) >= mod(-K(i,_(1,end)) * w, d)`.
+    // The cut's slack is again an integer.
+    static void addCut(Tableau &t, size_t i) {
+        const int64_t d = t.den[i];
+        llvm::SmallVector<int64_t> c;
+        const bool isConst = fraction(t, i, c);
+        const size_t n = c.size();
+        const size_t q = isConst ? 0 : getDiv(t, c, d);
+        const size_t r = t.T.numRow();
+        t.T.resize(r + 1, t.T.numCol());
+        t.K.resize(r + 1, t.K.numCol());
+        t.den.push_back(d);
+        for (size_t k = 0; k < t.T.numCol(); ++k)
+            t.T(r, k) = mod(t.T(i, k), d);
+        for (size_t k = 0; k < n; ++k)
+            t.K(r, 1 + k) = -c[k];
+        // `mod(-K(i,_(1,end)) * w, d) == c * w - d * q`
+        if (!isConst)
+            t.K(r, divColumn(t, q)) += d;
+    }
+    void addPiece(const Tableau &t, bool feasible) {
+        Piece &p = pieces.emplace_back();
+        p.context = t.context;
+        p.divs = t.divs;
+        p.feasible = feasible;
+        p.bounded = true;
+        if (!feasible)
+            return;
+        const size_t n = t.K.numCol() - 1;
+        p.solution = IntMatrix(numVars, n);
+        for (size_t j = 0; j < numVars; ++j) {
+            const int64_t d = t.den[j];
+            p.bounded &= (t.K(j, 0) == d);
+            for (size_t k = 0; k < n; ++k)
+                p.solution(j, k) = t.K(j, 1 + k) / d;
+        }
+    }
+    void solve(Tableau t) {
+        while (true) {
+            if (++steps > maxSteps) {
+                complete = false;
+                return;
+            }
+            const size_t numRow = t.T.numRow();
+            size_t neg = numRow, unknown = numRow;
+            for (size_t i = 0; i < numRow; ++i) {
+                int s = sign(t, i);
+                if (!complete)
+                    return;
+                if (s < 0) {
+                    neg = i;
+                    break;
+                }
+                if ((s == 0) && (unknown == numRow))
+                    unknown = i;
+            }
+            if (neg != numRow) {
+                size_t p = pivotColumn(t, neg);
+                if (p == numVars) {
+                    addPiece(t, false);
+                    return;
+                }
+                pivot(t, neg, p);
+                continue;
+            }
+            if (unknown != numRow) {
+                Tableau u = t;
+                addContext(u, unknown, false);
+                solve(std::move(u));
+                if (!complete)
+                    return;
+                addContext(t, unknown, true);
+                continue;
+            }
+            size_t i = nonIntegralRow(t);
+            if (i == numVars) {
+                addPiece(t, true);
+                return;
+            }
+            addCut(t, i);
+        }
+    }
+
+  public:
+    friend std::ostream &operator<<(std::ostream &os, const PIP &pip) {
+        for (auto &p : pip.pieces) {
+            os << "context: " << p.context << "\ndivs: " << p.divs << "\n";
+            if (!p.feasible)
+                os << "no solution\n";
+            else if (!p.bounded)
+                os << "unbounded\n";
+            else
+                os << "x = " << p.solution << "\n";
+        }
+        return os;
+    }
+};
@@ -64,7 +64,13 @@ struct Polyhedra {
     I64Matrix E;
     CmptrType C;
 
-    void pruneBounds() {
+    // `Pairwise` compares every pair of constraints through the comparator,
+    // so it uses the comparator's facts; `Sweep` solves one LP per
+    // constraint instead, see `pruneBoundsSweep`.
+    enum class Prune { Pairwise, Sweep };
+    void pruneBounds(Prune mode = Prune::Pairwise) {
+        if (mode == Prune::Sweep)
+            return pruneBoundsSweep();
         Vector<int64_t> diff{A.numCol()};
         if constexpr (hasEqualities)
 	    removeRedundantRows(A, E);
@@ -74,22 +80,11 @@ struct Polyhedra {
                 if (A.numRow() <= 1)
                     return;
                 diff = A(--i, _) - A(j, _);
-                std::cout << "--------------Start new " << i << "--------------"
-                          << std::endl;
-                std::cout << "Now i, j are " << i << " " << j << std::endl;
-                std::cout << "print diff first: " << diff << std::endl;
-
                 if (C.greaterEqual(diff)) {
-                    std::cout << "i: " << i << "; j: " << j
-                              << " greater Equal returns true" << A
-                              << std::endl;
                     eraseConstraint(A, i);
                     C.init(A, E);
                     --j; // `i < j`, and `i` has been removed
                 } else if (C.greaterEqual(diff *= -1)) {
-                    std::cout << "i: " << i << "; j : " << j
-                              << " greater Equal returns false" << A
-                              << std::endl;
                     eraseConstraint(A, j);
                     C.init(A, E);
                     break; // `j` is gone
@@ -98,6 +93,90 @@ struct Polyhedra {
         }
     }
 
+    // Removes redundant inequalities with a single sweep of one LP per
+    // constraint, instead of comparing all pairs of constraints.
+    // Row `r` is redundant iff it is a non-negative combination of the other
+    // inequalities, the equalities, and `1 >= 0`, i.e. iff
+    // A(r,_)' == l_0 e_0 + A_{-r}' l + E' (m+ - m-), l_0, l, m+, m- >= 0
+    // is feasible. These LPs share the model `[e_0 A' E' -E']`, and the
+    // right hand side of row `r`'s is the model's own column of `r`, which
+    // the tableau keeps up to date through every pivot. So one tableau
+    // serves the whole sweep: each LP copies its column into the constants,
+    // excludes it from entering, and starts from the basis the previous one
+    // ended in, only pivoting if that basis is infeasible for it. Dropping a
+    // redundant row keeps its column excluded, and the comparator is
+    // reinitialized once at the end.
+    void pruneBoundsSweep() {
+        if constexpr (hasEqualities)
+            removeRedundantRows(A, E);
+        const size_t numCol = A.numCol();
+        const size_t numIneq = A.numRow();
+        const size_t numEq = E.numRow();
+        if (numIneq <= 1)
+            return;
+        Simplex simplex;
+        simplex.resize(numCol, 2 + numIneq + 2 * numEq);
+        {
+            // [0 e_0 A' E' -E']
+            MutPtrMatrix<int64_t> B{simplex.getConstraints()};
+            B(0, 1) = 1;
+            B(_, _(2, 2 + numIneq)) = A.transpose();
+            if constexpr (hasEqualities) {
+                B(_, _(2 + numIneq, 2 + numIneq + numEq)) = E.transpose();
+                MutPtrMatrix<int64_t> negE{B(_, _(2 + numIneq + numEq, end))};
+                negE = E.transpose();
+                negE *= -1;
+            }
+        }
+        // linearly dependent rows are implied by the others, as every
+        // right hand side is a column of the model
+        simplex.hermiteNormalForm();
+        for (auto &&x : simplex.getBasicConstraints())
+            x = -1;
+        for (auto &&x : simplex.getBasicVariables())
+            x = -1;
+        // any basis will do to start
+        for (size_t r = 0; r < simplex.getNumConstraints(); ++r) {
+            PtrVector<int64_t> row{
+                static_cast<const Simplex &>(simplex).getConstraints()(r, _)};
+            size_t v = 1;
+            while (row[v] == 0)
+                ++v;
+            simplex.pivotPositive(r, v);
+        }
+        llvm::SmallVector<bool> excluded(simplex.getNumVar(), false);
+        llvm::SmallVector<unsigned> redundant;
+        for (size_t r = numIneq; r;) {
+            const size_t v = 2 + --r;
+            MutPtrMatrix<int64_t> B{simplex.getConstraints()};
+            excluded[v] = true;
+            // a basic `v` must leave before its column becomes the constants
+            if (int64_t i = simplex.getBasicConstraints()[v]; i >= 0) {
+                size_t j = 1;
+                while ((j < B.numCol()) && (excluded[j] || (B(i, j) == 0)))
+                    ++j;
+                if (j == B.numCol()) {
+                    // `v` is the only way to satisfy row `i`
+                    excluded[v] = false;
+                    continue;
+                }
+                simplex.pivotPositive(i, j);
+            }
+            for (size_t k = 0; k < B.numRow(); ++k)
+                B(k, 0) = B(k, v);
+            if (simplex.dualFeasible(excluded))
+                excluded[v] = false;
+            else
+                redundant.push_back(r); // keep it out of the model
+        }
+        if (redundant.empty())
+            return;
+        // `redundant` is sorted in descending order
+        for (auto r : redundant)
+            eraseConstraint(A, r);
+        C.init(A, E);
+    }
+
     size_t getNumVar() const { return A.numCol() - 1; }
     size_t getNumInequalityConstraints() const { return A.numRow(); }
     size_t getNumEqualityConstraints() const { return E.numRow(); }
@@ -226,6 +305,23 @@ struct Polyhedra {
         pruneBounds();
     }
 
+    // Removes all of `vars` at once, letting `fourierMotzkin` discard
+    // redundant combinations as it goes, and prunes only at the end.
+    void removeVariablesAndPrune(llvm::ArrayRef<size_t> vars) {
+        if constexpr (hasEqualities) {
+            llvm::SmallVector<size_t> fmVars;
+            for (auto v : vars)
+                if (substituteEquality(A, E, v))
+                    fmVars.push_back(v);
+            fourierMotzkin(A, fmVars);
+            if (E.numRow() > 1)
+                NormalForm::simplifySystem(E);
+        } else {
+            fourierMotzkin(A, vars);
+        }
+        pruneBounds();
+    }
+
     void dropEmptyConstraints(IntMatrix &A) const {
         for (size_t c = A.numRow(); c != 0;)
             if (allZero(A(--c, _)))
@@ -33,6 +33,8 @@ struct Schedule {
     const uint8_t numLoops;
     // -1 indicates not vectorized
     int8_t vectorized = -1;
+    // number of lanes `vectorized` is vectorized by
+    uint16_t vectorWidth = 1;
     // -1 indicates not unrolled
     // inner unroll means either the only unrolled loop, or if outer unrolled,
     // then the inner unroll is nested inside of the outer unroll.
@@ -42,6 +44,9 @@ struct Schedule {
     int8_t unrolledInner = -1;
     // -1 indicates not unrolled
     int8_t unrolledOuter = -1;
+    // unroll factors of `unrolledInner` and `unrolledOuter`
+    uint16_t unrollFactorInner = 1;
+    uint16_t unrollFactorOuter = 1;
     Schedule(size_t nLoops)
         : data(llvm::SmallVector<int64_t, maxStackStorage>(
               nLoops * (nLoops + 2) + 1)),
@@ -77,6 +82,34 @@ struct Schedule {
         return fusedThrough(y, std::min(numLoops, y.numLoops));
     }
     size_t getNumLoops() const { return numLoops; }
+    // Schedule for the nest returned by `AffineLoopNest::tile(tileSizes)`.
+    // The tile loops are scheduled first, in order, each fused like the
+    // outermost loop; the point loops keep this schedule.
+    Schedule tile(llvm::ArrayRef<int64_t> tileSizes) const {
+        size_t numTiled = 0;
+        for (auto t : tileSizes)
+            numTiled += (t > 0);
+        Schedule ret(numLoops + numTiled);
+        MutSquarePtrMatrix<int64_t> Phi(ret.getPhi());
+        Phi(_(numTiled, end), _(numTiled, end)) = getPhi();
+        MutPtrVector<int64_t> omega(ret.getOmega());
+        PtrVector<int64_t> oldOmega(getOmega());
+        for (size_t i = 0; i < numTiled; ++i) {
+            omega[2 * i] = oldOmega[0];
+            omega[2 * i + 1] = 0;
+        }
+        omega(_(2 * numTiled, end)) = oldOmega;
+        auto shift = [=](int8_t l) -> int8_t {
+            return l < 0 ? l : int8_t(l + numTiled);
+        };
+        ret.vectorized = shift(vectorized);
+        ret.vectorWidth = vectorWidth;
+        ret.unrolledInner = shift(unrolledInner);
+        ret.unrolledOuter = shift(unrolledOuter);
+        ret.unrollFactorInner = unrollFactorInner;
+        ret.unrollFactorOuter = unrollFactorOuter;
+        return ret;
+    }
 };
 
 // TODO:
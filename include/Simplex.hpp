@@ -26,7 +26,7 @@ struct Simplex {
     // column 1: constraint values
     Matrix<int64_t, 0, 0, 0> tableau;
     size_t numSlackVar;
-    bool inCanonicalForm;
+    bool inCanonicalForm{false};
     static constexpr size_t numExtraRows = 2;
     static constexpr size_t numExtraCols = 1;
     static constexpr size_t numTableauRows(size_t i) {
@@ -127,6 +127,17 @@ struct Simplex {
         tableau(0, 0) = 0;
         // remove trivially redundant constraints
         hermiteNormalForm();
+        if (initiateFeasibleCore())
+            return true;
+        inCanonicalForm = true;
+        return false;
+    }
+    // `initiateFeasible` without the HNF; the feasibility answer is still
+    // correct if some constraints are linearly dependent, but the tableau
+    // is not left in canonical form, so only use it for one-shot queries.
+    bool initiateFeasibleCore() {
+        tableau(0, 0) = 0;
+        inCanonicalForm = false;
         // [ I;  X ; b ]
         //
         // original number of variables
@@ -234,7 +245,6 @@ struct Simplex {
 #ifdef VERBOSESIMPLEX
         std::cout << "final tableau =" << tableau << std::endl;
 #endif
-        inCanonicalForm = true;
         return 0;
     }
     static int getEnteringVariable(PtrVector<int64_t> costs) {
@@ -394,8 +404,6 @@ struct Simplex {
             makeBasic(C, 0, i);
         size_t ind = basicConstraints[i];
         size_t lastRow = C.numRow() - 1;
-        SHOWLN(ind);
-        SHOWLN(C.numRow());
         if (lastRow != ind)
             swapRows(C, ind, lastRow);
         truncateConstraints(lastRow);
@@ -423,78 +431,238 @@ struct Simplex {
         return m;
     }
     // check if a solution exists such that `x` can be true.
-    bool unSatisfiable(PtrVector<int64_t> x, size_t off) const {
+    // The sub-problem is written into `sub`, reusing its memory, so repeated
+    // queries with the same `sub` do not allocate. Only feasibility is needed,
+    // so the HNF of the sub-problem is skipped.
+    bool unSatisfiable(Simplex &sub, PtrVector<int64_t> x, size_t off) const {
         // is it a valid solution to set the first `x.size()` variables to `x`?
         // first, check that >= 0 constraint is satisfied
-        for (auto y : x)
-            if (y < 0)
-                return true;
+        if (!allGEZero(x))
+            return true;
         // approach will be to move `x.size()` variables into the
         // equality constraints, and then check if the remaining sub-problem is
         // satisfiable.
-        Simplex subSimp;
         const size_t numCon = getNumConstraints();
         const size_t numVar = getNumVar();
         const size_t numFix = x.size();
-        subSimp.resizeForOverwrite(numCon, numVar - numFix);
-        subSimp.tableau(0, 0) = 0;
-        subSimp.tableau(0, 1) = 0;
+        sub.resizeForOverwrite(numCon, numVar - numFix);
+        sub.tableau(0, 0) = 0;
+        sub.tableau(0, 1) = 0;
         auto fC{getCostsAndConstraints()};
-        auto sC{subSimp.getCostsAndConstraints()};
+        auto sC{sub.getCostsAndConstraints()};
         sC(_, 0) = fC(_, 0) - fC(_, _(1 + off, 1 + off + numFix)) * x;
-        // sC(_, 0) = fC(_, 0);
-        // for (size_t i = 0; i < numFix; ++i)
-        //     sC(_, 0) -= x(i) * fC(_, i + 1 + off);
         sC(_, _(1, 1 + off)) = fC(_, _(1, 1 + off));
         sC(_, _(1 + off, end)) = fC(_, _(1 + off + numFix, end));
-        SHOWLN(off);
-        SHOWLN(fC);
-        SHOWLN(sC);
-        SHOWLN(x);
-        SHOWLN(subSimp);
-        return subSimp.initiateFeasible();
+        return sub.initiateFeasibleCore();
+    }
+    bool unSatisfiable(PtrVector<int64_t> x, size_t off) const {
+        Simplex sub;
+        return unSatisfiable(sub, x, off);
+    }
+    bool satisfiable(Simplex &sub, PtrVector<int64_t> x, size_t off) const {
+        return !unSatisfiable(sub, x, off);
     }
     bool satisfiable(PtrVector<int64_t> x, size_t off) const {
         return !unSatisfiable(x, off);
     } // check if a solution exists such that `x` can be true.
-    bool unSatisfiableZeroRem(PtrVector<int64_t> x, size_t off,
+    bool unSatisfiableZeroRem(Simplex &sub, PtrVector<int64_t> x, size_t off,
                               size_t numRow) const {
         // is it a valid solution to set the first `x.size()` variables to `x`?
         // first, check that >= 0 constraint is satisfied
-        for (auto y : x)
-            if (y < 0)
-                return true;
+        if (!allGEZero(x))
+            return true;
         // approach will be to move `x.size()` variables into the
         // equality constraints, and then check if the remaining sub-problem is
         // satisfiable.
-        Simplex subSimp;
         assert(numRow <= getNumConstraints());
         const size_t numFix = x.size();
-        subSimp.resizeForOverwrite(numRow, 1 + off);
-        subSimp.tableau(0, 0) = 0;
-        subSimp.tableau(0, 1) = 0;
-        // auto fC{getCostsAndConstraints()};
-        // auto sC{subSimp.getCostsAndConstraints()};
+        sub.resizeForOverwrite(numRow, 1 + off);
+        sub.tableau(0, 0) = 0;
+        sub.tableau(0, 1) = 0;
         auto fC{getConstraints()};
-        auto sC{subSimp.getConstraints()};
+        auto sC{sub.getConstraints()};
         sC(_, 0) = fC(_(begin, numRow), 0) -
                    fC(_(begin, numRow), _(1 + off, 1 + off + numFix)) * x;
-        // sC(_, 0) = fC(_, 0);
-        // for (size_t i = 0; i < numFix; ++i)
-        //     sC(_, 0) -= x(i) * fC(_, i + 1 + off);
         sC(_, _(1, 1 + off)) = fC(_(begin, numRow), _(1, 1 + off));
-        assert(sC(_, _(1, 1 + off)) == fC(_(begin, numRow), _(1, 1 + off)));
-        SHOWLN(off);
-        SHOWLN(fC);
-        SHOWLN(sC);
-        SHOWLN(x);
-        SHOWLN(subSimp);
-        return subSimp.initiateFeasible();
+        return sub.initiateFeasibleCore();
+    }
+    bool unSatisfiableZeroRem(PtrVector<int64_t> x, size_t off,
+                              size_t numRow) const {
+        Simplex sub;
+        return unSatisfiableZeroRem(sub, x, off, numRow);
+    }
+    bool satisfiableZeroRem(Simplex &sub, PtrVector<int64_t> x, size_t off,
+                            size_t numRow) const {
+        return !unSatisfiableZeroRem(sub, x, off, numRow);
     }
     bool satisfiableZeroRem(PtrVector<int64_t> x, size_t off,
                             size_t numRow) const {
         return !unSatisfiableZeroRem(x, off, numRow);
     }
+    // Batched versions of `unSatisfiable` and `unSatisfiableZeroRem`;
+    // `X` holds one candidate per row, and `ret[i]` is the answer for
+    // `X(i,_)`.
+    llvm::SmallVector<bool> unSatisfiable(PtrMatrix<int64_t> X,
+                                          size_t off) const {
+        const size_t numFix = X.numCol();
+        return unSatisfiableBatch(getConstraints(), X, off,
+                                  getNumVar() - 1 - off - numFix);
+    }
+    llvm::SmallVector<bool> satisfiable(PtrMatrix<int64_t> X,
+                                        size_t off) const {
+        llvm::SmallVector<bool> ret{unSatisfiable(X, off)};
+        for (auto &&r : ret)
+            r = !r;
+        return ret;
+    }
+    llvm::SmallVector<bool> unSatisfiableZeroRem(PtrMatrix<int64_t> X,
+                                                 size_t off,
+                                                 size_t numRow) const {
+        assert(numRow <= getNumConstraints());
+        return unSatisfiableBatch(getConstraints()(_(begin, numRow), _), X, off,
+                                  0);
+    }
+    llvm::SmallVector<bool> satisfiableZeroRem(PtrMatrix<int64_t> X,
+                                               size_t off,
+                                               size_t numRow) const {
+        llvm::SmallVector<bool> ret{unSatisfiableZeroRem(X, off, numRow)};
+        for (auto &&r : ret)
+            r = !r;
+        return ret;
+    }
+    // pivots variable `v` into the basis in constraint `r`, regardless of
+    // feasibility
+    void pivot(size_t r, size_t v) {
+        MutPtrMatrix<int64_t> C{getConstraints()};
+        for (size_t i = 0; i < C.numRow(); ++i)
+            if (i != r)
+                NormalForm::zeroWithRowOperation(C, i, r, v, 0);
+        MutStridedVector<int64_t> basicVars{getBasicVariables()};
+        MutPtrVector<int64_t> basicConstraints{getBasicConstraints()};
+        int64_t oldBasicVar = basicVars[r];
+        if ((oldBasicVar >= 0) && (size_t(oldBasicVar) < getNumVar()))
+            basicConstraints[oldBasicVar] = -1;
+        basicVars[r] = v;
+        basicConstraints[v] = r;
+    }
+    // `pivot`, then negates the rows whose basic variable has a negative
+    // coefficient, so that the basic solution is feasible iff all constants
+    // are non-negative
+    void pivotPositive(size_t r, size_t v) {
+        pivot(r, v);
+        MutPtrMatrix<int64_t> C{getConstraints()};
+        StridedVector<int64_t> basicVars{
+            static_cast<const Simplex *>(this)->getBasicVariables()};
+        for (size_t i = 0; i < C.numRow(); ++i)
+            if ((basicVars[i] >= 0) && (C(i, basicVars[i]) < 0))
+                C(i, _) *= -1;
+    }
+    // Restores the feasibility of a basis kept by `pivotPositive`, whose
+    // constants may be negative, with dual simplex pivots that never enter a
+    // variable `v` with `excluded[v]`. There are no costs, so every basis is
+    // dual feasible, and Bland's rule ensures termination.
+    // returns `true` if infeasible
+    bool dualFeasible(llvm::ArrayRef<bool> excluded) {
+        const Simplex &cthis = *this;
+        while (true) {
+            PtrMatrix<int64_t> C{cthis.getConstraints()};
+            StridedVector<int64_t> basicVars{cthis.getBasicVariables()};
+            size_t r = C.numRow();
+            for (size_t i = 0; i < C.numRow(); ++i)
+                if ((C(i, 0) < 0) &&
+                    ((r == C.numRow()) || (basicVars[i] < basicVars[r])))
+                    r = i;
+            if (r == C.numRow())
+                return false;
+            size_t v = 1;
+            while ((v < C.numCol()) && (excluded[v] || (C(r, v) >= 0)))
+                ++v;
+            if (v == C.numCol())
+                return true;
+            pivotPositive(r, v);
+        }
+    }
+    // `C` holds the constraints `[b V0 F V1]`; each query fixes the `F`
+    // variables (starting at column `1 + off`) to a row of `X`, keeps `V0`
+    // and the first `numTrailing` variables of `V1`, and zeros the rest.
+    // One tableau is prepared for the whole batch, with the fixed variables
+    // moved to the end, and brought into canonical form once. The constants
+    // of a query's sub-problem are then linear in `x`; if the basic solution
+    // is non-negative for that `x`, the query is feasible without running
+    // another simplex. Remaining queries are solved starting from the
+    // prepared tableau.
+    static llvm::SmallVector<bool> unSatisfiableBatch(PtrMatrix<int64_t> C,
+                                                      PtrMatrix<int64_t> X,
+                                                      size_t off,
+                                                      size_t numTrailing) {
+        const size_t numQuery = X.numRow();
+        const size_t numFix = X.numCol();
+        const size_t numFree = off + numTrailing;
+        llvm::SmallVector<bool> ret(numQuery, true);
+        Simplex prep;
+        prep.resize(C.numRow(), 1 + numFree + numFix);
+        MutPtrMatrix<int64_t> P{prep.getConstraints()};
+        P(_, _(begin, 1 + off)) = C(_, _(begin, 1 + off));
+        P(_, _(1 + off, 1 + numFree)) =
+            C(_, _(1 + off + numFix, 1 + off + numFix + numTrailing));
+        P(_, _(1 + numFree, end)) = C(_, _(1 + off, 1 + off + numFix));
+        // fixing variables only restricts the problem
+        if (prep.initiateFeasible())
+            return ret;
+        const Simplex &cprep = prep;
+        // make sure no fixed variable is basic
+        bool parametric = true;
+        {
+            MutPtrMatrix<int64_t> PC{prep.getConstraints()};
+            StridedVector<int64_t> basicVars{cprep.getBasicVariables()};
+            for (size_t r = 0; r < PC.numRow(); ++r) {
+                int64_t v = basicVars[r];
+                if ((v > 0) && (size_t(v) <= numFree))
+                    continue;
+                PtrVector<int64_t> basicCons{cprep.getBasicConstraints()};
+                size_t j = 1;
+                for (; j <= numFree; ++j)
+                    if (PC(r, j) && (basicCons[j] < 0))
+                        break;
+                if (j > numFree) {
+                    parametric = false;
+                    break;
+                }
+                prep.pivot(r, j);
+            }
+        }
+        PtrMatrix<int64_t> PC{cprep.getConstraints()};
+        StridedVector<int64_t> basicVars{cprep.getBasicVariables()};
+        const size_t numCon = PC.numRow();
+        // constants for every query: b - F*x
+        IntMatrix B{X * PC(_, _(1 + numFree, end)).transpose()};
+        Simplex sub;
+        for (size_t q = 0; q < numQuery; ++q) {
+            if (!allGEZero(X(q, _)))
+                continue;
+            MutPtrVector<int64_t> b{B.getRow(q)};
+            for (size_t r = 0; r < numCon; ++r)
+                b[r] = PC(r, 0) - b[r];
+            if (parametric) {
+                bool feasible = true;
+                for (size_t r = 0; r < numCon; ++r)
+                    if (b[r] && ((b[r] > 0) != (PC(r, basicVars[r]) > 0)))
+                        feasible = false;
+                if (feasible) {
+                    ret[q] = false;
+                    continue;
+                }
+            }
+            sub.resizeForOverwrite(numCon, 1 + numFree);
+            sub.tableau(0, 0) = 0;
+            sub.getCost() = 0;
+            MutPtrMatrix<int64_t> SC{sub.getConstraints()};
+            SC(_, 0) = b;
+            SC(_, _(1, end)) = PC(_, _(1, 1 + numFree));
+            ret[q] = sub.initiateFeasibleCore();
+        }
+        return ret;
+    }
     void printResult() {
         auto C{getConstraints()};
         auto basicVars{getBasicVariables()};
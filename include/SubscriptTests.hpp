@@ -0,0 +1,414 @@
+#pragma once
+
+#include "./ArrayReference.hpp"
+#include "./Constraints.hpp"
+#include "./Loops.hpp"
+#include "./Math.hpp"
+#include "./POSet.hpp"
+#include "./Symbolics.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
+
+// Cheap dependence tests, run before building `DependencePolyhedra`.
+//
+// For references `x` and `y` with matching strides, `x(i) == y(j)` holds dim
+// by dim, where dim `k` requires
+// `h_k = sum_l a_l i_l - sum_l b_l j_l + c + s == 0`,
+// with `a` and `b` the columns of the index matrices, `c` the difference of
+// the constant offsets, and `s` that of the symbolic offsets.
+// The tiers, from cheapest:
+// - ZIV: `h_k` has no loop terms, so `c != 0` proves independence.
+// - GCD: `ArrayReference::gcdKnownIndependent`.
+// - SIV: `h_k` only has terms on loop `l`, with `a_l == b_l` (strong) or one
+//   of them `0` (weak zero); solved exactly over the bounds of `l`.
+// - Banerjee: `0` must be in the range of `h_k` over the bounds of the loops.
+//   Each loop is bounded with all others eliminated. When `x` and `y` share
+//   their symbols, unit bounds are kept in terms of the symbols, so that
+//   `i <= N - 1` and `-N` cancel. The symbols then take their range from the
+//   `PartiallyOrderedSet`.
+// - Interval: as Banerjee, for dims whose symbolic offsets do not cancel.
+// Conversely, if both share a rectangular nest, and each dim is either ZIV
+// with `c == 0` or strong SIV on its own loop, with a distance no larger than
+// the loop's extent, then they are dependent; the SIV tier reports this.
+// Anything else is left to the polyhedra.
+struct SubscriptTest {
+    enum class Tier { None, ZIV, GCD, SIV, Banerjee, Interval };
+    enum class Result { Unknown, Independent, Dependent };
+    struct Outcome {
+        Result result;
+        // tier that decided, `None` if `Unknown`
+        Tier tier;
+    };
+    // `h` of one dim
+    struct Subscript {
+        llvm::SmallVector<int64_t> a;
+        llvm::SmallVector<int64_t> b;
+        int64_t c;
+        // `s` as coefficients of `[1, symbols]` if they are shared, with
+        // `sym[0] == 0`; otherwise empty, and `s` is in `symRange`
+        llvm::SmallVector<int64_t> sym;
+        Interval symRange;
+        bool isSymbolic;
+        bool isZIV() const { return allZero(a) && allZero(b); }
+    };
+    // Bounds of one loop with the others eliminated. `lower` and `upper` are
+    // coefficients of `[1, symbols]`, empty if there is no unit bound.
+    struct LoopBound {
+        Interval range;
+        llvm::SmallVector<int64_t> lower;
+        llvm::SmallVector<int64_t> upper;
+    };
+    const ArrayReference &x;
+    const ArrayReference &y;
+    const PartiallyOrderedSet &poset;
+    const bool sameSymbols;
+    llvm::SmallVector<Subscript, 3> subscripts;
+    // bounds of the loops of `x` and `y`, computed on demand
+    llvm::SmallVector<llvm::Optional<LoopBound>> xBounds;
+    llvm::SmallVector<llvm::Optional<LoopBound>> yBounds;
+
+    static Interval symbolInterval(const Polynomial::Monomial &m,
+                                   const PartiallyOrderedSet &poset) {
+        // the poset only orders `VarType::Constant` symbols
+        for (auto &v : m.prodIDs)
+            if (v.getType() != VarType::Constant)
+                return Interval::unconstrained();
+        return poset.asInterval(m);
+    }
+    // poset variable of `m`, if it is one
+    static llvm::Optional<size_t>
+    posetVariable(const Polynomial::Monomial &m,
+                  const PartiallyOrderedSet &poset) {
+        if ((m.prodIDs.size() != 1) ||
+            (m.prodIDs[0].getType() != VarType::Constant) ||
+            (m.prodIDs[0].getID() >= poset.nVar))
+            return {};
+        return m.prodIDs[0].getID();
+    }
+    // `coefs[0] + sum_k coefs[k] * symbols[k-1]`
+    static Interval symbolicInterval(llvm::ArrayRef<Polynomial::Monomial> syms,
+                                     llvm::ArrayRef<int64_t> coefs,
+                                     const PartiallyOrderedSet &poset) {
+        llvm::SmallVector<int64_t> c{coefs.begin(), coefs.end()};
+        Interval itv{c[0]};
+        // terms of opposite sign are paired, as the poset bounds differences
+        for (size_t i = 1; i < c.size(); ++i) {
+            for (size_t j = 1; (c[i] > 0) && (j < c.size()); ++j) {
+                if (c[j] >= 0)
+                    continue;
+                llvm::Optional<size_t> vi = posetVariable(syms[i - 1], poset);
+                llvm::Optional<size_t> vj = posetVariable(syms[j - 1], poset);
+                if (!vi || !vj)
+                    continue;
+                int64_t m = std::min(c[i], -c[j]);
+                // `x_i - x_j`
+                itv += poset(*vj, *vi) * m;
+                c[i] -= m;
+                c[j] += m;
+            }
+        }
+        for (size_t k = 1; k < c.size(); ++k)
+            if (c[k])
+                itv += symbolInterval(syms[k - 1], poset) * c[k];
+        return itv;
+    }
+    static llvm::SmallVector<int64_t> symbolicPart(PtrVector<int64_t> row,
+                                                   size_t numSymbols) {
+        llvm::SmallVector<int64_t> coefs;
+        for (size_t k = 0; k < numSymbols; ++k)
+            coefs.push_back(row[k]);
+        return coefs;
+    }
+    // `floor(x / d)` and `ceil(x / d)` for `d > 0`
+    static int64_t floorDiv(int64_t x, int64_t d) {
+        int64_t q = x / d;
+        return q - ((x % d) < 0);
+    }
+    static int64_t ceilDiv(int64_t x, int64_t d) {
+        int64_t q = x / d;
+        return q + ((x % d) > 0);
+    }
+    static constexpr int64_t typeMin = std::numeric_limits<int64_t>::min();
+    static constexpr int64_t typeMax = std::numeric_limits<int64_t>::max();
+    // adds bounds, where `typeMin` and `typeMax` are infinite
+    static int64_t addLower(int64_t a, int64_t b) {
+        return ((a == typeMin) || (b == typeMin)) ? typeMin
+                                                  : saturatedAdd(a, b);
+    }
+    static int64_t addUpper(int64_t a, int64_t b) {
+        return ((a == typeMax) || (b == typeMax)) ? typeMax
+                                                  : saturatedAdd(a, b);
+    }
+    static LoopBound loopBound(const AffineLoopNest &loop, size_t l,
+                               const PartiallyOrderedSet &poset) {
+        const size_t numSymbols = loop.getNumSymbols();
+        const size_t numLoops = loop.getNumLoops();
+        IntMatrix B = loop.A;
+        for (size_t q = 0; q < numLoops; ++q)
+            if (q != l)
+                fourierMotzkin(B, numSymbols + q);
+        LoopBound bound{Interval::unconstrained(), {}, {}};
+        // numeric bound of the chosen `lower` and `upper`
+        int64_t symLower = typeMin, symUpper = typeMax;
+        for (size_t r = 0; r < B.numRow(); ++r) {
+            // `a*i_l + rest >= 0`
+            int64_t a = B(r, numSymbols + l);
+            if (!a)
+                continue;
+            llvm::SmallVector<int64_t> rest =
+                symbolicPart(B.getRow(r), numSymbols);
+            Interval restRange = symbolicInterval(loop.symbols, rest, poset);
+            if (a > 0) {
+                // `i_l >= ceil(-rest / a)`
+                int64_t lb = restRange.upperBound == typeMax
+                                 ? typeMin
+                                 : ceilDiv(-restRange.upperBound, a);
+                bound.range.lowerBound = std::max(bound.range.lowerBound, lb);
+                if ((a == 1) && (bound.lower.empty() || (lb > symLower))) {
+                    for (auto &v : rest)
+                        v = -v;
+                    bound.lower = std::move(rest);
+                    symLower = lb;
+                }
+            } else {
+                // `i_l <= floor(rest / -a)`
+                int64_t ub = restRange.upperBound == typeMax
+                                 ? typeMax
+                                 : floorDiv(restRange.upperBound, -a);
+                bound.range.upperBound = std::min(bound.range.upperBound, ub);
+                if ((a == -1) && (bound.upper.empty() || (ub < symUpper))) {
+                    bound.upper = std::move(rest);
+                    symUpper = ub;
+                }
+            }
+        }
+        return bound;
+    }
+    const LoopBound &bound(bool isX, size_t l) {
+        llvm::Optional<LoopBound> &b = (isX ? xBounds : yBounds)[l];
+        if (!b)
+            b = loopBound(*(isX ? x : y).loop, l, poset);
+        return *b;
+    }
+
+    SubscriptTest(const ArrayReference &x, const ArrayReference &y,
+                  const PartiallyOrderedSet &poset)
+        : x(x), y(y), poset(poset),
+          sameSymbols(x.loop->symbols == y.loop->symbols),
+          xBounds(x.getNumLoops()), yBounds(y.getNumLoops()) {
+        if (!x.stridesMatch(y))
+            return;
+        PtrMatrix<int64_t> Ax = x.indexMatrix();
+        PtrMatrix<int64_t> Ay = y.indexMatrix();
+        PtrMatrix<int64_t> Ox = x.offsetMatrix();
+        PtrMatrix<int64_t> Oy = y.offsetMatrix();
+        const size_t numSymbols = x.loop->getNumSymbols();
+        for (size_t k = 0; k < x.arrayDim(); ++k) {
+            Subscript &sub = subscripts.emplace_back(Subscript{
+                {}, {}, Ox(k, 0) - Oy(k, 0), {}, Interval{0}, false});
+            for (size_t l = 0; l < Ax.numRow(); ++l)
+                sub.a.push_back(Ax(l, k));
+            for (size_t l = 0; l < Ay.numRow(); ++l)
+                sub.b.push_back(Ay(l, k));
+            if (sameSymbols) {
+                // let the offsets cancel
+                sub.sym.resize(numSymbols, 0);
+                for (size_t j = 1; j < Ox.numCol(); ++j)
+                    sub.sym[j] += Ox(k, j);
+                for (size_t j = 1; j < Oy.numCol(); ++j)
+                    sub.sym[j] -= Oy(k, j);
+                sub.isSymbolic = !allZero(sub.sym);
+                continue;
+            }
+            sub.isSymbolic = !allZero(Ox(k, _(1, end))) ||
+                             !allZero(Oy(k, _(1, end)));
+            if (!sub.isSymbolic)
+                continue;
+            llvm::SmallVector<int64_t> ox =
+                symbolicPart(Ox.getRow(k), Ox.numCol());
+            llvm::SmallVector<int64_t> oy =
+                symbolicPart(Oy.getRow(k), Oy.numCol());
+            ox[0] = oy[0] = 0;
+            sub.symRange = symbolicInterval(x.loop->symbols, ox, poset) -
+                           symbolicInterval(y.loop->symbols, oy, poset);
+        }
+    }
+
+    // loop `l` if `sub` only has terms on loop `l` of `x` and/or `y`
+    static llvm::Optional<size_t> singleLoop(const Subscript &sub) {
+        llvm::Optional<size_t> l;
+        auto check = [&](llvm::ArrayRef<int64_t> coefs) {
+            for (size_t q = 0; q < coefs.size(); ++q) {
+                if (!coefs[q])
+                    continue;
+                if (l && (*l != q))
+                    return false;
+                l = q;
+            }
+            return true;
+        };
+        if (!check(sub.a) || !check(sub.b))
+            return {};
+        return l;
+    }
+    static int64_t coef(llvm::ArrayRef<int64_t> coefs, size_t l) {
+        return l < coefs.size() ? coefs[l] : 0;
+    }
+    // range of `h` over the bounds of the loops
+    Interval range(const Subscript &sub) {
+        // `h` is within `[lo*[1, symbols] + loNum, hi*[1, symbols] + hiNum]`
+        llvm::SmallVector<int64_t> lo{sub.sym};
+        lo.resize(sameSymbols ? x.loop->getNumSymbols() : 1, 0);
+        lo[0] = sub.c;
+        llvm::SmallVector<int64_t> hi{lo};
+        int64_t loNum = sub.symRange.lowerBound;
+        int64_t hiNum = sub.symRange.upperBound;
+        // adds `m*i`
+        auto add = [&](const LoopBound &bd, int64_t m) {
+            const llvm::SmallVector<int64_t> &max = m > 0 ? bd.upper : bd.lower;
+            const llvm::SmallVector<int64_t> &min = m > 0 ? bd.lower : bd.upper;
+            Interval r = bd.range * m;
+            if (sameSymbols && !max.empty())
+                for (size_t k = 0; k < max.size(); ++k)
+                    hi[k] += m * max[k];
+            else
+                hiNum = addUpper(hiNum, r.upperBound);
+            if (sameSymbols && !min.empty())
+                for (size_t k = 0; k < min.size(); ++k)
+                    lo[k] += m * min[k];
+            else
+                loNum = addLower(loNum, r.lowerBound);
+        };
+        for (size_t l = 0; l < sub.a.size(); ++l)
+            if (int64_t a = sub.a[l])
+                add(bound(true, l), a);
+        for (size_t l = 0; l < sub.b.size(); ++l)
+            if (int64_t b = sub.b[l])
+                add(bound(false, l), -b);
+        return Interval{
+            addLower(symbolicInterval(x.loop->symbols, lo, poset).lowerBound,
+                     loNum),
+            addUpper(symbolicInterval(x.loop->symbols, hi, poset).upperBound,
+                     hiNum)};
+    }
+    static bool excludes(Interval itv, int64_t v) {
+        return (v < itv.lowerBound) || (v > itv.upperBound);
+    }
+    // exact SIV test; `true` if independent
+    bool sivIndependent(const Subscript &sub) {
+        llvm::Optional<size_t> l = singleLoop(sub);
+        if (!l)
+            return false;
+        int64_t a = coef(sub.a, *l);
+        int64_t b = coef(sub.b, *l);
+        if (a == b) {
+            // `a*(i_l - j_l) == -c`
+            if (sub.c % a)
+                return true;
+            Subscript d{{}, {}, 0, {}, Interval{0}, false};
+            d.a.resize(sub.a.size(), 0);
+            d.b.resize(sub.b.size(), 0);
+            d.a[*l] = d.b[*l] = 1;
+            return excludes(range(d), -sub.c / a);
+        }
+        if (a && b)
+            return false;
+        // weak zero: `a*i_l == -c` or `b*j_l == c`
+        const bool isX = a != 0;
+        int64_t m = isX ? a : -b;
+        if (sub.c % m)
+            return true;
+        return excludes(bound(isX, *l).range, -sub.c / m);
+    }
+    // Whether the extent of each loop of a rectangular `loop` is at least
+    // `minExtent[l]`.
+    bool rectangularWithExtent(const AffineLoopNest &loop,
+                               llvm::ArrayRef<int64_t> minExtent) const {
+        const size_t numSymbols = loop.getNumSymbols();
+        PtrMatrix<int64_t> A = loop.A;
+        llvm::SmallVector<int> loopOfRow;
+        for (size_t r = 0; r < A.numRow(); ++r) {
+            int l = -1;
+            for (size_t q = 0; q < loop.getNumLoops(); ++q) {
+                if (int64_t c = A(r, numSymbols + q)) {
+                    if ((l >= 0) || (std::abs(c) != 1))
+                        return false;
+                    l = q;
+                }
+            }
+            loopOfRow.push_back(l);
+        }
+        // each pair of lower and upper bounds gives `upper - lower >= 0`
+        llvm::SmallVector<int64_t> width(numSymbols);
+        for (size_t r0 = 0; r0 < A.numRow(); ++r0) {
+            int l = loopOfRow[r0];
+            if ((l < 0) || (A(r0, numSymbols + l) != 1))
+                continue;
+            for (size_t r1 = 0; r1 < A.numRow(); ++r1) {
+                if ((loopOfRow[r1] != l) || (A(r1, numSymbols + l) != -1))
+                    continue;
+                for (size_t k = 0; k < numSymbols; ++k)
+                    width[k] = A(r0, k) + A(r1, k);
+                Interval w = symbolicInterval(loop.symbols, width, poset);
+                if (w.lowerBound < minExtent[l])
+                    return false;
+            }
+        }
+        return true;
+    }
+    bool knownDependent() const {
+        const AffineLoopNest &loop = *x.loop;
+        if ((x.loop.get() != y.loop.get()) &&
+            (!sameSymbols || !(loop.A == y.loop->A)))
+            return false;
+        llvm::SmallVector<int64_t> minExtent(loop.getNumLoops(), 0);
+        llvm::SmallVector<bool> used(loop.getNumLoops(), false);
+        for (auto &sub : subscripts) {
+            if (sub.isSymbolic)
+                return false;
+            if (sub.isZIV()) {
+                if (sub.c)
+                    return false;
+                continue;
+            }
+            llvm::Optional<size_t> l = singleLoop(sub);
+            if (!l || used[*l])
+                return false;
+            int64_t a = coef(sub.a, *l);
+            if ((a != coef(sub.b, *l)) || (sub.c % a))
+                return false;
+            used[*l] = true;
+            minExtent[*l] = std::abs(sub.c / a);
+        }
+        return rectangularWithExtent(loop, minExtent);
+    }
+    Outcome run() {
+        if (subscripts.size() != x.arrayDim())
+            return {Result::Unknown, Tier::None};
+        for (auto &sub : subscripts)
+            if (sub.isZIV() && !sub.isSymbolic && sub.c)
+                return {Result::Independent, Tier::ZIV};
+        if (x.gcdKnownIndependent(y))
+            return {Result::Independent, Tier::GCD};
+        for (auto &sub : subscripts)
+            if (!sub.isSymbolic && sivIndependent(sub))
+                return {Result::Independent, Tier::SIV};
+        for (auto &sub : subscripts)
+            if (!sub.isSymbolic && excludes(range(sub), 0))
+                return {Result::Independent, Tier::Banerjee};
+        for (auto &sub : subscripts)
+            if (sub.isSymbolic && excludes(range(sub), 0))
+                return {Result::Independent, Tier::Interval};
+        if (knownDependent())
+            return {Result::Dependent, Tier::SIV};
+        return {Result::Unknown, Tier::None};
+    }
+    static Outcome check(const ArrayReference &x, const ArrayReference &y,
+                         const PartiallyOrderedSet &poset) {
+        return SubscriptTest(x, y, poset).run();
+    }
+};
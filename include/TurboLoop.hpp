@@ -1,26 +1,43 @@
 #pragma once
 
+#include "./AffineExtraction.hpp"
+#include "./CodeGen.hpp"
+#include "./CostModeling.hpp"
 #include "./IntegerMap.hpp"
+#include "./LoopBlock.hpp"
 #include "./Loops.hpp"
+#include "./ModuleContext.hpp"
 #include "./POSet.hpp"
 // #include "Tree.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <deque>
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/STLExtras.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/Analysis/AssumptionCache.h>
 #include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/LoopIterator.h>
 #include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
 #include <llvm/Analysis/TargetLibraryInfo.h>
 #include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Analysis/ValueTracking.h>
 #include <llvm/IR/Constant.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/Dominators.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/PassManager.h>
 #include <llvm/IR/Value.h>
 #include <llvm/Support/Casting.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Transforms/Utils/Local.h>
 #include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
 
 static bool isKnownOne(llvm::Value *x) {
     if (llvm::ConstantInt *constInt = llvm::dyn_cast<llvm::ConstantInt>(x)) {
@@ -31,21 +48,329 @@ static bool isKnownOne(llvm::Value *x) {
     return false;
 }
 
+// struct NestIndVarRewriter
+// Rewrites the recurrences of the loops of a nest in terms of new induction
+// variables. An affine `SCEVAddRecExpr` of `loops[d]` becomes
+// `start + step * x_d`, where `x_d` is `indVars[d]`, or `0` while `indVars`
+// is empty, which only checks that the rewrite is possible. Any other
+// recurrence, or value defined in the nest, clears `valid`.
+struct NestIndVarRewriter
+    : public llvm::SCEVRewriteVisitor<NestIndVarRewriter> {
+    llvm::ArrayRef<llvm::Loop *> loops;
+    llvm::ArrayRef<llvm::Value *> indVars;
+    bool valid{true};
+
+    NestIndVarRewriter(llvm::ScalarEvolution &SE,
+                       llvm::ArrayRef<llvm::Loop *> loops,
+                       llvm::ArrayRef<llvm::Value *> indVars = {})
+        : SCEVRewriteVisitor(SE), loops(loops), indVars(indVars) {}
+    const llvm::SCEV *visitAddRecExpr(const llvm::SCEVAddRecExpr *E) {
+        auto it = llvm::find(loops, E->getLoop());
+        if ((it == loops.end()) || !E->isAffine()) {
+            valid = false;
+            return E;
+        }
+        const llvm::SCEV *start = visit(E->getStart());
+        const llvm::SCEV *step = visit(E->getStepRecurrence(SE));
+        llvm::Type *T = step->getType();
+        const llvm::SCEV *x =
+            indVars.empty()
+                ? SE.getZero(T)
+                : SE.getTruncateOrSignExtend(
+                      SE.getUnknown(indVars[it - loops.begin()]), T);
+        return SE.getAddExpr(start, SE.getMulExpr(step, x));
+    }
+    const llvm::SCEV *visitUnknown(const llvm::SCEVUnknown *E) {
+        if (auto *I = llvm::dyn_cast<llvm::Instruction>(E->getValue()))
+            if (loops.front()->contains(I))
+                valid = false;
+        return E;
+    }
+};
+
+// struct TurboLoopTask
+// All state `TurboLoopPass` keeps about one function, so that functions can
+// be processed independently. A task runs in three stages:
+// 1. `TurboLoopPass::collect` queries LLVM's analyses and fills `lblock`;
+// 2. `analyze` builds the dependences and their SCCs, and picks each nest's
+//    unroll-and-jam. It touches neither the IR nor any analysis manager, so
+//    tasks of different functions may run it concurrently;
+// 3. `TurboLoopPass::apply` picks each nest's vectorization, and regenerates
+//    the nests it transforms with `generateCode`.
+// Stages 1 and 3 must be run serially, as LLVM's analysis managers are not
+// thread safe. `analyze` must not print either, or the output of concurrent
+// tasks would interleave.
+struct TurboLoopTask {
+    llvm::Function *F;
+    FunctionContext ctx;
+    LoopBlock lblock;
+    llvm::SmallVector<llvm::SmallVector<int64_t>> components;
+    // const llvm::TargetLibraryInfo *TLI;
+    const llvm::TargetTransformInfo *TTI{nullptr};
+    llvm::LoopInfo *LI{nullptr};
+    llvm::ScalarEvolution *SE{nullptr};
+    // budget for `RegisterTilingModel`
+    unsigned registerCount{0};
+    // lanes for `VectorizationModel`
+    unsigned vectorWidth{1};
+
+    TurboLoopTask(llvm::Function &F, const ModuleContext &module)
+        : F(&F), ctx(module) {}
+    void analyze() {
+        lblock.fillEdges(ctx.poset);
+        components = lblock.getComponents();
+        chooseUnrollAndJam();
+    }
+    // the distinct `AffineLoopNest`s of `lblock`'s accesses, in order
+    llvm::SmallVector<const AffineLoopNest *> getLoopNests() const {
+        llvm::SmallVector<const AffineLoopNest *> nests;
+        for (auto &m : lblock.memory)
+            if (std::find(nests.begin(), nests.end(), m.ref.loop.get()) ==
+                nests.end())
+                nests.push_back(m.ref.loop.get());
+        return nests;
+    }
+    // Unroll-and-jam of loop `j` of `loop` interleaves iterations of `j` with
+    // the loops inside it, as if `j` were moved innermost. This must preserve
+    // every dependence between the accesses of `loop`.
+    bool canUnrollAndJam(const AffineLoopNest &loop, size_t j) const {
+        const size_t numLoops = loop.getNumLoops();
+        llvm::SmallVector<unsigned, 4> order;
+        for (size_t l = 0; l < numLoops; ++l)
+            if (l != j)
+                order.push_back(l);
+        order.push_back(j);
+        for (auto &e : lblock.edges) {
+            if ((e.in->ref.loop.get() != &loop) ||
+                (e.out->ref.loop.get() != &loop))
+                continue;
+            if (e.distance.size() != numLoops)
+                return false;
+            llvm::Optional<bool> preserved =
+                e.isPreservedByPermutation(order);
+            if (!(preserved && *preserved))
+                return false;
+        }
+        // `edges` has no output dependences of a store on itself
+        for (auto &m : lblock.memory)
+            if ((m.ref.loop.get() == &loop) && (!m.isLoad) &&
+                DependencePolyhedra(m, m, ctx.poset).mayCarry(j))
+                return false;
+        return true;
+    }
+    // Sets the unroll-and-jam of each nest's schedules to the choice of
+    // `RegisterTilingModel`, if it is legal.
+    void chooseUnrollAndJam() {
+        for (const AffineLoopNest *loop : getLoopNests()) {
+            UnrollAndJam u =
+                RegisterTilingModel(*loop, lblock.memory, registerCount)
+                    .choose();
+            if (((u.outer >= 0) && !canUnrollAndJam(*loop, u.outer)) ||
+                ((u.inner >= 0) && !canUnrollAndJam(*loop, u.inner)))
+                continue;
+            for (auto &m : lblock.memory)
+                if (m.ref.loop.get() == loop)
+                    u.apply(m.schedule);
+        }
+    }
+    // Sets the vectorized loop of each nest's schedules to the choice of
+    // `VectorizationModel`. Its `TTI` costs create vector types in the
+    // `LLVMContext`, which functions share, so this is not part of `analyze`.
+    void chooseVectorization() {
+        for (const AffineLoopNest *loop : getLoopNests()) {
+            Vectorization v = VectorizationModel(*loop, lblock.memory,
+                                                 lblock.edges, vectorWidth, TTI)
+                                  .choose();
+            for (auto &m : lblock.memory)
+                if (m.ref.loop.get() == loop)
+                    v.apply(m.schedule);
+        }
+    }
+    // The SCEV of each symbol of `loop`, or `None` if one isn't an integer.
+    // Module constants are replaced by their value.
+    llvm::Optional<llvm::SmallVector<const llvm::SCEV *>>
+    getSymbolSCEVs(const AffineLoopNest &loop, llvm::IntegerType *T) {
+        llvm::SmallVector<const llvm::SCEV *> symbols;
+        for (auto &m : loop.symbols) {
+            llvm::SmallVector<const llvm::SCEV *> factors;
+            for (VarID v : m) {
+                size_t id = v.getID();
+                llvm::Value *x = ctx.symbols.backward[id - 1];
+                if (id <= ctx.module.getNumSymbols())
+                    x = llvm::cast<llvm::GlobalVariable>(x)->getInitializer();
+                if (!x->getType()->isIntegerTy())
+                    return llvm::None;
+                factors.push_back(
+                    SE->getTruncateOrSignExtend(SE->getSCEV(x), T));
+            }
+            symbols.push_back(SE->getMulExpr(factors));
+        }
+        return symbols;
+    }
+    // Regenerates the top-level loop `outer` with `LoopNestCodeGen`, if its
+    // schedule records a transformation. This is only done for perfect nests
+    // in loop simplify form, whose accesses all lie in the innermost loop,
+    // a single block. The other blocks may only hold instructions that are
+    // safe to speculate, as these are moved into the innermost loop, and
+    // branch conditionally only at the latches, which must be the only
+    // exits. Header phis must be recurrences of the nest, and no value of
+    // the nest may be used outside of it.
+    // The old blocks are appended to `dead`, to be deleted once `LI` is no
+    // longer used.
+    bool regenerate(llvm::Loop *outer, llvm::SCEVExpander &expander,
+                    llvm::SmallVectorImpl<llvm::BasicBlock *> &dead) {
+        const MemoryAccess *first = nullptr;
+        for (auto &m : lblock.memory) {
+            auto *I = llvm::cast<llvm::Instruction>(m.user);
+            if (!outer->contains(I))
+                continue;
+            if (!first)
+                first = &m;
+            else if (m.ref.loop != first->ref.loop)
+                return false;
+        }
+        if (!first)
+            return false;
+        const AffineLoopNest &loop = *first->ref.loop;
+        const Schedule &sch = first->schedule;
+        if ((sch.vectorized < 0) && (sch.unrolledInner < 0) &&
+            (sch.unrolledOuter < 0))
+            return false;
+        llvm::SmallVector<llvm::Loop *, 4> chain;
+        for (llvm::Loop *L = outer;; L = L->getSubLoops().front()) {
+            if (!(L->isLoopSimplifyForm() &&
+                  (L->getExitingBlock() == L->getLoopLatch())))
+                return false;
+            chain.push_back(L);
+            if (L->isInnermost())
+                break;
+            if (L->getSubLoops().size() != 1)
+                return false;
+        }
+        if ((chain.size() != loop.getNumLoops()) ||
+            (chain.back()->getNumBlocks() != 1))
+            return false;
+        for (auto &m : lblock.memory)
+            if (outer->contains(llvm::cast<llvm::Instruction>(m.user)) &&
+                (LI->getLoopFor(llvm::cast<llvm::Instruction>(m.user)
+                                    ->getParent()) != chain.back()))
+                return false;
+        llvm::LoopBlocksRPO RPO(outer);
+        RPO.perform(LI);
+        llvm::SmallVector<llvm::BasicBlock *> blocks(RPO.begin(), RPO.end());
+        NestIndVarRewriter check(*SE, chain);
+        for (llvm::BasicBlock *BB : blocks) {
+            auto *br = llvm::dyn_cast<llvm::BranchInst>(BB->getTerminator());
+            if (!br)
+                return false;
+            bool isLatch = llvm::any_of(chain, [=](llvm::Loop *L) {
+                return L->getLoopLatch() == BB;
+            });
+            if (br->isConditional() && !isLatch)
+                return false;
+            bool isHeader = llvm::any_of(chain, [=](llvm::Loop *L) {
+                return L->getHeader() == BB;
+            });
+            bool isInnermost = BB == chain.back()->getHeader();
+            for (llvm::Instruction &I : *BB) {
+                for (llvm::User *U : I.users())
+                    if (!outer->contains(llvm::cast<llvm::Instruction>(U)))
+                        return false;
+                if (auto *phi = llvm::dyn_cast<llvm::PHINode>(&I)) {
+                    if (!isHeader)
+                        return false;
+                    check.visit(SE->getSCEV(phi));
+                } else if (!(isInnermost || I.isTerminator() ||
+                             llvm::isSafeToSpeculativelyExecute(&I))) {
+                    return false;
+                }
+            }
+        }
+        if (!check.valid)
+            return false;
+        llvm::IntegerType *indexType =
+            llvm::Type::getInt64Ty(F->getContext());
+        llvm::Optional<llvm::SmallVector<const llvm::SCEV *>> symbols =
+            getSymbolSCEVs(loop, indexType);
+        if (!symbols)
+            return false;
+
+        llvm::BasicBlock *preheader = outer->getLoopPreheader();
+        llvm::BasicBlock *exit = outer->getExitBlock();
+        preheader->getTerminator()->eraseFromParent();
+        llvm::IRBuilder<> builder(preheader);
+        auto body = [&](llvm::IRBuilder<> &b,
+                        llvm::ArrayRef<llvm::Value *> indVars) {
+            llvm::ValueToValueMapTy vmap;
+            llvm::SmallVector<llvm::Instruction *> clones;
+            for (llvm::BasicBlock *BB : blocks) {
+                for (llvm::Instruction &I : *BB) {
+                    if (llvm::isa<llvm::PHINode>(I) || I.isTerminator())
+                        continue;
+                    llvm::Instruction *c = I.clone();
+                    b.Insert(c, I.getName());
+                    vmap[&I] = c;
+                    clones.push_back(c);
+                }
+            }
+            NestIndVarRewriter rewriter(*SE, chain, indVars);
+            for (llvm::Loop *L : chain)
+                for (llvm::PHINode &phi : L->getHeader()->phis())
+                    vmap[&phi] = expander.expandCodeFor(
+                        rewriter.visit(SE->getSCEV(&phi)), phi.getType(),
+                        clones.front());
+            for (llvm::Instruction *c : clones)
+                llvm::RemapInstruction(c, vmap,
+                                       llvm::RF_IgnoreMissingLocals |
+                                           llvm::RF_NoModuleLevelChanges);
+            // e.g. the old induction variables' increments and exit tests
+            for (llvm::Instruction *c : llvm::reverse(clones))
+                if (llvm::isInstructionTriviallyDead(c))
+                    c->eraseFromParent();
+        };
+        LoopNestCodeGen codegen(*SE, expander, indexType, loop, *symbols);
+        LoopNestCodeGen::Statement statement{&sch, body};
+        codegen.emit(builder, statement);
+        exit->replacePhiUsesWith(outer->getLoopLatch(),
+                                 builder.GetInsertBlock());
+        builder.CreateBr(exit);
+        SE->forgetLoop(outer);
+        dead.append(blocks.begin(), blocks.end());
+        return true;
+    }
+    // Regenerates each top-level nest `regenerate` applies to, and deletes
+    // the old nests. Returns `true` if the IR changed, in which case `LI` and
+    // `SE` are stale.
+    bool generateCode() {
+        llvm::SCEVExpander expander(*SE, F->getParent()->getDataLayout(),
+                                    "turboloop");
+        llvm::SmallVector<llvm::BasicBlock *> dead;
+        for (llvm::Loop *L : *LI)
+            regenerate(L, expander, dead);
+        expander.clear();
+        for (llvm::BasicBlock *BB : dead)
+            BB->dropAllReferences();
+        for (llvm::BasicBlock *BB : dead)
+            BB->eraseFromParent();
+        return !dead.empty();
+    }
+};
+
 // requires `isRecursivelyLCSSAForm`
 class TurboLoopPass : public llvm::PassInfoMixin<TurboLoopPass> {
   public:
     llvm::PreservedAnalyses run(llvm::Function &F,
                                 llvm::FunctionAnalysisManager &AM);
-    ValueToPosetMap valueToPosetMap;
-    PartiallyOrderedSet poset;
+    void collect(TurboLoopTask &task, llvm::FunctionAnalysisManager &AM);
+    llvm::PreservedAnalyses apply(TurboLoopTask &task,
+                                  llvm::FunctionAnalysisManager &AM);
+    // Used when run as a function pass; rebuilt whenever we're handed a
+    // function of a different module.
+    ModuleContext moduleContext;
+    const llvm::Module *contextModule{nullptr};
     // Tree tree;
     // llvm::AssumptionCache *AC;
-    const llvm::TargetLibraryInfo *TLI;
-    const llvm::TargetTransformInfo *TTI;
-    llvm::LoopInfo *LI;
-    llvm::ScalarEvolution *SE;
     // const llvm::DataLayout *DL;
-    unsigned registerCount;
 
     // returns index to the loop whose preheader we place it in.
     // if it equals depth, then we must place it into the inner most loop
@@ -195,3 +520,31 @@ class TurboLoopPass : public llvm::PassInfoMixin<TurboLoopPass> {
     //     }
     // }
 };
+
+// Runs `TurboLoopPass` on each function of a module, building the
+// `ModuleContext` once rather than per function.
+// Every function is collected, then all are analyzed on a thread pool of
+// `numThreads` threads (`0` uses all hardware threads), then each is applied
+// in turn.
+class TurboLoopModulePass : public llvm::PassInfoMixin<TurboLoopModulePass> {
+  public:
+    TurboLoopModulePass(unsigned numThreads = 0) : numThreads(numThreads) {}
+    llvm::PreservedAnalyses run(llvm::Module &M,
+                                llvm::ModuleAnalysisManager &AM);
+    // runs `TurboLoopTask::analyze` of each task, on up to `numThreads`
+    // threads (`0` for one per core)
+    static void analyze(std::deque<TurboLoopTask> &tasks,
+                        unsigned numThreads) {
+        if (tasks.size() > 1) {
+            llvm::ThreadPool pool(llvm::hardware_concurrency(numThreads));
+            for (TurboLoopTask &task : tasks)
+                pool.async([&task] { task.analyze(); });
+            pool.wait();
+        } else {
+            for (TurboLoopTask &task : tasks)
+                task.analyze();
+        }
+    }
+    TurboLoopPass pass;
+    unsigned numThreads;
+};
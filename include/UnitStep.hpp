@@ -6,6 +6,8 @@
 #include "llvm/IR/BasicBlock.h"
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/STLExtras.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/Analysis/AssumptionCache.h>
 #include <llvm/Analysis/LoopAnalysisManager.h>
@@ -21,128 +23,152 @@
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/PassManager.h>
 #include <llvm/IR/Value.h>
+#include <llvm/IR/ValueHandle.h>
 #include <llvm/Support/Casting.h>
 #include <llvm/Transforms/Scalar/LoopPassManager.h>
+#include <llvm/Transforms/Utils/Local.h>
 #include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
 
 // requires `isLCSSAForm`
 // UnitStepPass is a LoopPass
+// Rewrites every induction variable with a non-unit step as
+// `oldIV = newIV * step + init`, where `newIV` runs from `0` to the loop's
+// backedge-taken count. A nest is canonicalized as a batch when the pass
+// reaches its outermost loop. All of its trip counts are expanded through one
+// `SCEVExpander`, each in the preheader of the outermost loop it is invariant
+// in. Loops with the same trip count therefore share the expanded code.
+// `ScalarEvolution` is kept valid by forgetting each rewritten loop, rather
+// than being invalidated.
+// Loops are rewritten innermost first: an inner loop's `init` or trip count
+// may use an outer loop's old IV, which is only replaced once the outer loop
+// is rewritten.
 class UnitStepPass : public llvm::PassInfoMixin<UnitStepPass> {
   public:
     llvm::PreservedAnalyses run(llvm::Loop &L, llvm::LoopAnalysisManager &,
                                 llvm::LoopStandardAnalysisResults &AR,
                                 llvm::LPMUpdater &) {
-
-        if (toUnitStep(L, AR)) {
-            // taken from llvm/Transforms/Scalar/IndVarsimplify.h
-            auto PA = llvm::getLoopPassPreservedAnalyses();
-            PA.preserveSet<llvm::CFGAnalyses>();
-            if (AR.MSSA)
-                PA.preserve<llvm::MemorySSAAnalysis>();
-            return PA;
-        } else {
+        // inner loops are handled along with their outermost loop
+        if (L.getParentLoop() || !canonicalizeNest(L, AR))
             return llvm::PreservedAnalyses::all();
-        }
+        // taken from llvm/Transforms/Scalar/IndVarsimplify.h
+        auto PA = llvm::getLoopPassPreservedAnalyses();
+        PA.preserveSet<llvm::CFGAnalyses>();
+        if (AR.MSSA)
+            PA.preserve<llvm::MemorySSAAnalysis>();
+        return PA;
     }
 
   private:
+    struct Candidate {
+        llvm::Loop *L;
+        llvm::PHINode *oldIV;
+        // may be old IVs of enclosing loops, so these follow their
+        // replacement
+        llvm::WeakTrackingVH init;
+        llvm::WeakTrackingVH step;
+        llvm::WeakTrackingVH backedgeTaken;
+    };
     static bool isConstantIntZero(llvm::Value *x) {
         if (auto *c = llvm::dyn_cast<llvm::ConstantInt>(x)) {
             return c->isZero();
         }
         return false;
     }
-    bool toUnitStep(llvm::Loop &L, llvm::LoopStandardAnalysisResults &AR) {
-        if (!L.isLoopSimplifyForm()) {
-            return false;
+    static bool canonicalizeNest(llvm::Loop &outer,
+                                 llvm::LoopStandardAnalysisResults &AR) {
+        llvm::SCEVExpander expander(
+            AR.SE, outer.getHeader()->getModule()->getDataLayout(),
+            "unitstep");
+        // don't insert a canonical IV of our own for the trip counts
+        expander.disableCanonicalMode();
+        // expand all trip counts before rewriting any loop, so that they're
+        // computed from the original IVs
+        llvm::SmallVector<Candidate> candidates;
+        for (llvm::Loop *L : outer.getLoopsInPreorder())
+            if (llvm::Optional<Candidate> c = getCandidate(*L, AR, expander))
+                candidates.push_back(*c);
+        for (Candidate &c : llvm::reverse(candidates))
+            toUnitStep(c, AR);
+        return !candidates.empty();
+    }
+    static llvm::Optional<Candidate>
+    getCandidate(llvm::Loop &L, llvm::LoopStandardAnalysisResults &AR,
+                 llvm::SCEVExpander &expander) {
+        if (!L.isLoopSimplifyForm())
+            return llvm::None;
+        llvm::PHINode *oldIV = L.getInductionVariable(AR.SE);
+        if (!oldIV)
+            return llvm::None;
+        llvm::Optional<llvm::Loop::LoopBounds> bounds =
+            llvm::Loop::LoopBounds::getBounds(L, *oldIV, AR.SE);
+        if (!bounds)
+            return llvm::None;
+        llvm::Value *step = bounds->getStepValue();
+        if (!step)
+            return llvm::None;
+        if (auto *stepConst = llvm::dyn_cast<llvm::ConstantInt>(step))
+            if (stepConst->isOne())
+                return llvm::None;
+        const llvm::SCEV *btc = AR.SE.getBackedgeTakenCount(&L);
+        if (llvm::isa<llvm::SCEVCouldNotCompute>(btc) ||
+            !AR.SE.isLoopInvariant(btc, &L))
+            return llvm::None;
+        btc = AR.SE.getTruncateOrZeroExtend(btc, oldIV->getType());
+        // hoist to the outermost preheader `btc` is invariant in
+        llvm::Loop *P = &L;
+        while (llvm::Loop *parent = P->getParentLoop()) {
+            if (!(parent->getLoopPreheader() &&
+                  AR.SE.isLoopInvariant(btc, parent)))
+                break;
+            P = parent;
         }
-        llvm::errs() << "Before replacement:\n"
-                     << L << "\nPreHeader:\n"
-                     << *L.getLoopPreheader() << "\nHeader:" << *L.getHeader()
-                     << "\n\n";
-        // llvm::Function *F = L.getHeader()->getParent();
-        // const llvm::DataLayout &DL = F->getParent()->getDataLayout();
-
-        auto oldIV = L.getInductionVariable(AR.SE);
-        // auto oldCmp = L.getLatchCmpInst();
+        llvm::Instruction *insertPt = P->getLoopPreheader()->getTerminator();
+        if (!llvm::isSafeToExpandAt(btc, insertPt, AR.SE))
+            return llvm::None;
+        llvm::Value *backedgeTaken =
+            expander.expandCodeFor(btc, oldIV->getType(), insertPt);
+        return Candidate{&L, oldIV, &bounds->getInitialIVValue(), step,
+                         backedgeTaken};
+    }
+    // our new loop will be
+    //  for (auto newIV = 0; newIV != backedgeTaken + 1; ++newIV){
+    //    oldIV = newIV*oldStep + oldInit;
+    //    ...
+    //  }
+    static void toUnitStep(Candidate &c, llvm::LoopStandardAnalysisResults &AR) {
+        llvm::Loop &L = *c.L;
+        // drop everything SCEV knows about `L` before we change it
+        AR.SE.forgetLoop(&L);
+        llvm::BasicBlock *preHeader = L.getLoopPreheader();
         // we check isLoopSimplifyForm, so there is only one latch
         llvm::BasicBlock *latch = L.getLoopLatch();
         llvm::BranchInst *oldBI =
             llvm::cast<llvm::BranchInst>(latch->getTerminator());
-        llvm::Optional<llvm::Loop::LoopBounds> boundsRoot =
-            llvm::Loop::LoopBounds::getBounds(L, *oldIV, AR.SE);
-        if (boundsRoot.hasValue()) {
-            llvm::Loop::LoopBounds &bounds = boundsRoot.getValue();
-            // auto pred
-            llvm::Value *step = bounds.getStepValue();
-            if (llvm::ConstantInt *stepConst =
-                    llvm::dyn_cast<llvm::ConstantInt>(step)) {
-                if (stepConst->isOne()) {
-                    return false;
-                }
-            }
-            // If we're here, then we have non-unit step.
-            llvm::Value *init = &bounds.getInitialIVValue();
-            llvm::Value *finl = &bounds.getFinalIVValue();
-            llvm::BasicBlock *preHeader = L.getLoopPreheader();
-            llvm::IRBuilder<> preHeaderBuilder(preHeader->getTerminator());
-            // we now want to transform the loop to
-            // init = 0;
-            // step = 1;
-            // final = (oldFinal - oldInit) / oldStep + 1
-            // oldIV = newIV * oldStep + oldInit
-            llvm::Value *exitCount = preHeaderBuilder.CreateSDiv(
-                preHeaderBuilder.CreateNSWSub(finl, init), step);
-            // llvm::Value *tripCount = preHeaderBuilder.CreateNSWAdd(
-            //     exitCount, llvm::ConstantInt::get(exitCount->getType(), 1));
-            //  our new loop will be
-            //  for (auto newIV = 0; newIV != tripCount; ++newIV){
-            //    oldIV = newIV*oldStep + oldInit;
-            //    ...
-            //  }
-            //  llvm::BasicBlock *header = L.getHeader();
-            llvm::IRBuilder<> headerBuilder(oldIV);
-            auto *newIV =
-                headerBuilder.CreatePHI(exitCount->getType(), 2, "newIndVar");
-            // newIV->setIncomingValue(
-            //     0, llvm::ConstantInt::get(exitCount->getType(), 0));
-            // newIV->setIncomingBlock(0, preHeader);
-            newIV->addIncoming(llvm::ConstantInt::get(exitCount->getType(), 0),
-                               preHeader);
-            // 3 + x - 3
-            // 3 - 3 + x
-            llvm::Value *replacementIV;
-            if (isConstantIntZero(init)) {
-                replacementIV = headerBuilder.CreateNSWMul(newIV, step);
-            } else {
-                replacementIV = headerBuilder.CreateNSWAdd(
-                    headerBuilder.CreateNSWMul(newIV, step), init);
-            }
-            // from IndVarSimplify.cpp
-            llvm::ICmpInst::Predicate P;
-            if (L.contains(oldBI->getSuccessor(0)))
-                P = llvm::ICmpInst::ICMP_NE;
-            else
-                P = llvm::ICmpInst::ICMP_EQ;
-            llvm::IRBuilder<> latchBuilder(oldBI);
-            auto toCmp = latchBuilder.CreateNSWAdd(
-                newIV, llvm::ConstantInt::get(newIV->getType(), 1),
-                "incIndVar");
-            newIV->addIncoming(toCmp, latch);
-            auto newCmp = latchBuilder.CreateICmp(P, newIV, exitCount);
-            // Now, we must delete clean up some old cold.
-            // 1. Remove the old branch instruction.
-            // 2. Remove the old compare instruction, if it has no remaining
-            // uses.
-            // 3. replace all uses of oldIV with replacementIV
-            oldBI->setCondition(newCmp);
-            oldIV->replaceAllUsesWith(replacementIV);
-            oldIV->eraseFromParent();
-            llvm::errs() << "After replacement PreHeader:\n"
-                         << *preHeader << "\nHeader:\n"
-                         << *L.getHeader();
-            // oldCmp->replaceAllUsesWith(newCmp);
-        }
-        return false;
+        llvm::Type *type = c.oldIV->getType();
+        llvm::PHINode *newIV = llvm::PHINode::Create(
+            type, 2, "newIndVar", &L.getHeader()->front());
+        newIV->addIncoming(llvm::ConstantInt::get(type, 0), preHeader);
+        llvm::IRBuilder<> headerBuilder(&*L.getHeader()->getFirstInsertionPt());
+        llvm::Value *replacementIV = headerBuilder.CreateNSWMul(newIV, c.step);
+        if (!isConstantIntZero(c.init))
+            replacementIV = headerBuilder.CreateNSWAdd(replacementIV, c.init);
+        // from IndVarSimplify.cpp
+        llvm::ICmpInst::Predicate P;
+        if (L.contains(oldBI->getSuccessor(0)))
+            P = llvm::ICmpInst::ICMP_NE;
+        else
+            P = llvm::ICmpInst::ICMP_EQ;
+        llvm::IRBuilder<> latchBuilder(oldBI);
+        auto toCmp = latchBuilder.CreateNSWAdd(
+            newIV, llvm::ConstantInt::get(type, 1), "incIndVar");
+        newIV->addIncoming(toCmp, latch);
+        // 1. branch on the new compare,
+        // 2. replace all uses of oldIV with replacementIV,
+        // 3. delete the old compare and increment, if they are now dead.
+        llvm::Value *oldCond = oldBI->getCondition();
+        oldBI->setCondition(latchBuilder.CreateICmp(P, newIV, c.backedgeTaken));
+        c.oldIV->replaceAllUsesWith(replacementIV);
+        c.oldIV->eraseFromParent();
+        llvm::RecursivelyDeleteTriviallyDeadInstructions(oldCond);
     }
 };
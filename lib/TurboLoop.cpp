@@ -35,6 +35,20 @@
 
 llvm::PreservedAnalyses TurboLoopPass::run(llvm::Function &F,
                                            llvm::FunctionAnalysisManager &FAM) {
+    if (contextModule != F.getParent()) {
+        moduleContext = ModuleContext(*F.getParent());
+        contextModule = F.getParent();
+    }
+    TurboLoopTask task(F, moduleContext);
+    collect(task, FAM);
+    task.analyze();
+    return apply(task, FAM);
+}
+
+void TurboLoopPass::collect(TurboLoopTask &task,
+                            llvm::FunctionAnalysisManager &FAM) {
+    llvm::Function &F = *task.F;
+    FunctionContext &ctx = task.ctx;
     llvm::AssumptionCache &AC = FAM.getResult<llvm::AssumptionAnalysis>(F);
     std::cout << "Assumptions:" << std::endl;
     for (auto &a : AC.assumptions()) {
@@ -55,43 +69,43 @@ llvm::PreservedAnalyses TurboLoopPass::run(llvm::Function &F,
                          << "\nop1 valueID: " << op1->getValueID() << "\n";
             llvm::errs() << "op0 valueName: " << op0->getValueName()
                          << "\nop1 valueName: " << op1->getValueName() << "\n";
-            size_t op0posID = valueToPosetMap.push(op0);
-            size_t op1posID = valueToPosetMap.push(op1);
+            size_t op0posID = ctx.getSymbol(op0);
+            size_t op1posID = ctx.getSymbol(op1);
             llvm::errs() << "op0posID: " << op0posID
                          << "\nop1posID: " << op1posID << "\n";
             switch (icmp->getPredicate()) {
             case llvm::CmpInst::ICMP_ULT:
                 // op0 < op1
                 // 1 - 0
-                poset.push(0, op0posID, Interval::nonNegative());
-                poset.push(0, op1posID, Interval::nonNegative());
+                ctx.poset.push(0, op0posID, Interval::nonNegative());
+                ctx.poset.push(0, op1posID, Interval::nonNegative());
 		[[fallthrough]];
             case llvm::CmpInst::ICMP_SLT:
-                poset.push(op0posID, op1posID, Interval::positive());
+                ctx.poset.push(op0posID, op1posID, Interval::positive());
                 break;
             case llvm::CmpInst::ICMP_ULE:
-                poset.push(0, op0posID, Interval::nonNegative());
-                poset.push(0, op1posID, Interval::nonNegative());
+                ctx.poset.push(0, op0posID, Interval::nonNegative());
+                ctx.poset.push(0, op1posID, Interval::nonNegative());
 		[[fallthrough]];
             case llvm::CmpInst::ICMP_SLE:
-                poset.push(op0posID, op1posID, Interval::nonNegative());
+                ctx.poset.push(op0posID, op1posID, Interval::nonNegative());
                 break;
             case llvm::CmpInst::ICMP_EQ:
-                poset.push(op0posID, op1posID, Interval::zero());
+                ctx.poset.push(op0posID, op1posID, Interval::zero());
                 break;
             case llvm::CmpInst::ICMP_UGT:
-                poset.push(0, op0posID, Interval::nonNegative());
-                poset.push(0, op1posID, Interval::nonNegative());
+                ctx.poset.push(0, op0posID, Interval::nonNegative());
+                ctx.poset.push(0, op1posID, Interval::nonNegative());
 		[[fallthrough]];
             case llvm::CmpInst::ICMP_SGT:
-                poset.push(op0posID, op1posID, Interval::negative());
+                ctx.poset.push(op0posID, op1posID, Interval::negative());
                 break;
             case llvm::CmpInst::ICMP_UGE:
-                poset.push(0, op0posID, Interval::nonNegative());
-                poset.push(0, op1posID, Interval::nonNegative());
+                ctx.poset.push(0, op0posID, Interval::nonNegative());
+                ctx.poset.push(0, op1posID, Interval::nonNegative());
 		[[fallthrough]];
             case llvm::CmpInst::ICMP_SGE:
-                poset.push(op0posID, op1posID, Interval::nonPositive());
+                ctx.poset.push(op0posID, op1posID, Interval::nonPositive());
                 break;
             case llvm::CmpInst::ICMP_NE:
                 // we don't have a representation of this.
@@ -114,13 +128,17 @@ llvm::PreservedAnalyses TurboLoopPass::run(llvm::Function &F,
     // ClassID 0: ScalarRC
     // ClassID 1: RegisterRC
     // TLI = &FAM.getResult<llvm::TargetLibraryAnalysis>(F);
-    TTI = &FAM.getResult<llvm::TargetIRAnalysis>(F);
+    const llvm::TargetTransformInfo *TTI = task.TTI =
+        &FAM.getResult<llvm::TargetIRAnalysis>(F);
     llvm::errs() << "DataLayout: " << F.getParent()->getDataLayout().getStringRepresentation() << "\n";
-    std::cout << "Scalar registers: " << TTI->getNumberOfRegisters(0) << std::endl;
-    std::cout << "Vector registers: " << TTI->getNumberOfRegisters(1) << std::endl;
+    // the loop bodies we unroll-and-jam are expected to be vectorized, so
+    // budget the vector register class
+    task.registerCount = TTI->getNumberOfRegisters(
+        TTI->getRegisterClassForType(true));
 
-    LI = &FAM.getResult<llvm::LoopAnalysis>(F);
-    SE = &FAM.getResult<llvm::ScalarEvolutionAnalysis>(F);
+    llvm::LoopInfo *LI = task.LI = &FAM.getResult<llvm::LoopAnalysis>(F);
+    llvm::ScalarEvolution *SE = task.SE =
+        &FAM.getResult<llvm::ScalarEvolutionAnalysis>(F);
     // DL = &F.getParent()->getDataLayout();
 
     // llvm::SCEVExpander rewriter(*SE, F.getParent()->getDataLayout(),
@@ -281,10 +299,56 @@ llvm::PreservedAnalyses TurboLoopPass::run(llvm::Function &F,
             std::cout << "\n";
         }
     }
-    
+    AffineExtraction extraction(ctx, *SE, *LI, F.getParent()->getDataLayout(),
+                                task.lblock);
+    extraction.extract(F);
+    task.vectorWidth =
+        VectorizationModel::vectorWidth(*TTI, task.lblock.memory);
+}
+
+llvm::PreservedAnalyses TurboLoopPass::apply(TurboLoopTask &task,
+                                             llvm::FunctionAnalysisManager &) {
+    task.chooseVectorization();
+    if (!task.generateCode())
+        return llvm::PreservedAnalyses::all();
     return llvm::PreservedAnalyses::none();
-    // return llvm::PreservedAnalyses::all();
 }
+llvm::PreservedAnalyses
+TurboLoopModulePass::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
+    llvm::FunctionAnalysisManager &FAM =
+        MAM.getResult<llvm::FunctionAnalysisManagerModuleProxy>(M)
+            .getManager();
+    ModuleContext moduleContext(M);
+    // `deque` so that tasks don't move once constructed
+    std::deque<TurboLoopTask> tasks;
+    for (llvm::Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        pass.collect(tasks.emplace_back(F, moduleContext), FAM);
+    }
+    analyze(tasks, numThreads);
+    llvm::PreservedAnalyses PA = llvm::PreservedAnalyses::all();
+    for (TurboLoopTask &task : tasks) {
+        llvm::PreservedAnalyses FPA = pass.apply(task, FAM);
+        FAM.invalidate(*task.F, FPA);
+        PA.intersect(std::move(FPA));
+    }
+    // function analyses were invalidated above, as in
+    // `ModuleToFunctionPassAdaptor`
+    PA.preserveSet<llvm::AllAnalysesOn<llvm::Function>>();
+    PA.preserve<llvm::FunctionAnalysisManagerModuleProxy>();
+    return PA;
+}
+
+bool PipelineParsingCB(llvm::StringRef Name, llvm::ModulePassManager &MPM,
+                       llvm::ArrayRef<llvm::PassBuilder::PipelineElement>) {
+    if (Name == "turbo-loop") {
+        MPM.addPass(TurboLoopModulePass());
+        return true;
+    }
+    return false;
+}
+
 bool PipelineParsingCB(llvm::StringRef Name, llvm::FunctionPassManager &FPM,
                        llvm::ArrayRef<llvm::PassBuilder::PipelineElement>) {
     if (Name == "turbo-loop") {
@@ -298,7 +362,16 @@ bool PipelineParsingCB(llvm::StringRef Name, llvm::FunctionPassManager &FPM,
 }
 
 void RegisterCB(llvm::PassBuilder &PB) {
-    PB.registerPipelineParsingCallback(PipelineParsingCB);
+    PB.registerPipelineParsingCallback(
+        static_cast<bool (*)(
+            llvm::StringRef, llvm::ModulePassManager &,
+            llvm::ArrayRef<llvm::PassBuilder::PipelineElement>)>(
+            PipelineParsingCB));
+    PB.registerPipelineParsingCallback(
+        static_cast<bool (*)(
+            llvm::StringRef, llvm::FunctionPassManager &,
+            llvm::ArrayRef<llvm::PassBuilder::PipelineElement>)>(
+            PipelineParsingCB));
 }
 
 extern "C" ::llvm::PassPluginLibraryInfo LLVM_ATTRIBUTE_WEAK
@@ -23,3 +23,52 @@ TEST(BitSetTest, BasicAssertions) {
     EXPECT_EQ(j, bsc.size());
     EXPECT_EQ(j, length(bs));
 }
+
+TEST(BitSetReferenceTest, BasicAssertions) {
+    BitSet bs(200);
+    BitSet::Reference r{bs, 130};
+    EXPECT_FALSE(r);
+    r = true;
+    EXPECT_TRUE(r);
+    EXPECT_TRUE(contains(bs, 130));
+    EXPECT_EQ(length(bs), 1);
+    BitSet::Reference{bs, 3} = true;
+    EXPECT_EQ(length(bs), 2);
+    r = false;
+    EXPECT_FALSE(contains(bs, 130));
+    clear(bs);
+    EXPECT_EQ(length(bs), 0);
+    EXPECT_FALSE(contains(bs, 3));
+}
+
+TEST(BitSetAlgebraTest, BasicAssertions) {
+    BitSet a(300), b(130);
+    for (size_t x : {0, 63, 64, 127, 200, 299})
+        push(a, x);
+    for (size_t x : {1, 63, 127, 128})
+        push(b, x);
+    llvm::SmallVector<size_t> av;
+    for (auto I = a.begin(); I != a.end(); ++I)
+        av.push_back(*I);
+    EXPECT_EQ(av, (llvm::SmallVector<size_t>{0, 63, 64, 127, 200, 299}));
+    llvm::SmallVector<size_t> fv;
+    forEach(a, [&](size_t x) { fv.push_back(x); });
+    EXPECT_EQ(fv, av);
+
+    BitSet u = a | b, i = a & b, d = a - b;
+    EXPECT_EQ(length(u), 8);
+    EXPECT_EQ(popcount(u), 8);
+    EXPECT_EQ(length(i), 2);
+    EXPECT_TRUE(contains(i, 63) && contains(i, 127));
+    EXPECT_EQ(length(d), 4);
+    EXPECT_FALSE(contains(d, 63));
+    EXPECT_TRUE(contains(d, 299));
+    EXPECT_TRUE(isSubset(i, a));
+    EXPECT_TRUE(isSubset(i, b));
+    EXPECT_TRUE(isSubset(b, u));
+    EXPECT_FALSE(isSubset(a, b));
+    EXPECT_TRUE((d | i) == a);
+    BitSet e;
+    EXPECT_TRUE(e.begin() == e.end());
+    EXPECT_TRUE(isSubset(e, b));
+}
@@ -0,0 +1,417 @@
+#include "../include/CodeGen.hpp"
+#include "../include/Loops.hpp"
+#include "../include/Math.hpp"
+#include "../include/Schedule.hpp"
+#include "../include/Symbolics.hpp"
+#include "../include/TurboLoop.hpp"
+#include "../include/UnitStep.hpp"
+#include "MatrixStringParse.hpp"
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/GenericValue.h>
+#include <llvm/ExecutionEngine/Interpreter.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/SourceMgr.h>
+#include <memory>
+
+// The interpreter does not support `llvm.{s,u}{min,max}`, which the
+// `SCEVExpander` uses for the bounds.
+static void lowerMinMax(llvm::Function &F) {
+    llvm::SmallVector<llvm::IntrinsicInst *> calls;
+    for (auto &BB : F)
+        for (auto &I : BB)
+            if (auto II = llvm::dyn_cast<llvm::IntrinsicInst>(&I))
+                if (llvm::isa<llvm::MinMaxIntrinsic>(II))
+                    calls.push_back(II);
+    for (auto II : calls) {
+        llvm::IRBuilder<> b(II);
+        llvm::Value *x = II->getArgOperand(0), *y = II->getArgOperand(1);
+        llvm::Value *c = b.CreateICmp(
+            llvm::cast<llvm::MinMaxIntrinsic>(II)->getPredicate(), x, y);
+        II->replaceAllUsesWith(b.CreateSelect(c, x, y));
+        II->eraseFromParent();
+    }
+}
+
+// Emits `f(N)`, running `statements` over `loop`, where `N` is the only
+// symbol. Each statement adds `sum_i c_i * i_i` of the induction variables to
+// `@sum` and increments `@count`. Returns `{@count, @sum}` after calling it
+// with `N`.
+static std::pair<int64_t, int64_t>
+runNest(const AffineLoopNest &loop, llvm::ArrayRef<Schedule> schedules,
+        llvm::ArrayRef<int64_t> c, int64_t N, size_t *numLoops = nullptr) {
+    auto ctx = std::make_unique<llvm::LLVMContext>();
+    auto mod = std::make_unique<llvm::Module>("codegen", *ctx);
+    llvm::IntegerType *I64 = llvm::Type::getInt64Ty(*ctx);
+    auto newGlobal = [&](const char *name) {
+        return new llvm::GlobalVariable(*mod, I64, false,
+                                        llvm::GlobalValue::ExternalLinkage,
+                                        llvm::ConstantInt::get(I64, 0), name);
+    };
+    llvm::GlobalVariable *count = newGlobal("count");
+    llvm::GlobalVariable *sum = newGlobal("sum");
+    llvm::Function *F = llvm::Function::Create(
+        llvm::FunctionType::get(llvm::Type::getVoidTy(*ctx), {I64}, false),
+        llvm::GlobalValue::ExternalLinkage, "f", *mod);
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(*ctx, "entry", F));
+
+    llvm::TargetLibraryInfoImpl TLII;
+    llvm::TargetLibraryInfo TLI(TLII);
+    llvm::AssumptionCache AC(*F);
+    llvm::DominatorTree DT(*F);
+    llvm::LoopInfo LI(DT);
+    llvm::ScalarEvolution SE(*F, TLI, AC, DT, LI);
+    llvm::SCEVExpander expander(SE, mod->getDataLayout(), "codegen");
+    llvm::SmallVector<const llvm::SCEV *, 1> symbols{SE.getSCEV(F->getArg(0))};
+    LoopNestCodeGen codegen(SE, expander, I64, loop, symbols);
+
+    auto body = [&](llvm::IRBuilder<> &b, llvm::ArrayRef<llvm::Value *> ivs) {
+        llvm::Value *x = llvm::ConstantInt::get(I64, 0);
+        for (size_t i = 0; i < ivs.size(); ++i)
+            x = b.CreateAdd(x, b.CreateMul(ivs[i], b.getInt64(c[i])));
+        b.CreateStore(b.CreateAdd(b.CreateLoad(I64, sum), x), sum);
+        b.CreateStore(b.CreateAdd(b.CreateLoad(I64, count), b.getInt64(1)),
+                      count);
+    };
+    llvm::SmallVector<LoopNestCodeGen::Statement> statements;
+    for (auto &sch : schedules)
+        statements.push_back({&sch, body});
+    codegen.emit(builder, statements);
+    builder.CreateRetVoid();
+    expander.clear();
+    EXPECT_FALSE(llvm::verifyFunction(*F, &llvm::errs()));
+    if (numLoops) {
+        llvm::DominatorTree newDT(*F);
+        llvm::LoopInfo newLI(newDT);
+        *numLoops = newLI.getLoopsInPreorder().size();
+    }
+
+    lowerMinMax(*F);
+    LLVMLinkInInterpreter();
+    std::unique_ptr<llvm::ExecutionEngine> EE(
+        llvm::EngineBuilder(std::move(mod))
+            .setEngineKind(llvm::EngineKind::Interpreter)
+            .create());
+    llvm::GenericValue arg;
+    arg.IntVal = llvm::APInt(64, N);
+    EE->runFunction(F, {arg});
+    auto read = [&](llvm::GlobalVariable *g) {
+        return int64_t(
+            *static_cast<uint64_t *>(EE->getPointerToGlobal(g)));
+    };
+    return {read(count), read(sum)};
+}
+
+TEST(CodeGenTest, BasicAssertions) {
+    // for (m = 0; m < N; ++m)
+    //   for (n = 0; n <= m; ++n)
+    IntMatrix A{stringToIntMatrix("[0 0 1 0; -1 1 -1 0; 0 0 0 1; 0 0 1 -1]")};
+    auto loop = AffineLoopNest::construct(
+        A, {Polynomial::Monomial(Polynomial::ID{1})});
+    const int64_t N = 10;
+    // sum_{m<N} sum_{n<=m} 100*m + n
+    int64_t expectedSum = 0;
+    for (int64_t m = 0; m < N; ++m)
+        for (int64_t n = 0; n <= m; ++n)
+            expectedSum += 100 * m + n;
+    llvm::SmallVector<int64_t> c{100, 1};
+    Schedule sch(2);
+    size_t numLoops = 0;
+    auto [count, sum] = runNest(*loop, sch, c, N, &numLoops);
+    EXPECT_EQ(count, N * (N + 1) / 2);
+    EXPECT_EQ(sum, expectedSum);
+    EXPECT_EQ(numLoops, 2);
+
+    // interchanged: `n` outer, `m` from `n` to `N-1`
+    Schedule interchanged(2);
+    interchanged.getPhi()(0, 0) = 0;
+    interchanged.getPhi()(1, 1) = 0;
+    interchanged.getPhi()(0, 1) = 1;
+    interchanged.getPhi()(1, 0) = 1;
+    auto [countI, sumI] = runNest(*loop, interchanged, c, N);
+    EXPECT_EQ(countI, N * (N + 1) / 2);
+    EXPECT_EQ(sumI, expectedSum);
+
+    // two statements fused through the `m` loop, but not the `n` loop
+    Schedule s0(2), s1(2);
+    s1.getOmega()[2] = 1;
+    llvm::SmallVector<Schedule, 2> fused{s0, s1};
+    size_t numLoopsFused = 0;
+    auto [countF, sumF] = runNest(*loop, fused, c, N, &numLoopsFused);
+    EXPECT_EQ(countF, N * (N + 1));
+    EXPECT_EQ(sumF, 2 * expectedSum);
+    EXPECT_EQ(numLoopsFused, 3);
+
+    // tiling `m` by 4 requires dividing the bounds of the tile loop
+    llvm::SmallVector<int64_t> tileSizes{4, 0};
+    auto tiled = loop->tile(tileSizes);
+    Schedule tiledSch = sch.tile(tileSizes);
+    llvm::SmallVector<int64_t> cTiled{0, 100, 1};
+    auto [countT, sumT] = runNest(*tiled, tiledSch, cTiled, N);
+    EXPECT_EQ(countT, N * (N + 1) / 2);
+    EXPECT_EQ(sumT, expectedSum);
+    // the tile loop's index
+    llvm::SmallVector<int64_t> cTile{1, 0, 0};
+    auto [countT2, sumT2] = runNest(*tiled, tiledSch, cTile, N);
+    int64_t expectedTileSum = 0;
+    for (int64_t m = 0; m < N; ++m)
+        expectedTileSum += (m / 4) * (m + 1);
+    EXPECT_EQ(sumT2, expectedTileSum);
+}
+
+TEST(CodeGenMetadataTest, BasicAssertions) {
+    llvm::LLVMContext ctx;
+    Schedule sch(2);
+    EXPECT_EQ(LoopNestCodeGen::loopMetadata(ctx, sch, 1, true), nullptr);
+    sch.vectorized = 1;
+    sch.vectorWidth = 4;
+    sch.unrolledInner = 0;
+    sch.unrollFactorInner = 3;
+    llvm::MDNode *inner = LoopNestCodeGen::loopMetadata(ctx, sch, 1, true);
+    ASSERT_NE(inner, nullptr);
+    EXPECT_EQ(inner->getOperand(0), inner);
+    EXPECT_EQ(inner->getNumOperands(), 3);
+    llvm::MDNode *outer = LoopNestCodeGen::loopMetadata(ctx, sch, 0, false);
+    ASSERT_NE(outer, nullptr);
+    EXPECT_EQ(outer->getNumOperands(), 2);
+    auto *name = llvm::cast<llvm::MDString>(
+        llvm::cast<llvm::MDNode>(outer->getOperand(1))->getOperand(0));
+    EXPECT_EQ(name->getString(), "llvm.loop.unroll_and_jam.count");
+}
+
+// for (i = 0; i < N; i += 2)
+//   for (j = i; j < N; j += 3)
+//     sum += 1000*i + j;
+// The inner loop's `init` is the outer loop's IV.
+static const char *triangularStrided = R"(
+@sum = global i64 0
+define void @f(i64 %N) {
+entry:
+  %g = icmp sgt i64 %N, 0
+  br i1 %g, label %outer.ph, label %exit
+outer.ph:
+  br label %outer
+outer:
+  %i = phi i64 [ 0, %outer.ph ], [ %i.next, %latch ]
+  br label %inner.ph
+inner.ph:
+  br label %inner
+inner:
+  %j = phi i64 [ %i, %inner.ph ], [ %j.next, %inner ]
+  %s = load i64, i64* @sum
+  %ij = mul i64 %i, 1000
+  %t = add i64 %ij, %j
+  %s2 = add i64 %s, %t
+  store i64 %s2, i64* @sum
+  %j.next = add nuw nsw i64 %j, 3
+  %jc = icmp slt i64 %j.next, %N
+  br i1 %jc, label %inner, label %latch
+latch:
+  %i.next = add nuw nsw i64 %i, 2
+  %ic = icmp slt i64 %i.next, %N
+  br i1 %ic, label %outer, label %exit.l
+exit.l:
+  br label %exit
+exit:
+  ret void
+}
+)";
+
+// Parses `ir`, optionally runs `UnitStepPass` over `@f`, and returns `@sum`
+// after calling `f(N)`. The names of `@f`'s phis are written to `phis`.
+static int64_t runUnitStep(const char *ir, bool transform, int64_t N,
+                           llvm::SmallVectorImpl<std::string> *phis = nullptr) {
+    llvm::LLVMContext ctx;
+    llvm::SMDiagnostic err;
+    std::unique_ptr<llvm::Module> mod = llvm::parseAssemblyString(ir, err, ctx);
+    EXPECT_TRUE(mod);
+    if (transform) {
+        llvm::PassBuilder PB;
+        llvm::LoopAnalysisManager LAM;
+        llvm::FunctionAnalysisManager FAM;
+        llvm::CGSCCAnalysisManager CGAM;
+        llvm::ModuleAnalysisManager MAM;
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+        llvm::FunctionPassManager FPM;
+        FPM.addPass(llvm::createFunctionToLoopPassAdaptor(UnitStepPass()));
+        llvm::ModulePassManager MPM;
+        MPM.addPass(llvm::createModuleToFunctionPassAdaptor(std::move(FPM)));
+        MPM.run(*mod, MAM);
+    }
+    llvm::Function *F = mod->getFunction("f");
+    EXPECT_FALSE(llvm::verifyFunction(*F, &llvm::errs()));
+    if (phis)
+        for (auto &BB : *F)
+            for (auto &phi : BB.phis())
+                phis->push_back(phi.getName().str());
+    lowerMinMax(*F);
+    llvm::GlobalVariable *sum = mod->getGlobalVariable("sum");
+    std::unique_ptr<llvm::ExecutionEngine> EE(
+        llvm::EngineBuilder(std::move(mod))
+            .setEngineKind(llvm::EngineKind::Interpreter)
+            .create());
+    llvm::GenericValue arg;
+    arg.IntVal = llvm::APInt(64, N);
+    EE->runFunction(F, {arg});
+    return *static_cast<int64_t *>(EE->getPointerToGlobal(sum));
+}
+
+TEST(UnitStepTest, BasicAssertions) {
+    LLVMLinkInInterpreter();
+    for (int64_t N : {1, 2, 3, 4, 5, 7, 10, 13}) {
+        int64_t expectedSum = 0;
+        for (int64_t i = 0; i < N; i += 2)
+            for (int64_t j = i; j < N; j += 3)
+                expectedSum += 1000 * i + j;
+        EXPECT_EQ(runUnitStep(triangularStrided, false, N), expectedSum);
+        llvm::SmallVector<std::string> phis;
+        EXPECT_EQ(runUnitStep(triangularStrided, true, N, &phis), expectedSum);
+        // both old IVs are replaced, and the expander adds no canonical IV
+        size_t numNewIVs = 0;
+        for (const std::string &name : phis) {
+            EXPECT_NE(name, "i");
+            EXPECT_NE(name, "j");
+            EXPECT_NE(name.rfind("indvar", 0), 0);
+            numNewIVs += name.rfind("newIndVar", 0) == 0;
+        }
+        EXPECT_EQ(numNewIVs, 2);
+    }
+}
+
+// for (i = 0; i < N; ++i)
+//   for (j = 0; j < N; ++j)
+//     A[i*N + j] = B[j] * C[i];
+static const char *scaleNest = R"(
+@A = global [64 x i64] zeroinitializer
+@B = global [8 x i64] [i64 1, i64 2, i64 3, i64 4, i64 5, i64 6, i64 7, i64 8]
+@C = global [8 x i64] [i64 10, i64 20, i64 30, i64 40, i64 50, i64 60,
+                       i64 70, i64 80]
+define void @f(i64 %N) {
+entry:
+  %g = icmp sgt i64 %N, 0
+  br i1 %g, label %outer.ph, label %exit
+outer.ph:
+  br label %outer
+outer:
+  %i = phi i64 [ 0, %outer.ph ], [ %i.next, %latch ]
+  %iN = mul nsw i64 %i, %N
+  br label %inner
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %pb = getelementptr inbounds [8 x i64], [8 x i64]* @B, i64 0, i64 %j
+  %b = load i64, i64* %pb
+  %pc = getelementptr inbounds [8 x i64], [8 x i64]* @C, i64 0, i64 %i
+  %c = load i64, i64* %pc
+  %x = mul i64 %b, %c
+  %idx = add nsw i64 %iN, %j
+  %pa = getelementptr inbounds [64 x i64], [64 x i64]* @A, i64 0, i64 %idx
+  store i64 %x, i64* %pa
+  %j.next = add nuw nsw i64 %j, 1
+  %jc = icmp ne i64 %j.next, %N
+  br i1 %jc, label %inner, label %latch
+latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %ic = icmp ne i64 %i.next, %N
+  br i1 %ic, label %outer, label %exit.l
+exit.l:
+  br label %exit
+exit:
+  ret void
+}
+)";
+
+// Parses `ir` and runs `TurboLoopTask`'s stages over `@f`, with the nest's
+// unroll-and-jam and vectorization chosen only if `transform`. Returns `@A`
+// after calling `f(N)`. The number of loops after code generation is
+// written to `numLoops`, and whether any has vectorization metadata to
+// `vectorized`.
+static llvm::SmallVector<int64_t> runTurboLoop(const char *ir, bool transform,
+                                               int64_t N, size_t *numLoops,
+                                               bool *vectorized) {
+    llvm::LLVMContext ctx;
+    llvm::SMDiagnostic err;
+    std::unique_ptr<llvm::Module> mod = llvm::parseAssemblyString(ir, err, ctx);
+    EXPECT_TRUE(mod);
+    llvm::Function *F = mod->getFunction("f");
+    {
+        llvm::TargetLibraryInfoImpl TLII;
+        llvm::TargetLibraryInfo TLI(TLII);
+        llvm::AssumptionCache AC(*F);
+        llvm::DominatorTree DT(*F);
+        llvm::LoopInfo LI(DT);
+        llvm::ScalarEvolution SE(*F, TLI, AC, DT, LI);
+        ModuleContext module(*mod);
+        TurboLoopTask task(*F, module);
+        task.LI = &LI;
+        task.SE = &SE;
+        AffineExtraction extraction(task.ctx, SE, LI, mod->getDataLayout(),
+                                    task.lblock);
+        extraction.extract(*F);
+        EXPECT_EQ(task.lblock.memory.size(), 3);
+        if (transform) {
+            task.registerCount = 16;
+            task.analyze();
+            task.vectorWidth = 4;
+            task.chooseVectorization();
+        }
+        // nests without a transformation are left alone
+        EXPECT_EQ(task.generateCode(), transform);
+    }
+    EXPECT_FALSE(llvm::verifyFunction(*F, &llvm::errs()));
+    llvm::DominatorTree DT(*F);
+    llvm::LoopInfo LI(DT);
+    *numLoops = LI.getLoopsInPreorder().size();
+    *vectorized = false;
+    for (llvm::Loop *L : LI.getLoopsInPreorder())
+        *vectorized |= llvm::findStringMetadataForLoop(
+                           L, "llvm.loop.vectorize.width")
+                           .hasValue();
+    lowerMinMax(*F);
+    llvm::GlobalVariable *A = mod->getGlobalVariable("A");
+    std::unique_ptr<llvm::ExecutionEngine> EE(
+        llvm::EngineBuilder(std::move(mod))
+            .setEngineKind(llvm::EngineKind::Interpreter)
+            .create());
+    llvm::GenericValue arg;
+    arg.IntVal = llvm::APInt(64, N);
+    EE->runFunction(F, {arg});
+    auto *a = static_cast<int64_t *>(EE->getPointerToGlobal(A));
+    return llvm::SmallVector<int64_t>(a, a + 64);
+}
+
+TEST(TurboLoopCodeGenTest, BasicAssertions) {
+    LLVMLinkInInterpreter();
+    for (int64_t N : {1, 3, 8}) {
+        llvm::SmallVector<int64_t> expected(64, 0);
+        for (int64_t i = 0; i < N; ++i)
+            for (int64_t j = 0; j < N; ++j)
+                expected[i * N + j] = (j + 1) * (10 * (i + 1));
+        size_t numLoops = 0;
+        bool vectorized = true;
+        EXPECT_EQ(runTurboLoop(scaleNest, false, N, &numLoops, &vectorized),
+                  expected);
+        EXPECT_EQ(numLoops, 2);
+        EXPECT_FALSE(vectorized);
+        EXPECT_EQ(runTurboLoop(scaleNest, true, N, &numLoops, &vectorized),
+                  expected);
+        EXPECT_EQ(numLoops, 2);
+        EXPECT_TRUE(vectorized);
+    }
+}
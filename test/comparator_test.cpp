@@ -136,3 +136,22 @@ TEST(TestEmpty, BasicAssertions){
 }
 
 
+
+TEST(BatchCompare, BasicAssertions){
+    // rank deficient case from `BasicCompare`
+    IntMatrix A{stringToIntMatrix("[-1 0 1 0 0; 0 -1 1 0 0; 0 0 -1 1 0; 0 0 -1 0 1; -1 1 0 0 0; -2 -1 0 1 0]")};
+    auto comp = LinearSymbolicComparator::construct(A,false);
+    IntMatrix Q{stringToIntMatrix("[-1 0 0 0 1; 0 0 0 -1 1; -3 0 0 1 0; 0 0 0 1 -1; 0 -2 0 1 0]")};
+    llvm::SmallVector<bool> batch = comp.greaterEqual(Q);
+    ASSERT_EQ(batch.size(), Q.numRow());
+    // querying twice must agree, whether or not the warm start was used
+    for (size_t i = 0; i < Q.numRow(); ++i){
+        EXPECT_EQ(batch[i], comp.greaterEqual(Q.getRow(i)));
+        EXPECT_EQ(batch[i], comp.greaterEqual(Q.getRow(i)));
+    }
+    EXPECT_TRUE(batch[0]);
+    EXPECT_FALSE(batch[1]);
+    EXPECT_TRUE(batch[2]);
+    EXPECT_FALSE(batch[3]);
+    EXPECT_FALSE(batch[4]);
+}
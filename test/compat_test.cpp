@@ -96,6 +96,71 @@ TEST(LessTrivialPruneBounds, BasicAssertions) {
     EXPECT_EQ(loop0Count.second, 1);
 }
 
+TEST(SweepPruneBounds, BasicAssertions) {
+    // same systems as `TrivialPruneBounds` and `LessTrivialPruneBounds`,
+    // pruned with one LP per constraint instead of pairwise comparisons
+    auto A{stringToIntMatrix("[0 1 0; -1 1 -1; 0 0 1; -2 1 -1; 1 0 1]")};
+    llvm::SmallVector<Polynomial::Monomial> symbols{
+        Polynomial::Monomial(Polynomial::ID{1})};
+    auto affp{AffineLoopNest::construct(A, symbols)};
+    affp->pruneBounds(AffineLoopNest::Prune::Sweep);
+    EXPECT_EQ(affp->A, stringToIntMatrix("[0 0 1; -2 1 -1]"));
+
+    IntMatrix B{stringToIntMatrix("[-3 1 1 1 -1 -1 -1; "
+                                  "0 0 0 0 1 1 1; "
+                                  "-2 1 0 1 -1 0 -1; "
+                                  "0 0 0 0 1 0 1; "
+                                  "0 0 0 0 0 1 0; "
+                                  "-1 0 1 0 0 -1 0; "
+                                  "-1 1 0 0 -1 0 0; "
+                                  "0 0 0 0 1 0 0; "
+                                  "0 0 0 0 0 0 1; "
+                                  "-1 0 0 1 0 0 -1]")};
+    llvm::SmallVector<Polynomial::Monomial> symbols3{
+        Polynomial::Monomial(Polynomial::ID{1}),
+        Polynomial::Monomial(Polynomial::ID{2}),
+        Polynomial::Monomial(Polynomial::ID{3})};
+    auto affs{AffineLoopNest::construct(B, symbols3)};
+    affs->pruneBounds(AffineLoopNest::Prune::Sweep);
+    EXPECT_EQ(affs->A.numRow(), 6);
+    for (size_t v = 0; v < 3; ++v) {
+        auto count = affs->countSigns(affs->A, v + affs->getNumSymbols());
+        EXPECT_EQ(count.first, 1);
+        EXPECT_EQ(count.second, 1);
+    }
+
+    // x, y >= 0, x + y <= 4 imply x <= 6, y <= 5, x - y <= 4, and
+    // 2x + y <= 10, the last only through combining three constraints.
+    // Each LP starts from the basis the previous one ended in.
+    auto tri{AffineLoopNest::construct(
+        stringToIntMatrix("[0 1 0; 6 -1 0; 0 0 1; 5 0 -1; 4 -1 -1; "
+                          "10 -2 -1; 4 -1 1]"),
+        {})};
+    tri->pruneBounds(AffineLoopNest::Prune::Sweep);
+    EXPECT_EQ(tri->A, stringToIntMatrix("[0 1 0; 4 -1 -1; 0 0 1]"));
+}
+
+TEST(FourierMotzkinHistory, BasicAssertions) {
+    // 0 <= i <= N-1, i <= j <= N-1, j <= k <= N-1
+    IntMatrix A{stringToIntMatrix("[0 0 1 0 0; -1 1 -1 0 0; 0 0 -1 1 0; "
+                                  "-1 1 0 -1 0; 0 0 0 -1 1; -1 1 0 0 -1]")};
+    IntMatrix B{A};
+    fourierMotzkin(B, 2);
+    fourierMotzkin(B, 3);
+    // eliminating `i` and then `j` one at a time produces `N - 1 >= 0` twice
+    EXPECT_EQ(B.numRow(), 4);
+    llvm::SmallVector<size_t> vars{2, 3};
+    fourierMotzkin(A, vars);
+    EXPECT_EQ(A.numRow(), 3);
+    IntMatrix expected{stringToIntMatrix("[-1 1 0 0 0; -1 1 0 0 -1; 0 0 0 0 1]")};
+    for (size_t e = 0; e < expected.numRow(); ++e) {
+        bool found = false;
+        for (size_t r = 0; r < A.numRow(); ++r)
+            found |= (A.getRow(r) == expected.getRow(e));
+        EXPECT_TRUE(found);
+    }
+}
+
 TEST(AffineTest0, BasicAssertions) {
     std::cout << "Starting affine test 0" << std::endl;
     // the loop is
@@ -1,6 +1,10 @@
+#include "../include/ArrayContraction.hpp"
 #include "../include/ArrayReference.hpp"
+#include "../include/BitSets.hpp"
+#include "../include/CostModeling.hpp"
 #include "../include/DependencyPolyhedra.hpp"
 #include "../include/LoopBlock.hpp"
+#include "../include/LoopFusion.hpp"
 #include "../include/Math.hpp"
 #include "../include/Symbolics.hpp"
 #include "MatrixStringParse.hpp"
@@ -468,3 +472,376 @@ TEST(TriangularExampleTest, BasicAssertions) {
         EXPECT_EQ(reverse.depPoly.E(nonZeroInd, numSymbols + 4), -1);
     }
 }
+
+// for (m = 0; m < 256; ++m)
+//   for (n = 0; n < 256; ++n)
+//     for (k = 0; k < 256; ++k)
+//       C(m,n) += A(m,k) * B(k,n);
+struct MatMul {
+    IntMatrix Aloop;
+    llvm::IntrusiveRefCntPtr<AffineLoopNest> loop;
+    ArrayReference Cmn;
+    ArrayReference Amk;
+    ArrayReference Bkn;
+};
+static MatMul matmul() {
+    auto M = Polynomial::Monomial(Polynomial::ID{1});
+    auto K = Polynomial::Monomial(Polynomial::ID{2});
+    IntMatrix Aloop{stringToIntMatrix("[255 -1 0 0; 0 1 0 0; 255 0 -1 0; "
+                                      "0 0 1 0; 255 0 0 -1; 0 0 0 1]")};
+    auto loop = AffineLoopNest::construct(Aloop, {});
+    ArrayReference Cmn{0, loop, 2};
+    {
+        MutPtrMatrix<int64_t> IndMat = Cmn.indexMatrix();
+        IndMat(0, 0) = 1; // m
+        IndMat(1, 1) = 1; // n
+        Cmn.strides[0] = 1;
+        Cmn.strides[1] = M;
+    }
+    ArrayReference Amk{1, loop, 2};
+    {
+        MutPtrMatrix<int64_t> IndMat = Amk.indexMatrix();
+        IndMat(0, 0) = 1; // m
+        IndMat(2, 1) = 1; // k
+        Amk.strides[0] = 1;
+        Amk.strides[1] = M;
+    }
+    ArrayReference Bkn{2, loop, 2};
+    {
+        MutPtrMatrix<int64_t> IndMat = Bkn.indexMatrix();
+        IndMat(2, 0) = 1; // k
+        IndMat(1, 1) = 1; // n
+        Bkn.strides[0] = 1;
+        Bkn.strides[1] = K;
+    }
+    return MatMul{Aloop, loop, Cmn, Amk, Bkn};
+}
+
+TEST(TilingCostModelTest, BasicAssertions) {
+    auto [Aloop, loop, Cmn, Amk, Bkn] = matmul();
+    Schedule sch(3);
+    llvm::SmallVector<MemoryAccess, 4> memory;
+    memory.emplace_back(Cmn, nullptr, sch, true);
+    memory.emplace_back(Amk, nullptr, sch, true);
+    memory.emplace_back(Bkn, nullptr, sch, true);
+    memory.emplace_back(Cmn, nullptr, sch, false);
+
+    TilingCostModel model(*loop, memory);
+    // the load and store of `C` form one group
+    EXPECT_EQ(model.refs.size(), 3);
+    EXPECT_EQ(model.tripCounts, (llvm::SmallVector<int64_t>{256, 256, 256}));
+    // one `k` row: 1 line of `C`, 256 of `A`, and 256/8 of `B`
+    llvm::SmallVector<int64_t> row{1, 1, 256};
+    EXPECT_EQ(model.footprint(row), 1 + 256 + 32);
+    EXPECT_EQ(model.untiledCost(), 256 * 256 * (1 + 256 + 32));
+
+    llvm::SmallVector<int64_t> tileSizes = model.chooseTileSizes();
+    llvm::SmallVector<int64_t> tile{tileSizes};
+    size_t numTiled = 0;
+    for (size_t i = 0; i < tile.size(); ++i) {
+        numTiled += (tile[i] > 0);
+        if (tile[i] == 0)
+            tile[i] = model.tripCounts[i];
+    }
+    EXPECT_GT(numTiled, 0);
+    EXPECT_LE(model.footprint(tile), model.cache.cacheLines);
+    EXPECT_LT(10 * model.cost(tile), model.untiledCost());
+
+    auto tiled = loop->tile(tileSizes);
+    EXPECT_EQ(tiled->getNumLoops(), 3 + numTiled);
+    EXPECT_EQ(tiled->A.numRow(), Aloop.numRow() + 2 * numTiled);
+    Schedule tiledSch = sch.tile(tileSizes);
+    EXPECT_EQ(tiledSch.getNumLoops(), 3 + numTiled);
+    EXPECT_EQ(tiledSch.getPhi()(numTiled, numTiled), 1);
+    // tiling only `m` by 32: 32*t <= m <= 32*t + 31
+    llvm::SmallVector<int64_t> tileM{32, 0, 0};
+    auto tiledM = loop->tile(tileM);
+    IntMatrix expected{stringToIntMatrix(
+        "[255 0 -1 0 0; 0 0 1 0 0; 255 0 0 -1 0; 0 0 0 1 0; 255 0 0 0 -1; "
+        "0 0 0 0 1; 0 -32 1 0 0; 31 32 -1 0 0]")};
+    EXPECT_EQ(tiledM->A, expected);
+    // the tile loop is bounded through `m`
+    auto [lower, upper] = tiledM->bounds(1);
+    EXPECT_EQ(lower.numRow(), 1);
+    EXPECT_EQ(upper.numRow(), 1);
+}
+
+TEST(RegisterTilingModelTest, BasicAssertions) {
+    auto [Aloop, loop, Cmn, Amk, Bkn] = matmul();
+    Schedule sch(3);
+    llvm::SmallVector<MemoryAccess, 4> memory;
+    memory.emplace_back(Cmn, nullptr, sch, true);
+    memory.emplace_back(Amk, nullptr, sch, true);
+    memory.emplace_back(Bkn, nullptr, sch, true);
+    memory.emplace_back(Cmn, nullptr, sch, false);
+    // unroll-and-jam `m` and `n`, keeping the `C(m,n)` accumulators in
+    // registers across `k`
+    RegisterTilingModel regModel(*loop, memory, 16);
+    UnrollAndJam uj = regModel.choose();
+    EXPECT_EQ(uj.outer, 0);
+    EXPECT_EQ(uj.inner, 1);
+    EXPECT_EQ(uj.outerFactor, 3);
+    EXPECT_EQ(uj.innerFactor, 3);
+    EXPECT_EQ(uj.registers, 3 * 3 + 3 + 3);
+    UnrollAndJam uj32 = RegisterTilingModel(*loop, memory, 32).choose();
+    EXPECT_LE(uj32.registers, 32);
+    EXPECT_LT(uj32.memOpsPerIteration, uj.memOpsPerIteration);
+    Schedule unrolledSch = sch;
+    uj.apply(unrolledSch);
+    EXPECT_EQ(unrolledSch.unrolledOuter, 0);
+    EXPECT_EQ(unrolledSch.unrollFactorInner, 3);
+}
+
+TEST(VectorizationModelTest, BasicAssertions) {
+    auto [Aloop, loop, Cmn, Amk, Bkn] = matmul();
+    auto M = Polynomial::Monomial(Polynomial::ID{1});
+    EXPECT_EQ(VectorizationModel::pattern(Cmn, 0), AccessPattern::Contiguous);
+    EXPECT_EQ(VectorizationModel::pattern(Cmn, 1), AccessPattern::Gather);
+    EXPECT_EQ(VectorizationModel::pattern(Cmn, 2), AccessPattern::Invariant);
+    Schedule sch(3);
+    LoopBlock lblock;
+    lblock.memory.reserve(4);
+    lblock.memory.emplace_back(Cmn, nullptr, sch, true);
+    lblock.memory.emplace_back(Amk, nullptr, sch, true);
+    lblock.memory.emplace_back(Bkn, nullptr, sch, true);
+    // the store follows the loads in the body
+    Schedule schStore(3);
+    schStore.getOmega()[6] = 1;
+    lblock.memory.emplace_back(Cmn, nullptr, schStore, false);
+    lblock.fillEdges();
+    EXPECT_EQ(lblock.edges.size(), 2);
+
+    VectorizationModel model(*loop, lblock.memory, lblock.edges, 4);
+    // `k` carries the reduction into `C(m,n)`
+    EXPECT_TRUE(model.isLegal(0));
+    EXPECT_TRUE(model.isLegal(1));
+    EXPECT_FALSE(model.isLegal(2));
+    // along `m`, `C` and `A` are contiguous and `B` is invariant
+    Vectorization vec = model.choose();
+    EXPECT_EQ(vec.loop, 0);
+    EXPECT_EQ(vec.width, 4);
+    EXPECT_EQ(vec.cost, 0.75);
+    EXPECT_EQ(model.scalarCost(), 3.0);
+    for (auto &m : lblock.memory)
+        vec.apply(m.schedule);
+    EXPECT_EQ(lblock.memory.front().schedule.vectorized, 0);
+    EXPECT_EQ(lblock.memory.back().schedule.vectorWidth, 4);
+
+    // for (m = 0; m < 256; ++m)
+    //   for (n = 0; n < 256; ++n)
+    //     A(m+1,n) = 2*A(m,n);
+    IntMatrix Aloop2{
+        stringToIntMatrix("[255 -1 0; 0 1 0; 255 0 -1; 0 0 1]")};
+    auto loop2 = AffineLoopNest::construct(Aloop2, {});
+    ArrayReference Amn{0, loop2, 2};
+    {
+        MutPtrMatrix<int64_t> IndMat = Amn.indexMatrix();
+        IndMat(0, 0) = 1; // m
+        IndMat(1, 1) = 1; // n
+        Amn.strides[0] = 1;
+        Amn.strides[1] = M;
+    }
+    ArrayReference Amn1{Amn};
+    Amn1.offsetMatrix()(0, 0) = 1;
+    Schedule sch2(2);
+    LoopBlock lblock2;
+    lblock2.memory.reserve(2);
+    lblock2.memory.emplace_back(Amn, nullptr, sch2, true);
+    Schedule sch2Store(2);
+    sch2Store.getOmega()[4] = 1;
+    lblock2.memory.emplace_back(Amn1, nullptr, sch2Store, false);
+    lblock2.fillEdges();
+    VectorizationModel model2(*loop2, lblock2.memory, lblock2.edges, 4);
+    EXPECT_FALSE(model2.isLegal(0));
+    EXPECT_TRUE(model2.isLegal(1));
+    // `n` is legal, but only through gathers and scatters
+    EXPECT_EQ(model2.choose().loop, -1);
+}
+
+TEST(LoopFusionTest, BasicAssertions) {
+    // for (m = 0; m < 256; ++m)
+    //   for (n = 0; n < 256; ++n)
+    //     B(m,n) = A(m,n);
+    // for (m = 0; m < 256; ++m)
+    //   for (n = 0; n < 256; ++n)
+    //     C(m,n) = B(m,n+o);
+    auto M = Polynomial::Monomial(Polynomial::ID{1});
+    IntMatrix Aloop{
+        stringToIntMatrix("[255 -1 0; 0 1 0; 255 0 -1; 0 0 1]")};
+    auto loop0 = AffineLoopNest::construct(Aloop, {});
+    auto loop1 = AffineLoopNest::construct(Aloop, {});
+    auto ref = [&](unsigned id, llvm::IntrusiveRefCntPtr<AffineLoopNest> loop,
+                   int64_t offset) {
+        ArrayReference r{id, loop, 2};
+        MutPtrMatrix<int64_t> IndMat = r.indexMatrix();
+        IndMat(0, 0) = 1; // m
+        IndMat(1, 1) = 1; // n
+        r.strides[0] = M;
+        r.strides[1] = 1;
+        r.offsetMatrix()(1, 0) = offset;
+        return r;
+    };
+    auto sch = [](int64_t nest, int64_t stmt) {
+        Schedule s(2);
+        s.getOmega()[0] = nest;
+        s.getOmega()[4] = stmt;
+        return s;
+    };
+    for (int64_t o : {0, 1}) {
+        LoopBlock lblock;
+        lblock.memory.reserve(4);
+        lblock.memory.emplace_back(ref(0, loop0, 0), nullptr, sch(0, 0), true);
+        lblock.memory.emplace_back(ref(1, loop0, 0), nullptr, sch(0, 1),
+                                   false);
+        lblock.memory.emplace_back(ref(1, loop1, o), nullptr, sch(1, 0), true);
+        lblock.memory.emplace_back(ref(2, loop1, 0), nullptr, sch(1, 1),
+                                   false);
+        lblock.fillEdges();
+        EXPECT_EQ(lblock.edges.size(), 1);
+
+        LoopFusion fusion(lblock, 16);
+        EXPECT_EQ(fusion.clusters.size(), 2);
+        EXPECT_EQ(fusion.clusters[0].depth, 2);
+        // the store and load of `B`
+        EXPECT_EQ(fusion.reuse(fusion.clusters[0], fusion.clusters[1]), 2);
+        // too few registers for the three streams
+        EXPECT_EQ(LoopFusion(lblock, 2).fuse(), 0);
+        EXPECT_EQ(fusion.fuse(), 1);
+        EXPECT_EQ(fusion.clusters.size(), 1);
+        // reading `B(m,n+1)` before it is written prevents fusing `n`
+        const size_t d = o ? 1 : 2;
+        EXPECT_EQ(fusion.clusters[0].depth, d);
+        MemoryAccess &load = lblock.memory[2];
+        MemoryAccess &store = lblock.memory[3];
+        EXPECT_TRUE(load.fusedThrough(lblock.memory[1]) == (d == 2));
+        EXPECT_TRUE(load.schedule.fusedThrough(lblock.memory[1].schedule, d));
+        EXPECT_EQ(load.schedule.getOmega()[0], 0);
+        // fused through `n`, the statements follow those of the first nest;
+        // otherwise, the second `n` loop follows the first.
+        EXPECT_EQ(load.schedule.getOmega()[2 * d], d == 2 ? 2 : 1);
+        EXPECT_EQ(store.schedule.getOmega()[2 * d], d == 2 ? 3 : 1);
+    }
+    // `omega[0] == 2` leaves a gap for something unmodeled between the nests
+    {
+        LoopBlock lblock;
+        lblock.memory.reserve(4);
+        lblock.memory.emplace_back(ref(0, loop0, 0), nullptr, sch(0, 0), true);
+        lblock.memory.emplace_back(ref(1, loop0, 0), nullptr, sch(0, 1),
+                                   false);
+        lblock.memory.emplace_back(ref(1, loop1, 0), nullptr, sch(2, 0), true);
+        lblock.memory.emplace_back(ref(2, loop1, 0), nullptr, sch(2, 1),
+                                   false);
+        lblock.fillEdges();
+        LoopFusion fusion(lblock, 16);
+        EXPECT_EQ(fusion.clusters.size(), 2);
+        EXPECT_EQ(fusion.reuse(fusion.clusters[0], fusion.clusters[1]), 2);
+        EXPECT_FALSE(fusion.adjacent(0));
+        EXPECT_EQ(fusion.fuse(), 0);
+        EXPECT_EQ(fusion.clusters.size(), 2);
+        EXPECT_EQ(lblock.memory[2].schedule.getOmega()[0], 2);
+    }
+    // after fusing the first two of three consecutive nests, the third is
+    // still adjacent to the result
+    {
+        LoopBlock lblock;
+        lblock.memory.reserve(6);
+        for (int64_t n = 0; n < 3; ++n) {
+            auto loop = n == 1 ? loop1 : loop0;
+            lblock.memory.emplace_back(ref(n, loop, 0), nullptr, sch(n, 0),
+                                       true);
+            lblock.memory.emplace_back(ref(n + 1, loop, 0), nullptr,
+                                       sch(n, 1), false);
+        }
+        lblock.fillEdges();
+        LoopFusion fusion(lblock, 16);
+        EXPECT_EQ(fusion.clusters.size(), 3);
+        EXPECT_EQ(fusion.fuse(), 2);
+        EXPECT_EQ(fusion.clusters.size(), 1);
+    }
+}
+
+TEST(ArrayContractionTest, BasicAssertions) {
+    // for (m = 0; m < 256; ++m)
+    //   for (n = 0; n < 256; ++n)
+    //     B(m,n) = A(m,n);
+    // fused with
+    // for (m = 1; m < 256; ++m)
+    //   for (n = 1; n < 256; ++n)
+    //     C(m,n) = B(m+o_0,n+o_1) + ...;
+    auto M = Polynomial::Monomial(Polynomial::ID{1});
+    auto loop0 = AffineLoopNest::construct(
+        stringToIntMatrix("[255 -1 0; 0 1 0; 255 0 -1; 0 0 1]"), {});
+    auto loop1 = AffineLoopNest::construct(
+        stringToIntMatrix("[255 -1 0; -1 1 0; 255 0 -1; -1 0 1]"), {});
+    // `m` from `2`
+    auto loop2 = AffineLoopNest::construct(
+        stringToIntMatrix("[255 -1 0; -2 1 0; 255 0 -1; -1 0 1]"), {});
+    auto ref = [&](unsigned id, llvm::IntrusiveRefCntPtr<AffineLoopNest> loop,
+                   int64_t o0, int64_t o1) {
+        ArrayReference r{id, loop, 2};
+        MutPtrMatrix<int64_t> IndMat = r.indexMatrix();
+        IndMat(0, 0) = 1; // m
+        IndMat(1, 1) = 1; // n
+        r.strides[0] = M;
+        r.strides[1] = 1;
+        r.offsetMatrix()(0, 0) = o0;
+        r.offsetMatrix()(1, 0) = o1;
+        return r;
+    };
+    auto sch = [](int64_t stmt) {
+        Schedule s(2);
+        s.getOmega()[4] = stmt;
+        return s;
+    };
+    BitSet liveOut(3);
+    push(liveOut, 0);
+    push(liveOut, 2);
+    // loads of `B` at the given offsets; contracts `B`
+    auto contract =
+        [&](llvm::ArrayRef<std::pair<int64_t, int64_t>> offsets,
+            llvm::IntrusiveRefCntPtr<AffineLoopNest> loop = nullptr,
+            int64_t loadOrder = 2, int64_t maxWindow = 4) {
+            if (!loop)
+                loop = loop1;
+            LoopBlock lblock;
+            lblock.memory.reserve(offsets.size() + 3);
+            lblock.memory.emplace_back(ref(0, loop0, 0, 0), nullptr, sch(0),
+                                       true);
+            lblock.memory.emplace_back(ref(1, loop0, 0, 0), nullptr, sch(1),
+                                       false);
+            for (auto [o0, o1] : offsets)
+                lblock.memory.emplace_back(ref(1, loop, o0, o1), nullptr,
+                                           sch(loadOrder), true);
+            lblock.memory.emplace_back(ref(2, loop, 0, 0), nullptr, sch(3),
+                                       false);
+            size_t numContracted =
+                ArrayContraction(lblock, maxWindow).contract(liveOut);
+            EXPECT_FALSE(lblock.memory.front().ref.isContracted());
+            EXPECT_FALSE(lblock.memory.back().ref.isContracted());
+            for (auto &m : lblock.memory) {
+                if (m.ref.arrayID == 1) {
+                    EXPECT_EQ(m.ref.contraction,
+                              lblock.memory[1].ref.contraction);
+                }
+            }
+            EXPECT_EQ(numContracted, lblock.memory[1].ref.isContracted());
+            return lblock.memory[1].ref.contraction;
+        };
+    using Buffer = llvm::SmallVector<int64_t, 3>;
+    // rows `m-1` and `m` of `B`
+    EXPECT_EQ(contract({{0, 0}, {-1, 0}, {0, -1}}), (Buffer{2, 0}));
+    EXPECT_EQ(contract({{-2, 0}}, loop2), (Buffer{3, 0}));
+    EXPECT_EQ(contract({{-2, 0}}, loop2, 2, 2), Buffer{});
+    // elements `n-1` and `n` of the current row
+    EXPECT_EQ(contract({{0, 0}, {0, -1}}), (Buffer{1, 2}));
+    // scalar replacement
+    EXPECT_EQ(contract({{0, 0}}), (Buffer{1, 1}));
+    // `B(m,n+1)` is not yet stored
+    EXPECT_EQ(contract({{0, 0}, {0, 1}}), Buffer{});
+    // nor is `B(m,n)` if it is loaded before the store
+    EXPECT_EQ(contract({{0, 0}}, loop1, 0), Buffer{});
+    // `B(m,-1)` and `B(-1,n)` are not stored within the block
+    EXPECT_EQ(contract({{0, -1}}, loop0), Buffer{});
+    EXPECT_EQ(contract({{-2, 0}}), Buffer{});
+    EXPECT_EQ(contract({{0, 0}}, loop0), (Buffer{1, 1}));
+}
@@ -2,6 +2,8 @@
 #include "../include/DependencyPolyhedra.hpp"
 #include "../include/LoopBlock.hpp"
 #include "../include/Math.hpp"
+#include "../include/POSet.hpp"
+#include "../include/SubscriptTests.hpp"
 #include "../include/Symbolics.hpp"
 #include "Loops.hpp"
 #include "Macro.hpp"
@@ -108,10 +110,55 @@ TEST(DependenceTest, BasicAssertions) {
     EXPECT_EQ(dc.size(), 1);
     Dependence &d(dc.front());
     EXPECT_TRUE(d.forward);
+    // the distances settled the direction, so no Farkas system was built
+    EXPECT_FALSE(d.hasFarkas());
+    // nor is one needed to size the scheduling problem
+    EXPECT_EQ(d.getNumLambda(), 10);
+    EXPECT_FALSE(d.hasFarkas());
     std::cout << d << std::endl;
+    EXPECT_FALSE(d.hasFarkas());
+    d.buildFarkas();
+    EXPECT_TRUE(d.hasFarkas());
     assert(d.forward);
-    assert(!allZero(d.dependenceSatisfaction.tableau(
-        d.dependenceSatisfaction.tableau.numRow() - 1, _)));
+    assert(!allZero(d.getSatisfaction().tableau(
+        d.getSatisfaction().tableau.numRow() - 1, _)));
+    // the load of `A(i+1,j)` reads the value stored one `j` iteration before
+    EXPECT_TRUE(d.hasConstantDistance());
+    EXPECT_EQ(d.distance.size(), 2);
+    EXPECT_EQ(d.direction(0), Dependence::Direction::Equal);
+    EXPECT_EQ(d.direction(1), Dependence::Direction::Less);
+    EXPECT_EQ(d.distance[1].lowerBound, 1);
+    EXPECT_EQ(d.distance[1].upperBound, 1);
+    EXPECT_FALSE(d.mayCarry(0));
+    EXPECT_TRUE(d.mayCarry(1, 1));
+    EXPECT_FALSE(d.mayCarry(1, -1));
+    // interchange and skewing `j` by `i` keep `(0, 1)` positive; reversing
+    // `j` does not
+    EXPECT_EQ(d.isPreservedByPermutation({1, 0}), true);
+    EXPECT_EQ(d.isPreservedBy(stringToIntMatrix("[1 0; 1 1]")), true);
+    EXPECT_EQ(d.isPreservedBy(stringToIntMatrix("[1 0; 0 -1]")), false);
+    // both index equalities are substituted out of the Farkas systems
+    auto elim = dep0.eliminateEqualities();
+    EXPECT_EQ(elim.pivots.size(), 2);
+    EXPECT_EQ(dep0.getNumLambda(), 5);
+    auto fp = dep0.farkasPair();
+    EXPECT_EQ(fp.first.getNumConstraints(), dep0.A.numCol() - 2);
+    EXPECT_EQ(fp.second.getNumConstraints(), dep0.A.numCol() - 2);
+    EXPECT_EQ(fp.first.getNumVar(), 1 + dep0.getNumLambda() +
+                                        dep0.getNumScheduleCoefficients() +
+                                        dep0.getNumSymbols());
+    // and the eliminated variables are recovered from the others
+    Vector<int64_t> v;
+    v.resizeForOverwrite(dep0.A.numCol());
+    for (size_t k = 0; k < v.size(); ++k)
+        v(k) = k + 1;
+    EXPECT_TRUE(elim.expand(v));
+    for (size_t r = 0; r < dep0.E.numRow(); ++r) {
+        int64_t s = 0;
+        for (size_t k = 0; k < v.size(); ++k)
+            s += dep0.E(r, k) * v(k);
+        EXPECT_EQ(s, 0);
+    }
 }
 
 TEST(IndependentTest, BasicAssertions) {
@@ -536,6 +583,30 @@ TEST(TriangularExampleTest, BasicAssertions) {
         EXPECT_EQ(reverse.depPoly.E(nonZeroInd, numSymbols + 1), 1);
         EXPECT_EQ(reverse.depPoly.E(nonZeroInd, numSymbols + 4), -1);
     }
+    lblock.fillEdges();
+    // the load and store of `A[m,k]` in the inner loop form the only cycle
+    auto components = lblock.getComponents();
+    EXPECT_EQ(components.size(), lblock.memory.size() - 1);
+    llvm::SmallVector<size_t> componentOf(lblock.memory.size());
+    for (size_t c = 0; c < components.size(); ++c)
+        for (auto m : components[c])
+            componentOf[m] = c;
+    EXPECT_EQ(nv(lblock.graph), lblock.memory.size());
+    for (size_t m = 0; m < lblock.memory.size(); ++m) {
+        auto outs = lblock.graph.outNeighbors(m);
+        ASSERT_EQ(outs.size(), lblock.memory[m].edgesOut.size());
+        for (size_t k = 0; k < outs.size(); ++k)
+            EXPECT_EQ(outs[k], lblock.getIndex(
+                                   lblock.edges[lblock.memory[m].edgesOut[k]].out));
+    }
+    for (auto &e : lblock.edges)
+        EXPECT_LE(componentOf[lblock.getIndex(e.in)],
+                  componentOf[lblock.getIndex(e.out)]);
+    EXPECT_EQ(componentOf[7], componentOf[8]);
+    auto [numLambda, numBounding, numConstraints] =
+        lblock.countAuxParamsAndConstraints(components[componentOf[7]]);
+    EXPECT_GT(numConstraints, 0);
+    EXPECT_LT(numLambda, lblock.countNumLambdas());
     //
     // lblock.fillEdges();
     // std::cout << "Number of edges found: " << lblock.edges.size() <<
@@ -757,3 +828,177 @@ TEST(TimeHidingInRankDeficiency, BasicAssertions) {
               << deps[0] << "\nReverse:\n"
               << deps[1] << std::endl;
 }
+
+TEST(SubscriptTest, BasicAssertions) {
+    // for (i = 0:9), for (j = 0:9)
+    auto box{AffineLoopNest::construct(
+        stringToIntMatrix("[9 -1 0; 0 1 0; 9 0 -1; 0 0 1]"), {})};
+    // for (i = 0:I-2), for (j = 0:J-2)
+    auto I = Polynomial::Monomial(Polynomial::ID{1});
+    auto J = Polynomial::Monomial(Polynomial::ID{2});
+    auto symbolic{AffineLoopNest::construct(
+        stringToIntMatrix("[-2 1 0 -1 0; 0 0 0 1 0; -2 0 1 0 -1; 0 0 0 0 1]"),
+        {I, J})};
+    // `inds` is the index matrix (loops x dims), and `offs` the offsets
+    // (dims x symbols)
+    auto ref = [&](llvm::IntrusiveRefCntPtr<AffineLoopNest> loop,
+                   const char *inds, const char *offs) {
+        IntMatrix indMat{stringToIntMatrix(inds)};
+        IntMatrix offMat{stringToIntMatrix(offs)};
+        ArrayReference r(0, loop, indMat.numCol(), offMat.numCol() > 1);
+        r.indexMatrix() = indMat;
+        r.offsetMatrix() = offMat;
+        for (size_t d = 0; d < r.arrayDim(); ++d)
+            r.strides[d] = d ? I : Polynomial::Monomial{};
+        return r;
+    };
+    PartiallyOrderedSet none;
+    using Result = SubscriptTest::Result;
+    using Tier = SubscriptTest::Tier;
+    auto expect = [&](const ArrayReference &x, const ArrayReference &y,
+                      Result result, Tier tier,
+                      const PartiallyOrderedSet &poset) {
+        SubscriptTest::Outcome o = SubscriptTest::check(x, y, poset);
+        EXPECT_EQ(o.result, result);
+        EXPECT_EQ(o.tier, tier);
+    };
+    // A[0, j] vs A[1, j]
+    expect(ref(box, "[0 0; 0 1]", "[0; 0]"), ref(box, "[0 0; 0 1]", "[1; 0]"),
+           Result::Independent, Tier::ZIV, none);
+    // A[2i] vs A[2i + 1]
+    expect(ref(box, "[2; 0]", "[0]"), ref(box, "[2; 0]", "[1]"),
+           Result::Independent, Tier::GCD, none);
+    // A[i] vs A[i + 20], and A[i] vs A[15]
+    expect(ref(box, "[1; 0]", "[0]"), ref(box, "[1; 0]", "[20]"),
+           Result::Independent, Tier::SIV, none);
+    expect(ref(box, "[1; 0]", "[0]"), ref(box, "[0; 0]", "[15]"),
+           Result::Independent, Tier::SIV, none);
+    // A[i + j] vs A[i + j + 30]
+    expect(ref(box, "[1; 1]", "[0]"), ref(box, "[1; 1]", "[30]"),
+           Result::Independent, Tier::Banerjee, none);
+    // A[i + j] vs A[i + j + 18] may alias
+    expect(ref(box, "[1; 1]", "[0]"), ref(box, "[1; 1]", "[18]"),
+           Result::Unknown, Tier::None, none);
+    // A[i, j] vs A[i + 9, j + 1]
+    expect(ref(box, "[1 0; 0 1]", "[0; 0]"), ref(box, "[1 0; 0 1]", "[9; 1]"),
+           Result::Dependent, Tier::SIV, none);
+
+    // A[i] vs A[i + I] is independent as `i <= I - 2`
+    ArrayReference x = ref(symbolic, "[1; 0]", "[0 0 0]");
+    expect(x, ref(symbolic, "[1; 0]", "[0 1 0]"), Result::Independent,
+           Tier::Interval, none);
+    // A[i] vs A[i + J] needs `J >= I - 1`
+    ArrayReference y = ref(symbolic, "[1; 0]", "[0 0 1]");
+    expect(x, y, Result::Unknown, Tier::None, none);
+    // `I >= 20` and `J >= I`
+    PartiallyOrderedSet poset;
+    poset.push(0, 1, Interval::LowerBound(20));
+    poset.push(1, 2, Interval::LowerBound(0));
+    expect(x, y, Result::Independent, Tier::Interval, poset);
+    // A[i+1, j+1] vs A[i+1, j]
+    ArrayReference src = ref(symbolic, "[1 0; 0 1]", "[1; 1]");
+    ArrayReference tgt = ref(symbolic, "[1 0; 0 1]", "[1; 0]");
+    expect(src, tgt, Result::Unknown, Tier::None, none);
+    expect(src, tgt, Result::Dependent, Tier::SIV, poset);
+}
+
+TEST(DelinearizationTest, BasicAssertions) {
+    auto I = Polynomial::Monomial(Polynomial::ID{1});
+    auto J = Polynomial::Monomial(Polynomial::ID{2});
+    // for (i = 0:I-1), for (j = 0:J-1)
+    auto loop{AffineLoopNest::construct(
+        stringToIntMatrix("[-1 1 0 -1 0; 0 0 0 1 0; -1 0 1 0 -1; 0 0 0 0 1]"),
+        {I, J})};
+    // for (i = 0:I), for (j = 0:J-1)
+    auto wide{AffineLoopNest::construct(
+        stringToIntMatrix("[0 1 0 -1 0; 0 0 0 1 0; -1 0 1 0 -1; 0 0 0 0 1]"),
+        {I, J})};
+    auto ref = [&](llvm::IntrusiveRefCntPtr<AffineLoopNest> l,
+                   const char *inds, const char *offs,
+                   llvm::ArrayRef<MPoly> strides) {
+        IntMatrix indMat{stringToIntMatrix(inds)};
+        IntMatrix offMat{stringToIntMatrix(offs)};
+        ArrayReference r(0, l, indMat.numCol());
+        r.indexMatrix() = indMat;
+        r.offsetMatrix() = offMat;
+        for (size_t d = 0; d < r.arrayDim(); ++d)
+            r.strides[d] = strides[d];
+        return r;
+    };
+    MPoly one = Polynomial::Monomial{};
+    MPoly colI = I;
+    // A[i, j] vs A[j], the first row of `A`
+    ArrayReference Aij = ref(loop, "[1 0; 0 1]", "[0; 0]", {one, colI});
+    ArrayReference Aj = ref(loop, "[0; 1]", "[0]", {colI});
+    auto axes = DependencePolyhedra::matchingStrideConstraintPairs(Aij, Aj);
+    EXPECT_TRUE(axes.hasValue());
+    EXPECT_EQ(axes->size(), 2);
+    EXPECT_EQ((*axes)[0].dims0.size(), 1);
+    EXPECT_TRUE((*axes)[0].dims1.empty());
+    EXPECT_EQ((*axes)[1].dims1.size(), 1);
+
+    // A[i] with `A` linear vs A[i, j]; `i` is below `I` only in `loop`
+    EXPECT_TRUE(DependencePolyhedra::matchingStrideConstraintPairs(
+                    ref(loop, "[1; 0]", "[0]", {one}), Aij)
+                    .hasValue());
+    EXPECT_FALSE(DependencePolyhedra::matchingStrideConstraintPairs(
+                     ref(wide, "[1; 0]", "[0]", {one}), Aij)
+                     .hasValue());
+
+    // B[i, 2j] with strides `[1, I]` vs B[i, j] with `[1, 2I]`
+    ArrayReference B2j = ref(loop, "[1 0; 0 2]", "[0; 0]", {one, colI});
+    ArrayReference Bj = ref(loop, "[1 0; 0 1]", "[0; 0]", {one, 2 * colI});
+    axes = DependencePolyhedra::matchingStrideConstraintPairs(B2j, Bj);
+    EXPECT_TRUE(axes.hasValue());
+    EXPECT_EQ(axes->size(), 2);
+    EXPECT_EQ((*axes)[1].dims1.size(), 1);
+    EXPECT_EQ((*axes)[1].dims1[0].second, 2);
+    Schedule sch(2);
+    MemoryAccess mB2j{B2j, nullptr, sch, false};
+    MemoryAccess mBj{Bj, nullptr, sch, true};
+    DependencePolyhedra depB(mB2j, mBj);
+    // columns are `[1, I, J, i_0, j_0, i_1, j_1]`; `2j_0 == 2j_1`
+    EXPECT_EQ(depB.E(1, 4), 2);
+    EXPECT_EQ(depB.E(1, 6), -2);
+
+    // `I` and `J` do not divide one another, so nothing is matched, and
+    // the dependence is conservative
+    ArrayReference AJ = ref(loop, "[1 0; 0 1]", "[0; 0]", {one, MPoly{J}});
+    EXPECT_FALSE(DependencePolyhedra::matchingStrideConstraintPairs(Aij, AJ)
+                     .hasValue());
+    MemoryAccess mAij{Aij, nullptr, sch, false};
+    MemoryAccess mAJ{AJ, nullptr, sch, true};
+    EXPECT_FALSE(DependencePolyhedra(mAij, mAJ).isEmpty());
+}
+
+TEST(ParametricEmptinessTest, BasicAssertions) {
+    auto I = Polynomial::Monomial(Polynomial::ID{1});
+    auto J = Polynomial::Monomial(Polynomial::ID{2});
+    // for (i = 0:I-1)
+    //   A[i] = A[i + J];
+    auto loop{AffineLoopNest::construct(
+        stringToIntMatrix("[-1 1 0 -1; 0 0 0 1]"), {I, J})};
+    ArrayReference Ai(0, loop, 1);
+    Ai.indexMatrix()(0, 0) = 1;
+    Ai.strides[0] = 1;
+    ArrayReference AiJ(0, loop, 1, true);
+    AiJ.indexMatrix()(0, 0) = 1;
+    AiJ.offsetMatrix()(0, 2) = 1;
+    AiJ.strides[0] = 1;
+    Schedule schLoad(1);
+    Schedule schStore(1);
+    schStore.getOmega()[2] = 1;
+    MemoryAccess mstore{Ai, nullptr, schStore, false};
+    MemoryAccess mload{AiJ, nullptr, schLoad, true};
+    DependencePolyhedra dep(mstore, mload);
+    // `J >= I` rules out `i0 == i1 + J`, but only `poset` knows it
+    PartiallyOrderedSet poset;
+    poset.push(1, 2, Interval::nonNegative());
+    IntMatrix ctx = dep.symbolContext(poset);
+    EXPECT_EQ(ctx.numRow(), 1);
+    EXPECT_EQ(ctx(0, 1), -1);
+    EXPECT_EQ(ctx(0, 2), 1);
+    EXPECT_FALSE(dep.isEmpty());
+    EXPECT_FALSE(dep.isIntegerEmpty());
+    EXPECT_TRUE(dep.isIntegerEmpty(poset));
+}
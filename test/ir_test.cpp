@@ -1,10 +1,23 @@
+#include "../include/AffineExtraction.hpp"
 #include "../include/ArrayReference.hpp"
 #include "../include/Math.hpp"
+#include "../include/ModuleContext.hpp"
+#include "../include/TurboLoop.hpp"
+#include "MatrixStringParse.hpp"
 #include "llvm/ADT/SmallVector.h"
 #include <cstdint>
 #include <cstdio>
 #include <gtest/gtest.h>
 #include <llvm/ADT/ArrayRef.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
 #include <utility>
 
 TEST(IRTest, BasicAssertions) {
@@ -77,3 +90,366 @@ TEST(IRTest, BasicAssertions) {
     // std::cout << ar << std::endl;
     // std::cout << "sizeof(TermBundle): " << sizeof(TermBundle) << std::endl;
 }
+
+TEST(AffineExtractionTest, BasicAssertions) {
+    // for (i = 0; i < N; ++i)
+    //   for (j = 0; j < N; ++j)
+    //     A[i*N + j] = A[i*N + j + N];
+    // for (i = 0; i < N; ++i)
+    //   A[i*i] = 0.0;
+    // for (i = 0; i < N; ++i)
+    //   for (j = 0; j < N; ++j)
+    //     A[i*N + j + 1] = 0.0;
+    const char *ir = R"(
+define void @f(double* noalias %A, i64 %N) {
+entry:
+  %g = icmp sgt i64 %N, 0
+  br i1 %g, label %outer, label %mid
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+  %iN = mul nsw i64 %i, %N
+  br label %inner
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %idx = add nsw i64 %iN, %j
+  %idxN = add nsw i64 %idx, %N
+  %pl = getelementptr inbounds double, double* %A, i64 %idxN
+  %x = load double, double* %pl
+  %ps = getelementptr inbounds double, double* %A, i64 %idx
+  store double %x, double* %ps
+  %j.next = add nuw nsw i64 %j, 1
+  %jc = icmp ne i64 %j.next, %N
+  br i1 %jc, label %inner, label %latch
+latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %ic = icmp ne i64 %i.next, %N
+  br i1 %ic, label %outer, label %mid
+mid:
+  br i1 %g, label %sq, label %exit
+sq:
+  %k = phi i64 [ 0, %mid ], [ %k.next, %sq ]
+  %kk = mul nsw i64 %k, %k
+  %pk = getelementptr inbounds double, double* %A, i64 %kk
+  store double 0.0, double* %pk
+  %k.next = add nuw nsw i64 %k, 1
+  %kc = icmp ne i64 %k.next, %N
+  br i1 %kc, label %sq, label %wrap
+wrap:
+  br i1 %g, label %wouter, label %exit
+wouter:
+  %wi = phi i64 [ 0, %wrap ], [ %wi.next, %wlatch ]
+  %wiN = mul nsw i64 %wi, %N
+  br label %winner
+winner:
+  %wj = phi i64 [ 0, %wouter ], [ %wj.next, %winner ]
+  %widx = add nsw i64 %wiN, %wj
+  %widx1 = add nsw i64 %widx, 1
+  %pw = getelementptr inbounds double, double* %A, i64 %widx1
+  store double 0.0, double* %pw
+  %wj.next = add nuw nsw i64 %wj, 1
+  %wjc = icmp ne i64 %wj.next, %N
+  br i1 %wjc, label %winner, label %wlatch
+wlatch:
+  %wi.next = add nuw nsw i64 %wi, 1
+  %wic = icmp ne i64 %wi.next, %N
+  br i1 %wic, label %wouter, label %exit
+exit:
+  ret void
+}
+)";
+    llvm::LLVMContext ctx;
+    llvm::SMDiagnostic err;
+    std::unique_ptr<llvm::Module> mod = llvm::parseAssemblyString(ir, err, ctx);
+    ASSERT_TRUE(mod);
+    llvm::Function *F = mod->getFunction("f");
+    llvm::TargetLibraryInfoImpl TLII;
+    llvm::TargetLibraryInfo TLI(TLII);
+    llvm::AssumptionCache AC(*F);
+    llvm::DominatorTree DT(*F);
+    llvm::LoopInfo LI(DT);
+    llvm::ScalarEvolution SE(*F, TLI, AC, DT, LI);
+    ModuleContext module(*mod);
+    FunctionContext fctx(module);
+    LoopBlock lblock;
+    AffineExtraction extraction(fctx, SE, LI, mod->getDataLayout(), lblock);
+    extraction.extract(*F);
+    // `A[k*k]` is not affine, and `A[i*N + j + 1]` can't be split into
+    // `A[j + 1, i]`, as `j + 1` reaches `N`
+    EXPECT_EQ(extraction.numNests, 3);
+    EXPECT_EQ(extraction.numModeledNests, 1);
+    ASSERT_EQ(lblock.memory.size(), 2);
+    size_t N = fctx.getSymbol(F->getArg(1));
+    EXPECT_EQ(N, 1);
+    MemoryAccess &load = lblock.memory[0];
+    MemoryAccess &store = lblock.memory[1];
+    EXPECT_TRUE(load.isLoad);
+    EXPECT_FALSE(store.isLoad);
+    EXPECT_EQ(load.ref.loop, store.ref.loop);
+    const AffineLoopNest &loop = *load.ref.loop;
+    ASSERT_EQ(loop.symbols.size(), 1);
+    EXPECT_TRUE(loop.symbols[0] == Polynomial::Monomial(Polynomial::ID{1}));
+    EXPECT_EQ(loop.A, stringToIntMatrix("[0 0 1 0; -1 1 -1 0; "
+                                        "0 0 0 1; -1 1 0 -1]"));
+    // A[i + 1, j] with strides [1, N], i.e. `A[j, i + 1]`
+    ASSERT_EQ(load.ref.arrayDim(), 2);
+    EXPECT_TRUE(isOne(load.ref.strides[0]));
+    EXPECT_TRUE(load.ref.strides[1] ==
+                MPoly(Polynomial::Monomial(Polynomial::ID{1})));
+    EXPECT_EQ(load.ref.indexMatrix(), stringToIntMatrix("[0 1; 1 0]"));
+    EXPECT_EQ(store.ref.indexMatrix(), stringToIntMatrix("[0 1; 1 0]"));
+    EXPECT_EQ(load.ref.offsetMatrix()(0, 0), 0);
+    EXPECT_EQ(load.ref.offsetMatrix()(1, 0), 1);
+    EXPECT_EQ(store.ref.offsetMatrix()(0, 0), 0);
+    EXPECT_EQ(store.ref.offsetMatrix()(1, 0), 0);
+    EXPECT_EQ(load.schedule.getOmega()[4], 0);
+    EXPECT_EQ(store.schedule.getOmega()[4], 1);
+    EXPECT_TRUE(load.schedule.fusedThrough(store.schedule));
+    EXPECT_EQ(lblock.userToMemory.lookup(load.user), &load);
+    lblock.fillEdges();
+    EXPECT_FALSE(lblock.edges.empty());
+}
+
+// fills `task.lblock` as `TurboLoopPass::collect` does
+static void collect(TurboLoopTask &task) {
+    llvm::Function &F = *task.F;
+    llvm::TargetLibraryInfoImpl TLII;
+    llvm::TargetLibraryInfo TLI(TLII);
+    llvm::AssumptionCache AC(F);
+    llvm::DominatorTree DT(F);
+    llvm::LoopInfo LI(DT);
+    llvm::ScalarEvolution SE(F, TLI, AC, DT, LI);
+    AffineExtraction extraction(task.ctx, SE, LI,
+                                F.getParent()->getDataLayout(), task.lblock);
+    extraction.extract(F);
+}
+
+TEST(TurboLoopModuleTest, BasicAssertions) {
+    // @shift:  for (i = 0; i < 64; ++i) A[i] = A[i + M];
+    // @shift1: for (i = 0; i < 64; ++i) A[i] = A[i + 1];
+    // @stencil: for (i = 0; i < N; ++i)
+    //             for (j = 0; j < N; ++j)
+    //               A[i*N + j] = A[i*N + j + N];
+    // `M == 100` is a module constant, so only the module's poset knows that
+    // `@shift` has no dependence.
+    const char *ir = R"(
+@M = constant i64 100
+
+define void @shift(double* noalias %A) {
+entry:
+  %m = load i64, i64* @M
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %im = add nsw i64 %i, %m
+  %pl = getelementptr inbounds double, double* %A, i64 %im
+  %x = load double, double* %pl
+  %ps = getelementptr inbounds double, double* %A, i64 %i
+  store double %x, double* %ps
+  %i.next = add nuw nsw i64 %i, 1
+  %c = icmp ne i64 %i.next, 64
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+define void @shift1(double* noalias %A) {
+entry:
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %i1 = add nsw i64 %i, 1
+  %pl = getelementptr inbounds double, double* %A, i64 %i1
+  %x = load double, double* %pl
+  %ps = getelementptr inbounds double, double* %A, i64 %i
+  store double %x, double* %ps
+  %i.next = add nuw nsw i64 %i, 1
+  %c = icmp ne i64 %i.next, 64
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+define void @stencil(double* noalias %A, i64 %N) {
+entry:
+  %g = icmp sgt i64 %N, 0
+  br i1 %g, label %outer, label %exit
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+  %iN = mul nsw i64 %i, %N
+  br label %inner
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %idx = add nsw i64 %iN, %j
+  %idxN = add nsw i64 %idx, %N
+  %pl = getelementptr inbounds double, double* %A, i64 %idxN
+  %x = load double, double* %pl
+  %ps = getelementptr inbounds double, double* %A, i64 %idx
+  store double %x, double* %ps
+  %j.next = add nuw nsw i64 %j, 1
+  %jc = icmp ne i64 %j.next, %N
+  br i1 %jc, label %inner, label %latch
+latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %ic = icmp ne i64 %i.next, %N
+  br i1 %ic, label %outer, label %exit
+exit:
+  ret void
+}
+)";
+    llvm::LLVMContext ctx;
+    llvm::SMDiagnostic err;
+    std::unique_ptr<llvm::Module> mod = llvm::parseAssemblyString(ir, err, ctx);
+    ASSERT_TRUE(mod);
+    ModuleContext module(*mod);
+    auto run = [&](unsigned numThreads) {
+        std::deque<TurboLoopTask> tasks;
+        for (llvm::Function &F : *mod)
+            collect(tasks.emplace_back(F, module));
+        if (numThreads)
+            TurboLoopModulePass::analyze(tasks, numThreads);
+        else
+            for (TurboLoopTask &task : tasks)
+                task.analyze();
+        return tasks;
+    };
+    std::deque<TurboLoopTask> serial = run(0);
+    ASSERT_EQ(serial.size(), 3);
+    for (TurboLoopTask &task : serial)
+        EXPECT_EQ(task.lblock.memory.size(), 2);
+    EXPECT_TRUE(serial[0].lblock.edges.empty());
+    EXPECT_FALSE(serial[1].lblock.edges.empty());
+    EXPECT_FALSE(serial[2].lblock.edges.empty());
+    for (size_t rep = 0; rep < 8; ++rep) {
+        std::deque<TurboLoopTask> pooled = run(4);
+        ASSERT_EQ(pooled.size(), serial.size());
+        for (size_t t = 0; t < serial.size(); ++t) {
+            LoopBlock &s = serial[t].lblock;
+            LoopBlock &p = pooled[t].lblock;
+            EXPECT_EQ(serial[t].components, pooled[t].components);
+            ASSERT_EQ(s.edges.size(), p.edges.size());
+            for (size_t e = 0; e < s.edges.size(); ++e) {
+                EXPECT_EQ(s.edges[e].in - s.memory.data(),
+                          p.edges[e].in - p.memory.data());
+                EXPECT_EQ(s.edges[e].out - s.memory.data(),
+                          p.edges[e].out - p.memory.data());
+                EXPECT_EQ(s.edges[e].forward, p.edges[e].forward);
+                ASSERT_EQ(s.edges[e].distance.size(),
+                          p.edges[e].distance.size());
+                for (size_t l = 0; l < s.edges[e].distance.size(); ++l) {
+                    EXPECT_EQ(s.edges[e].distance[l].lowerBound,
+                              p.edges[e].distance[l].lowerBound);
+                    EXPECT_EQ(s.edges[e].distance[l].upperBound,
+                              p.edges[e].distance[l].upperBound);
+                }
+            }
+        }
+    }
+}
+
+TEST(TurboLoopScheduleTest, BasicAssertions) {
+    // @scale: for (i = 0; i < N; ++i)
+    //           for (j = 0; j < N; ++j)
+    //             A[i*N + j] = B[j] * C[i];
+    // @skew:  for (i = 0; i < N; ++i)
+    //           for (j = 1; j < N; ++j)
+    //             A[i*N + j] = A[i*N + j - 1 + N] * B[j];
+    const char *ir = R"(
+define void @scale(double* noalias %A, double* noalias %B,
+                   double* noalias %C, i64 %N) {
+entry:
+  %g = icmp sgt i64 %N, 0
+  br i1 %g, label %outer, label %exit
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+  %iN = mul nsw i64 %i, %N
+  br label %inner
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %pb = getelementptr inbounds double, double* %B, i64 %j
+  %b = load double, double* %pb
+  %pc = getelementptr inbounds double, double* %C, i64 %i
+  %c = load double, double* %pc
+  %x = fmul double %b, %c
+  %idx = add nsw i64 %iN, %j
+  %pa = getelementptr inbounds double, double* %A, i64 %idx
+  store double %x, double* %pa
+  %j.next = add nuw nsw i64 %j, 1
+  %jc = icmp ne i64 %j.next, %N
+  br i1 %jc, label %inner, label %latch
+latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %ic = icmp ne i64 %i.next, %N
+  br i1 %ic, label %outer, label %exit
+exit:
+  ret void
+}
+
+define void @skew(double* noalias %A, double* noalias %B, i64 %N) {
+entry:
+  %g = icmp sgt i64 %N, 1
+  br i1 %g, label %outer, label %exit
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+  %iN = mul nsw i64 %i, %N
+  br label %inner
+inner:
+  %j = phi i64 [ 1, %outer ], [ %j.next, %inner ]
+  %pb = getelementptr inbounds double, double* %B, i64 %j
+  %b = load double, double* %pb
+  %idx = add nsw i64 %iN, %j
+  %jm = add nsw i64 %idx, -1
+  %idxl = add nsw i64 %jm, %N
+  %pl = getelementptr inbounds double, double* %A, i64 %idxl
+  %a = load double, double* %pl
+  %x = fmul double %a, %b
+  %pa = getelementptr inbounds double, double* %A, i64 %idx
+  store double %x, double* %pa
+  %j.next = add nuw nsw i64 %j, 1
+  %jc = icmp ne i64 %j.next, %N
+  br i1 %jc, label %inner, label %latch
+latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %ic = icmp ne i64 %i.next, %N
+  br i1 %ic, label %outer, label %exit
+exit:
+  ret void
+}
+)";
+    llvm::LLVMContext ctx;
+    llvm::SMDiagnostic err;
+    std::unique_ptr<llvm::Module> mod = llvm::parseAssemblyString(ir, err, ctx);
+    ASSERT_TRUE(mod);
+    ModuleContext module(*mod);
+    TurboLoopTask task(*mod->getFunction("scale"), module);
+    collect(task);
+    ASSERT_EQ(task.lblock.memory.size(), 3);
+    // unrolling `i` by `u` keeps `C[i]` in `u` registers and loads `B[j]`
+    // once for `u` stores, so with 16 registers `2u + 1 <= 16` gives `u = 7`
+    task.registerCount = 16;
+    task.analyze();
+    for (auto &m : task.lblock.memory) {
+        EXPECT_EQ(m.schedule.unrolledOuter, -1);
+        EXPECT_EQ(m.schedule.unrolledInner, 0);
+        EXPECT_EQ(m.schedule.unrollFactorInner, 7);
+    }
+    // `A` and `B` are contiguous in `j`, and `C[i]` is invariant in it,
+    // while `A` is strided in `i`
+    task.vectorWidth = 4;
+    task.chooseVectorization();
+    for (auto &m : task.lblock.memory) {
+        EXPECT_EQ(m.schedule.vectorized, 1);
+        EXPECT_EQ(m.schedule.vectorWidth, 4);
+    }
+    // `A[i*N + j - 1 + N]` is read one `i` before it is written, one `j`
+    // later, so interleaving the `i` iterations would overwrite it first
+    TurboLoopTask skew(*mod->getFunction("skew"), module);
+    collect(skew);
+    ASSERT_EQ(skew.lblock.memory.size(), 3);
+    skew.registerCount = 16;
+    skew.analyze();
+    ASSERT_FALSE(skew.lblock.edges.empty());
+    for (auto &m : skew.lblock.memory) {
+        EXPECT_EQ(m.schedule.unrolledOuter, -1);
+        EXPECT_EQ(m.schedule.unrolledInner, -1);
+    }
+}
@@ -1,6 +1,10 @@
+#include "../include/ModuleContext.hpp"
 #include "../include/POSet.hpp"
 #include <cstdio>
 #include <gtest/gtest.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
 
 TEST(POSet0, BasicAssertions) {
     PartiallyOrderedSet poset;
@@ -117,3 +121,47 @@ TEST(PolynomialCmp, BasicAssertions) {
     EXPECT_TRUE(poset.knownGreaterEqualZero(3 - P));
     EXPECT_FALSE(poset.knownGreaterEqualZero(2 - P));
 }
+
+TEST(ModuleContextTest, BasicAssertions) {
+    llvm::LLVMContext ctx;
+    llvm::Module M("mod", ctx);
+    llvm::Type *i64 = llvm::Type::getInt64Ty(ctx);
+    auto *N = new llvm::GlobalVariable(M, i64, true,
+                                       llvm::GlobalValue::InternalLinkage,
+                                       llvm::ConstantInt::get(i64, 10), "N");
+    auto *K = new llvm::GlobalVariable(M, i64, false,
+                                       llvm::GlobalValue::InternalLinkage,
+                                       llvm::ConstantInt::get(i64, 3), "K");
+    ModuleContext module(M);
+    EXPECT_EQ(module.getNumSymbols(), 1);
+    EXPECT_EQ(module.poset(module.symbols.getForward(N)).lowerBound, 10);
+    EXPECT_EQ(module.poset(module.symbols.getForward(N)).upperBound, 10);
+
+    llvm::SmallVector<llvm::Value *> loads;
+    for (const char *name : {"f", "g"}) {
+        llvm::Function *F = llvm::Function::Create(
+            llvm::FunctionType::get(i64, false),
+            llvm::GlobalValue::ExternalLinkage, name, M);
+        llvm::IRBuilder<> builder(llvm::BasicBlock::Create(ctx, "entry", F));
+        llvm::Value *n = builder.CreateLoad(i64, N);
+        llvm::Value *k = builder.CreateLoad(i64, K);
+        builder.CreateRet(builder.CreateAdd(n, k));
+        loads.push_back(n);
+        loads.push_back(k);
+    }
+    FunctionContext f(module), g(module);
+    size_t nf = f.getSymbol(loads[0]);
+    EXPECT_EQ(nf, module.symbols.getForward(N));
+    EXPECT_EQ(g.getSymbol(loads[2]), nf);
+    EXPECT_EQ(f.poset(nf).lowerBound, 10);
+    // `K` isn't constant, so each load is its own symbol
+    size_t kf = f.getSymbol(loads[1]);
+    EXPECT_EQ(kf, 2);
+    EXPECT_EQ(f.getSymbol(loads[1]), kf);
+    // facts from one function don't leak into the module or other functions
+    f.poset.push(nf, kf, Interval::positive());
+    EXPECT_EQ(f.poset.nVar, 3);
+    EXPECT_EQ(module.poset.nVar, 2);
+    EXPECT_EQ(g.poset.nVar, 2);
+    EXPECT_EQ(g.getSymbol(loads[3]), 2);
+}
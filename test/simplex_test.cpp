@@ -1,3 +1,5 @@
+#include "../include/ILPConstraintElimination.hpp"
+#include "../include/PIP.hpp"
 #include "../include/Simplex.hpp"
 #include "Math.hpp"
 #include "MatrixStringParse.hpp"
@@ -19,3 +21,129 @@ TEST(SimplexTest, BasicAssertions){
     std::cout << "S.tableau =" << S.tableau << std::endl;
     EXPECT_EQ(S.run(), 20);
 }
+
+TEST(ILPRedundancyTest, BasicAssertions){
+    // x >= 0; 1 - 2x >= 0; -x >= 0; 5 - x >= 0
+    // over the rationals, `-x >= 0` is not implied, but over the integers
+    // `1 - 2x >= 0` tightens to `-x >= 0`, which makes `5 - x >= 0` redundant
+    IntMatrix A{stringToIntMatrix("[0 1; 1 -2; 0 -1; 5 -1]")};
+    IntegerRedundancyChecker checker{A};
+    EXPECT_FALSE(checker.isRedundant(A, 0));
+    EXPECT_TRUE(checker.isRedundant(A, 2));
+    EXPECT_TRUE(checker.isRedundant(A, 3));
+    pruneBoundsILP(A);
+    EXPECT_EQ(A.numRow(), 2);
+    EXPECT_EQ(A(0, _), stringToIntMatrix("[0 1]")(0, _));
+    // i >= 0, j >= 0, N - i - j >= 0; i + j == N; N - i >= 0 is implied
+    IntMatrix B{stringToIntMatrix("[0 0 1 0; 0 0 0 1; 0 1 -1 -1; 0 1 -1 0]")};
+    IntMatrix E{stringToIntMatrix("[0 -1 1 1]")};
+    pruneBoundsILP(B, E);
+    EXPECT_EQ(B.numRow(), 2);
+}
+
+TEST(BatchedSatisfiableTest, BasicAssertions){
+    // 3x + 2y + z <= 10; 2x + 5y + 3z <= 15
+    IntMatrix A{stringToIntMatrix("[10 3 2 1; 15 2 5 3]")};
+    IntMatrix B{0,4};
+    llvm::Optional<Simplex> optS{Simplex::positiveVariables(A, B)};
+    ASSERT_TRUE(optS.hasValue());
+    Simplex &S{optS.getValue()};
+    // fix `x` and `y`; the two slack variables come first
+    IntMatrix X{stringToIntMatrix("[0 0; 1 1; 3 0; 4 0; 0 3; 1 3; -1 0]")};
+    llvm::SmallVector<bool> unsat{S.unSatisfiable(X, 2)};
+    llvm::SmallVector<bool> expected{false, false, false, true, false, true, true};
+    ASSERT_EQ(unsat.size(), X.numRow());
+    for (size_t i = 0; i < X.numRow(); ++i) {
+        EXPECT_EQ(unsat[i], expected[i]);
+        EXPECT_EQ(unsat[i], S.unSatisfiable(X.getRow(i), 2));
+    }
+    llvm::SmallVector<bool> zr{S.unSatisfiableZeroRem(X, 2, 2)};
+    for (size_t i = 0; i < X.numRow(); ++i)
+        EXPECT_EQ(zr[i], S.unSatisfiableZeroRem(X.getRow(i), 2, 2));
+}
+TEST(ScratchSatisfiableTest, BasicAssertions){
+    // 3x + 2y + z <= 10; 2x + 5y + 3z <= 15; x + y + z == 4
+    IntMatrix A{stringToIntMatrix("[10 3 2 1; 15 2 5 3]")};
+    IntMatrix B{stringToIntMatrix("[4 1 1 1]")};
+    llvm::Optional<Simplex> optS{Simplex::positiveVariables(A, B)};
+    ASSERT_TRUE(optS.hasValue());
+    Simplex &S{optS.getValue()};
+    IntMatrix X{stringToIntMatrix("[0 0; 1 1; 3 0; 4 0; 0 3; 1 3; -1 0]")};
+    llvm::SmallVector<bool> expected{false, false, false, true, true, true, true};
+    // one scratch simplex, reused for queries of differing shapes
+    Simplex sub;
+    for (size_t i = 0; i < X.numRow(); ++i) {
+        EXPECT_EQ(S.unSatisfiable(sub, X.getRow(i), 2), expected[i]);
+        EXPECT_EQ(S.unSatisfiable(sub, X(i, _(0, 1)), 2),
+                  S.unSatisfiable(X(i, _(0, 1)), 2));
+        EXPECT_EQ(S.unSatisfiableZeroRem(sub, X.getRow(i), 2, 2),
+                  S.unSatisfiableZeroRem(X.getRow(i), 2, 2));
+    }
+}
+TEST(PIPTest, BasicAssertions){
+    IntMatrix noContext{0, 2};
+    // x >= p, x >= 0: min is `max(p, 0)`, in two pieces
+    IntMatrix A{stringToIntMatrix("[0 -1 1; 0 0 1]")};
+    IntMatrix E{0, 3};
+    PIP pmax(A, E, noContext, 1);
+    EXPECT_TRUE(pmax.complete);
+    EXPECT_EQ(pmax.pieces.size(), 2);
+    for (int64_t p = -4; p <= 4; ++p) {
+        auto x = pmax.lexMin({p});
+        ASSERT_TRUE(x.hasValue());
+        EXPECT_EQ((*x)[0], std::max(p, int64_t(0)));
+    }
+    // 2x >= p: min is `ceil(p/2)`, which needs a div
+    IntMatrix B{stringToIntMatrix("[0 -1 2]")};
+    PIP pceil(B, E, noContext, 1);
+    EXPECT_TRUE(pceil.complete);
+    for (int64_t p = -5; p <= 5; ++p) {
+        auto x = pceil.lexMin({p});
+        ASSERT_TRUE(x.hasValue());
+        EXPECT_EQ((*x)[0], PIP::floorDiv(p + 1, 2));
+    }
+    // 0 <= i, j <= N - 1, 2i == 2j + 1: rationally, but not integer, feasible
+    IntMatrix C{stringToIntMatrix("[0 0 1 0; -1 1 -1 0; 0 0 0 1; -1 1 0 -1]")};
+    IntMatrix F{stringToIntMatrix("[-1 0 2 -2]")};
+    IntMatrix C2{C}, F2{F};
+    EXPECT_FALSE(rationallyEmpty(C2, F2));
+    EXPECT_TRUE(PIP(C, F, noContext, 1).isEmpty());
+    // 0 <= i <= N - 1, i == 5: empty iff N <= 5
+    IntMatrix D{stringToIntMatrix("[0 0 1; -1 1 -1]")};
+    IntMatrix G{stringToIntMatrix("[-5 0 1]")};
+    PIP pdep(D, G, noContext, 1);
+    EXPECT_FALSE(pdep.isEmpty());
+    EXPECT_FALSE(pdep.lexMin({5}).hasValue());
+    EXPECT_EQ((*pdep.lexMin({6}))[0], 5);
+    IntMatrix smallN{stringToIntMatrix("[5 -1]")};
+    EXPECT_TRUE(PIP(D, G, smallN, 1).isEmpty());
+    // with `N >= 6`, `i <= 5` holds for all solutions, but not `i <= 4`
+    IntMatrix largeN{stringToIntMatrix("[-6 1]")};
+    IntMatrix q5{stringToIntMatrix("[5 0 -1]")};
+    IntMatrix q4{stringToIntMatrix("[4 0 -1]")};
+    EXPECT_TRUE(PIP::knownGreaterEqual(D, G, largeN, 1, q5.getRow(0)));
+    EXPECT_FALSE(PIP::knownGreaterEqual(D, G, largeN, 1, q4.getRow(0)));
+}
+TEST(PIPBudgetTest, BasicAssertions) {
+    // 0 <= x, y, z <= 6 and -3 <= p, q <= 3; the context checks of the cuts
+    // used to each get a budget of their own, so this ran for minutes
+    IntMatrix A{stringToIntMatrix(
+        "[1 2 0 -2 1 -1; -2 -2 -3 2 1 -3; 2 3 1 2 -3 3; 0 0 0 1 0 0; "
+        "6 0 0 -1 0 0; 0 0 0 0 1 0; 6 0 0 0 -1 0; 0 0 0 0 0 1; "
+        "6 0 0 0 0 -1]")};
+    IntMatrix E{stringToIntMatrix("[3 3 -1 -1 -1 -3]")};
+    IntMatrix context{stringToIntMatrix("[3 1 0; 3 -1 0; 3 0 1; 3 0 -1]")};
+    PIP budgeted(A, E, context, 2);
+    EXPECT_FALSE(budgeted.complete);
+    EXPECT_LE(budgeted.steps, budgeted.maxSteps + 2);
+    EXPECT_FALSE(budgeted.isEmpty());
+    PIP pip(A, E, context, 2, 1 << 15);
+    EXPECT_TRUE(pip.complete);
+    EXPECT_FALSE(pip.isEmpty());
+    using Sol = llvm::SmallVector<int64_t>;
+    EXPECT_EQ(*pip.lexMin({1, -3}), (Sol{1, 2, 2}));
+    EXPECT_EQ(*pip.lexMin({2, 1}), (Sol{3, 5, 0}));
+    EXPECT_EQ(*pip.lexMin({3, 2}), (Sol{4, 6, 0}));
+    EXPECT_FALSE(pip.lexMin({0, 0}).hasValue());
+    EXPECT_FALSE(pip.lexMin({1, 2}).hasValue());
+}